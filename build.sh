@@ -39,6 +39,7 @@ $CC -c src/objects/heap.c      -o temp/objects/heap.o      $FLAGS
 $CC -c src/objects/o_int.c     -o temp/objects/o_int.o     $FLAGS
 $CC -c src/objects/o_map.c     -o temp/objects/o_map.o     $FLAGS
 $CC -c src/objects/o_list.c    -o temp/objects/o_list.o    $FLAGS
+$CC -c src/objects/o_tuple.c   -o temp/objects/o_tuple.o   $FLAGS
 $CC -c src/objects/o_none.c    -o temp/objects/o_none.o    $FLAGS
 $CC -c src/objects/o_bool.c    -o temp/objects/o_bool.o    $FLAGS
 $CC -c src/objects/o_file.c    -o temp/objects/o_file.o    $FLAGS
@@ -52,9 +53,13 @@ $CC -c src/objects/objects.c   -o temp/objects/objects.o   $FLAGS
 mkdir temp/compiler
 $CC -c src/compiler/parse.c      -o temp/compiler/parse.o      $FLAGS
 $CC -c src/compiler/compile.c    -o temp/compiler/compile.o    $FLAGS
+$CC -c src/compiler/aot.c        -o temp/compiler/aot.o        $FLAGS
+$CC -c src/compiler/infer.c      -o temp/compiler/infer.o      $FLAGS
+$CC -c src/compiler/inline.c     -o temp/compiler/inline.o     $FLAGS
 
 mkdir temp/common
 $CC -c src/common/executable.c -o temp/common/executable.o $FLAGS
+$CC -c src/common/profile.c    -o temp/common/profile.o    $FLAGS
 
 mkdir temp/runtime
 $CC -c src/runtime/runtime_error.c -o temp/runtime/runtime_error.o $FLAGS
@@ -62,6 +67,7 @@ $CC -c src/runtime/runtime.c 	   -o temp/runtime/runtime.o       $FLAGS
 $CC -c src/runtime/o_nfunc.c       -o temp/runtime/o_nfunc.o       $FLAGS
 $CC -c src/runtime/o_func.c        -o temp/runtime/o_func.o        $FLAGS
 $CC -c src/runtime/o_staticmap.c   -o temp/runtime/o_staticmap.o   $FLAGS
+$CC -c src/runtime/jit.c           -o temp/runtime/jit.o           $FLAGS
 
 mkdir temp/builtins
 $CC -c src/builtins/basic.c -o temp/builtins/basic.o $FLAGS
@@ -81,16 +87,20 @@ ar rcs build/libnoja-objects.a \
 ar rcs build/libnoja-compile.a \
 	temp/compiler/parse.o   \
 	temp/compiler/compile.o \
+	temp/compiler/aot.o     \
+	temp/compiler/infer.o   \
+	temp/compiler/inline.o  \
 	temp/utils/bpalloc.o    \
 	temp/utils/error.o      \
 	temp/utils/source.o
 
 ar rcs build/libnoja-runtime.a \
-	temp/runtime/runtime.o  \
-	temp/runtime/runtime_error.o \
-	temp/runtime/o_func.o   \
-	build/libnoja-compile.a \
-	build/libnoja-objects.a
+	temp/utils/*.o    \
+	temp/objects/*.o  \
+	temp/compiler/*.o \
+	temp/common/*.o   \
+	temp/runtime/*.o  \
+	temp/builtins/*.o
 
 $CC src/main.c \
 	temp/utils/utf8.o        \
@@ -102,6 +112,7 @@ $CC src/main.c \
 	temp/objects/o_map.o     \
 	temp/objects/o_none.o    \
 	temp/objects/o_list.o    \
+	temp/objects/o_tuple.o   \
 	temp/objects/o_file.o    \
 	temp/objects/o_dir.o     \
 	temp/objects/o_bool.o    \
@@ -113,10 +124,12 @@ $CC src/main.c \
 	temp/runtime/o_nfunc.o   \
 	temp/runtime/o_func.o    \
 	temp/runtime/o_staticmap.o \
+	temp/runtime/jit.o       \
 	temp/builtins/basic.o    \
 	temp/builtins/files.o    \
 	temp/builtins/math.o     \
 	temp/common/executable.o \
-	-o build/noja $FLAGS -Lbuild/ -lnoja-compile -lnoja-objects -lm
+	temp/common/profile.o    \
+	-o build/noja $FLAGS -Lbuild/ -lnoja-compile -lnoja-objects -lm -lpthread
 
 rm -rf temp
@@ -39,13 +39,23 @@
 
 static int bin_print(Runtime *runtime, Object **argv, unsigned int argc, Object **rets, unsigned int maxretc, Error *error)
 {
-	(void) runtime;
 	(void) rets;
 	(void) maxretc;
-	(void) error;
 
 	for(int i = 0; i < (int) argc; i += 1)
+	{
+		// Ropes are flattened here, where there's a
+		// heap, instead of being copied every time
+		// they're printed.
+		if(Object_IsString(argv[i]))
+		{
+			int size;
+			if(Object_ToString(argv[i], &size, Runtime_GetHeap(runtime), error) == NULL)
+				return -1;
+		}
+
 		Object_Print(argv[i], stdout);
+	}
 	return 0;
 }
 
@@ -57,7 +67,7 @@ static int bin_type(Runtime *runtime, Object **argv, unsigned int argc, Object *
 
 	if(maxretc == 0)
 		return 0;
-	rets[0] = (Object*) argv[0]->type;
+	rets[0] = (Object*) Object_GetType(argv[0]);
 	return 1;
 }
 
@@ -247,65 +257,33 @@ static int bin_error(Runtime *runtime, Object **argv, unsigned int argc, Object
 	if(string == NULL)
 		return -1;
 
-	Error_Report(error, 0, "%s", string);
+	Error_Report(error, 0, "%.*s", length, string);
 	return -1;
 }
 
 static int bin_strcat(Runtime *runtime, Object **argv, unsigned int argc, Object **rets, unsigned int maxretc, Error *error)
 {
-	unsigned int total_count = 0;
-
 	for(unsigned int i = 0; i < argc; i += 1)
-	{
 		if(!Object_IsString(argv[i]))
 		{
 			Error_Report(error, 0, "Argument #%d is not a string", i+1);
 			return -1;
 		}
 
-		total_count += Object_Count(argv[i], error);
-
-		if(error->occurred)
-			return -1;
-	}
-
-	char starting[128];
-	char *buffer = starting;
-
-	if(total_count > sizeof(starting)-1)
-	{
-		buffer = malloc(total_count+1);
-
-		if(buffer == NULL)
-		{
-			Error_Report(error, 1, "No memory");
-			return -1;
-		}
-	}
-
-	Object *result = NULL;
+	Object *result;
 
-	for(unsigned int i = 0, written = 0; i < argc; i += 1)
+	if(argc == 0)
+		result = Object_FromString("", 0, Runtime_GetHeap(runtime), error);
+	else
 	{
-		int n;
-		const char *s = Object_ToString(argv[i], &n, 
-			Runtime_GetHeap(runtime), error);
-
-		if(error->occurred)
-			goto done;
-
-		memcpy(buffer + written, s, n);
-		written += n;
+		// Concatenations only copy short strings,
+		// so this is linear in the number of
+		// arguments rather than in their size.
+		result = argv[0];
+		for(unsigned int i = 1; i < argc && result != NULL; i += 1)
+			result = Object_ConcatString(result, argv[i], Runtime_GetHeap(runtime), error);
 	}
 
-	buffer[total_count] = '\0';
-
-	result = Object_FromString(buffer, total_count, Runtime_GetHeap(runtime), error);
-
-done:
-	if(starting != buffer)
-		free(buffer);
-
 	if(result == NULL)
 		return -1;
 
@@ -356,6 +334,40 @@ static int bin_sliceBuffer(Runtime *runtime, Object **argv, unsigned int argc, O
 	return 1;
 }
 
+static int bin_sliceString(Runtime *runtime, Object **argv, unsigned int argc, Object **rets, unsigned int maxretc, Error *error)
+{
+	assert(argc == 3);
+
+	long long int offset = Object_ToInt(argv[1], error);
+	if(error->occurred == 1) return -1;
+
+	long long int length = Object_ToInt(argv[2], error);
+	if(error->occurred == 1) return -1;
+
+	Object *temp = Object_SliceString(argv[0], offset, length, Runtime_GetHeap(runtime), error);
+
+	if(temp == NULL)
+		return -1;
+
+	if(maxretc == 0)
+		return 0;
+	rets[0] = temp;
+	return 1;
+}
+
+static int bin_tuple(Runtime *runtime, Object **argv, unsigned int argc, Object **rets, unsigned int maxretc, Error *error)
+{
+	Object *tuple = Object_NewTuple(argc, argv, Runtime_GetHeap(runtime), error);
+
+	if(tuple == NULL)
+		return -1;
+
+	if(maxretc == 0)
+		return 0;
+	rets[0] = tuple;
+	return 1;
+}
+
 static int bin_bufferToString(Runtime *runtime, Object **argv, unsigned int argc, Object **rets, unsigned int maxretc, Error *error)
 {
 	assert(argc == 1);
@@ -389,6 +401,8 @@ const StaticMapSlot bins_basic[] = {
 	{ "bufferToString", SM_FUNCT, .as_funct = bin_bufferToString, .argc = 1 },
 
 	{ "strcat", SM_FUNCT, .as_funct = bin_strcat, .argc = -1 },
+	{ "sliceString", SM_FUNCT, .as_funct = bin_sliceString, .argc = 3 },
+	{ "tuple", SM_FUNCT, .as_funct = bin_tuple, .argc = -1 },
 
 	{ "type", SM_FUNCT, .as_funct = bin_type, .argc = 1 },
 	{ "unicode", SM_FUNCT, .as_funct = bin_unicode, .argc = 1 },
@@ -41,6 +41,8 @@ typedef struct {
 	Opcode 	opcode;
 	int 	offset;
 	int 	length;
+	int 	caller; // Offset of the inlined call the instruction belongs to, or -1.
+	void   *cache;  // See [Executable_GetInstrCache].
 	union {
 		long long int as_int;
 		double 		  as_float;
@@ -53,11 +55,13 @@ struct xExecutable {
 	char 		*head;
 	Instruction *body;
 	Source 		*src;
+	void 		*cache_owner;
 };
 
 struct xExeBuilder {
 	BucketList *data, *code;
 	int promc;
+	int caller; // Given to the instructions that are appended.
 };
 
 typedef struct {
@@ -86,7 +90,7 @@ static const InstrInfo instr_table[] = {
 	[OPCODE_LEQ] = {"LEQ", 0, NULL},
 	[OPCODE_GEQ] = {"GEQ", 0, NULL},
 	[OPCODE_AND] = {"AND", 0, NULL},
-	[OPCODE_OR] = {"AND", 0, NULL},
+	[OPCODE_OR] = {"OR", 0, NULL},
 
 	[OPCODE_ASS]  = {"ASS", 1, (OperandType[]) {OPTP_STRING}},
 	[OPCODE_POP]  = {"POP", 1, (OperandType[]) {OPTP_INT}},
@@ -110,6 +114,40 @@ static const InstrInfo instr_table[] = {
 	[OPCODE_JUMPIFNOTANDPOP] = {"JUMPIFNOTANDPOP", 1, (OperandType[]) {OPTP_INT}},
 	[OPCODE_JUMPIFANDPOP] = {"JUMPIFANDPOP", 1, (OperandType[]) {OPTP_INT}},
 	[OPCODE_JUMP] = {"JUMP", 1, (OperandType[]) {OPTP_INT}},
+
+	[OPCODE_ADDI] = {"ADDI", 0, NULL},
+	[OPCODE_SUBI] = {"SUBI", 0, NULL},
+	[OPCODE_MULI] = {"MULI", 0, NULL},
+	[OPCODE_DIVI] = {"DIVI", 0, NULL},
+	[OPCODE_LSSI] = {"LSSI", 0, NULL},
+	[OPCODE_GRTI] = {"GRTI", 0, NULL},
+	[OPCODE_LEQI] = {"LEQI", 0, NULL},
+	[OPCODE_GEQI] = {"GEQI", 0, NULL},
+	[OPCODE_ADDF] = {"ADDF", 0, NULL},
+	[OPCODE_SUBF] = {"SUBF", 0, NULL},
+	[OPCODE_MULF] = {"MULF", 0, NULL},
+	[OPCODE_DIVF] = {"DIVF", 0, NULL},
+	[OPCODE_LSSF] = {"LSSF", 0, NULL},
+	[OPCODE_GRTF] = {"GRTF", 0, NULL},
+	[OPCODE_LEQF] = {"LEQF", 0, NULL},
+	[OPCODE_GEQF] = {"GEQF", 0, NULL},
+
+	[OPCODE_ADDGI] = {"ADDGI", 0, NULL},
+	[OPCODE_SUBGI] = {"SUBGI", 0, NULL},
+	[OPCODE_MULGI] = {"MULGI", 0, NULL},
+	[OPCODE_DIVGI] = {"DIVGI", 0, NULL},
+	[OPCODE_LSSGI] = {"LSSGI", 0, NULL},
+	[OPCODE_GRTGI] = {"GRTGI", 0, NULL},
+	[OPCODE_LEQGI] = {"LEQGI", 0, NULL},
+	[OPCODE_GEQGI] = {"GEQGI", 0, NULL},
+	[OPCODE_ADDGF] = {"ADDGF", 0, NULL},
+	[OPCODE_SUBGF] = {"SUBGF", 0, NULL},
+	[OPCODE_MULGF] = {"MULGF", 0, NULL},
+	[OPCODE_DIVGF] = {"DIVGF", 0, NULL},
+	[OPCODE_LSSGF] = {"LSSGF", 0, NULL},
+	[OPCODE_GRTGF] = {"GRTGF", 0, NULL},
+	[OPCODE_LEQGF] = {"LEQGF", 0, NULL},
+	[OPCODE_GEQGF] = {"GEQGF", 0, NULL},
 };
 
 const char *Executable_GetOpcodeName(Opcode opcode)
@@ -117,6 +155,26 @@ const char *Executable_GetOpcodeName(Opcode opcode)
 	return instr_table[opcode].name;
 }
 
+// Returns the generic instruction that a specialized
+// one (ADDI, ADDGF, ..) stands for. Other opcodes are
+// returned as they are.
+Opcode Executable_GetGenericOpcode(Opcode opcode)
+{
+	switch(opcode)
+	{
+		case OPCODE_ADDI: case OPCODE_ADDF: case OPCODE_ADDGI: case OPCODE_ADDGF: return OPCODE_ADD;
+		case OPCODE_SUBI: case OPCODE_SUBF: case OPCODE_SUBGI: case OPCODE_SUBGF: return OPCODE_SUB;
+		case OPCODE_MULI: case OPCODE_MULF: case OPCODE_MULGI: case OPCODE_MULGF: return OPCODE_MUL;
+		case OPCODE_DIVI: case OPCODE_DIVF: case OPCODE_DIVGI: case OPCODE_DIVGF: return OPCODE_DIV;
+		case OPCODE_LSSI: case OPCODE_LSSF: case OPCODE_LSSGI: case OPCODE_LSSGF: return OPCODE_LSS;
+		case OPCODE_GRTI: case OPCODE_GRTF: case OPCODE_GRTGI: case OPCODE_GRTGF: return OPCODE_GRT;
+		case OPCODE_LEQI: case OPCODE_LEQF: case OPCODE_LEQGI: case OPCODE_LEQGF: return OPCODE_LEQ;
+		case OPCODE_GEQI: case OPCODE_GEQF: case OPCODE_GEQGI: case OPCODE_GEQGF: return OPCODE_GEQ;
+		default: break;
+	}
+	return opcode;
+}
+
 Executable *Executable_Copy(Executable *exe)
 {
 	assert(exe != NULL);
@@ -205,6 +263,54 @@ int Executable_GetInstrOffset(Executable *exe, int index)
 		return -1;
 }
 
+// Returns the offset of the call that was inlined
+// to produce the instruction at [index], or -1 if
+// the instruction isn't part of an inlined call.
+int Executable_GetInlinedCall(Executable *exe, int index)
+{
+	if(index < 0 || index >= exe->bodyl)
+		return -1;
+
+	if(exe->src)
+		return exe->body[index].caller;
+	else
+		return -1;
+}
+
+/* Symbol: Executable_GetInstrCache
+ *
+ *   Each instruction has a slot where the code that 
+ *   runs it can keep something it computed from the
+ *   operands, so that it doesn't need to compute it 
+ *   every time the instruction runs. Only the first
+ *   [owner] that stores something in the slots can
+ *   use them, since the things stored may only make
+ *   sense to it.
+ *
+ * Returns:
+ *   What was stored in the slot of the instruction
+ *   at [index], or NULL.
+ */
+void *Executable_GetInstrCache(Executable *exe, int index, void *owner)
+{
+	if(index < 0 || index >= exe->bodyl || exe->cache_owner != owner)
+		return NULL;
+
+	return exe->body[index].cache;
+}
+
+void Executable_SetInstrCache(Executable *exe, int index, void *owner, void *value)
+{
+	if(index < 0 || index >= exe->bodyl)
+		return;
+
+	if(exe->cache_owner == NULL)
+		exe->cache_owner = owner;
+
+	if(exe->cache_owner == owner)
+		exe->body[index].cache = value;
+}
+
 int Executable_GetInstrLength(Executable *exe, int index)
 {
 	if(index < 0 || index >= exe->bodyl)
@@ -216,6 +322,11 @@ int Executable_GetInstrLength(Executable *exe, int index)
 		return -1;
 }
 
+int Executable_GetInstrCount(Executable *exe)
+{
+	return exe->bodyl;
+}
+
 _Bool Executable_Fetch(Executable *exe, int index, Opcode *opcode, Operand *ops, int *opc)
 {
 	assert(index >= 0);
@@ -285,6 +396,7 @@ ExeBuilder *ExeBuilder_New(BPAlloc *alloc)
 		return NULL;
 
 	exeb->promc = 0;
+	exeb->caller = -1;
 	exeb->data = BucketList_New(alloc);
 	exeb->code = BucketList_New(alloc);
 
@@ -325,6 +437,7 @@ Executable *ExeBuilder_Finalize(ExeBuilder *exeb, Error *error)
 		exe->head = (char*) (exe->body + exe->bodyl);
 		exe->refs = 1;
 		exe->src = NULL;
+		exe->cache_owner = NULL;
 		
 	}
 
@@ -333,6 +446,14 @@ Executable *ExeBuilder_Finalize(ExeBuilder *exeb, Error *error)
 	return exe;
 }
 
+// Marks the instructions appended from now on as
+// part of the call at [offset] of the source, which
+// was inlined. An [offset] of -1 ends the call.
+void ExeBuilder_SetInlinedCall(ExeBuilder *exeb, int offset)
+{
+	exeb->caller = offset;
+}
+
 static void promise_callback(void *userp)
 {
 	assert(userp != NULL);
@@ -391,6 +512,8 @@ _Bool ExeBuilder_Append(ExeBuilder *exeb, Error *error, Opcode opcode, Operand *
 		instr->opcode = opcode;
 		instr->offset = off;
 		instr->length = len;
+		instr->caller = exeb->caller;
+		instr->cache  = NULL;
 
 		for(int i = 0; i < opc; i += 1)
 		{
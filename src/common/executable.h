@@ -87,6 +87,47 @@ typedef enum {
 	OPCODE_JUMPIFANDPOP,
 	OPCODE_JUMPIFNOTANDPOP,
 	OPCODE_JUMP,
+
+	// Versions of the arithmetic and relational
+	// instructions that assume both operands to
+	// be ints (I) or floats (F).
+	OPCODE_ADDI,
+	OPCODE_SUBI,
+	OPCODE_MULI,
+	OPCODE_DIVI,
+	OPCODE_LSSI,
+	OPCODE_GRTI,
+	OPCODE_LEQI,
+	OPCODE_GEQI,
+	OPCODE_ADDF,
+	OPCODE_SUBF,
+	OPCODE_MULF,
+	OPCODE_DIVF,
+	OPCODE_LSSF,
+	OPCODE_GRTF,
+	OPCODE_LEQF,
+	OPCODE_GEQF,
+
+	// Versions that the compiler only expects to
+	// receive ints (GI) or floats (GF) because a
+	// profile says so. They check the operands and
+	// fall back to the generic operation.
+	OPCODE_ADDGI,
+	OPCODE_SUBGI,
+	OPCODE_MULGI,
+	OPCODE_DIVGI,
+	OPCODE_LSSGI,
+	OPCODE_GRTGI,
+	OPCODE_LEQGI,
+	OPCODE_GEQGI,
+	OPCODE_ADDGF,
+	OPCODE_SUBGF,
+	OPCODE_MULGF,
+	OPCODE_DIVGF,
+	OPCODE_LSSGF,
+	OPCODE_GRTGF,
+	OPCODE_LEQGF,
+	OPCODE_GEQGF,
 } Opcode;
 
 typedef struct xExecutable Executable;
@@ -100,10 +141,16 @@ _Bool 		Executable_SetSource(Executable *exe, Source *src);
 Source 	   *Executable_GetSource(Executable *exe);
 int 		Executable_GetInstrOffset(Executable *exe, int index);
 int 		Executable_GetInstrLength(Executable *exe, int index);
+int 		Executable_GetInlinedCall(Executable *exe, int index);
+void 	   *Executable_GetInstrCache(Executable *exe, int index, void *owner);
+void 		Executable_SetInstrCache(Executable *exe, int index, void *owner, void *value);
+int 		Executable_GetInstrCount(Executable *exe);
 const char *Executable_GetOpcodeName(Opcode opcode);
+Opcode		Executable_GetGenericOpcode(Opcode opcode);
 
 ExeBuilder *ExeBuilder_New(BPAlloc *alloc);
 _Bool 		ExeBuilder_Append(ExeBuilder *exeb, Error *error, Opcode opcode, Operand *opv, int opc, int off, int len);
+void 		ExeBuilder_SetInlinedCall(ExeBuilder *exeb, int offset);
 Executable *ExeBuilder_Finalize(ExeBuilder *exeb, Error *error);
 BPAlloc    *ExeBuilder_GetAlloc(ExeBuilder *exeb);
 int 		ExeBuilder_InstrCount(ExeBuilder *exeb);
@@ -0,0 +1,201 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+** |                                                                          | 
+** |                          WHAT IS THIS FILE?                              |
+** | This file implements type profiles. A profile holds, for each            |
+** | instruction of an executable, the types of the operands it was executed  |
+** | with. The runtime fills a profile while running and can save it to a     |
+** | file, so that a later run of the same source can load it and compile     |
+** | the instructions that only saw ints or floats to their specialized form. |
+** |                                                                          |
+** | Profiles refer to instructions by index, so they're keyed by a hash of   |
+** | the source and by a hash of the shape of the executable, which is the    |
+** | sequence of its opcodes with the specialized ones replaced by their      |
+** | generic form. The same source compiled with different settings (with or  |
+** | without inlining, for instance) has a different shape and won't match.   |
+** |                                                                          |
+** | The file format is textual. The first line is                            |
+** |                                                                          |
+** |     noja-profile <hash> <shape> <count>                                  |
+** |                                                                          |
+** | and it's followed by a line for each instruction that was profiled:      |
+** |                                                                          |
+** |     <index> <bits>                                                       |
+** +--------------------------------------------------------------------------+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../utils/hash.h"
+#include "profile.h"
+
+struct xProfile {
+	int hash, shape, count;
+	unsigned char bits[];
+};
+
+static int hash_source(Source *src)
+{
+	return hashbytes((unsigned char*) Source_GetBody(src), Source_GetSize(src));
+}
+
+// Hashes the opcodes of [exe] and their operand
+// counts. Specialized opcodes are hashed as their
+// generic form, since which instructions are
+// specialized depends on the profile itself.
+static int hash_shape(Executable *exe)
+{
+	unsigned int state = 0;
+	int count = Executable_GetInstrCount(exe);
+
+	for(int i = 0; i < count; i += 1)
+	{
+		Opcode opcode;
+		Operand ops[3];
+		int     opc = sizeof(ops) / sizeof(ops[0]);
+
+		(void) Executable_Fetch(exe, i, &opcode, ops, &opc);
+
+		unsigned char bytes[] = { Executable_GetGenericOpcode(opcode), opc };
+		state = hashstep(state, bytes, sizeof(bytes));
+	}
+	return hashfinish(state, count);
+}
+
+static Profile *new_profile(int hash, int shape, int count)
+{
+	Profile *profile = calloc(1, sizeof(Profile) + count);
+
+	if(profile == NULL)
+		return NULL;
+
+	profile->hash = hash;
+	profile->shape = shape;
+	profile->count = count;
+	return profile;
+}
+
+Profile *Profile_New(Executable *exe)
+{
+	return new_profile(hash_source(Executable_GetSource(exe)), hash_shape(exe), Executable_GetInstrCount(exe));
+}
+
+void Profile_Free(Profile *profile)
+{
+	free(profile);
+}
+
+_Bool Profile_Matches(Profile *profile, Executable *exe)
+{
+	return profile->hash  == hash_source(Executable_GetSource(exe))
+		&& profile->count == Executable_GetInstrCount(exe)
+		&& profile->shape == hash_shape(exe);
+}
+
+void Profile_Record(Profile *profile, int index, unsigned char bits)
+{
+	if(index >= 0 && index < profile->count)
+		profile->bits[index] |= bits;
+}
+
+unsigned char Profile_Get(Profile *profile, int index)
+{
+	if(profile == NULL || index < 0 || index >= profile->count)
+		return 0;
+	return profile->bits[index];
+}
+
+_Bool Profile_Save(Profile *profile, const char *file, Error *error)
+{
+	FILE *fp = fopen(file, "w");
+
+	if(fp == NULL)
+	{
+		Error_Report(error, 0, "Couldn't open %s", file);
+		return 0;
+	}
+
+	fprintf(fp, "noja-profile %d %d %d\n", profile->hash, profile->shape, profile->count);
+
+	for(int i = 0; i < profile->count; i += 1)
+		if(profile->bits[i] != 0)
+			fprintf(fp, "%d %d\n", i, profile->bits[i]);
+
+	if(fclose(fp))
+	{
+		Error_Report(error, 0, "Couldn't write %s", file);
+		return 0;
+	}
+	return 1;
+}
+
+Profile *Profile_Load(const char *file, Error *error)
+{
+	FILE *fp = fopen(file, "r");
+
+	if(fp == NULL)
+	{
+		Error_Report(error, 0, "Couldn't open %s", file);
+		return NULL;
+	}
+
+	int hash, shape, count;
+
+	if(fscanf(fp, "noja-profile %d %d %d", &hash, &shape, &count) != 3 || count < 0)
+	{
+		Error_Report(error, 0, "%s isn't a profile", file);
+		fclose(fp);
+		return NULL;
+	}
+
+	Profile *profile = new_profile(hash, shape, count);
+
+	if(profile == NULL)
+	{
+		Error_Report(error, 1, "No memory");
+		fclose(fp);
+		return NULL;
+	}
+
+	int index, bits;
+
+	while(fscanf(fp, "%d %d", &index, &bits) == 2)
+		Profile_Record(profile, index, bits);
+
+	if(!feof(fp))
+	{
+		Error_Report(error, 0, "%s is malformed", file);
+		Profile_Free(profile);
+		fclose(fp);
+		return NULL;
+	}
+
+	fclose(fp);
+	return profile;
+}
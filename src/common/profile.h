@@ -0,0 +1,53 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+#include "../utils/error.h"
+#include "../utils/source.h"
+#include "executable.h"
+
+// Operand types observed by an instruction.
+enum {
+	PROFILE_INT   = 1, // Both operands were ints.
+	PROFILE_FLOAT = 2, // Both operands were floats.
+	PROFILE_OTHER = 4, // Anything else.
+};
+
+typedef struct xProfile Profile;
+
+Profile 	*Profile_New(Executable *exe);
+void 		 Profile_Free(Profile *profile);
+_Bool 		 Profile_Matches(Profile *profile, Executable *exe);
+void 		 Profile_Record(Profile *profile, int index, unsigned char bits);
+unsigned char Profile_Get(Profile *profile, int index);
+_Bool 		 Profile_Save(Profile *profile, const char *file, Error *error);
+Profile 	*Profile_Load(const char *file, Error *error);
+#endif
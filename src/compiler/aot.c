@@ -0,0 +1,549 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+** |                                                                          | 
+** |                          WHAT IS THIS FILE?                              |
+** | This file implements the ahead-of-time compiler, which lowers an         |
+** | `Executable` to a C translation unit. The generated file can be built    |
+** | into a standalone program by linking it to `libnoja-runtime.a`.          |
+** |                                                                          |
+** |                          HOW DOES IT WORK?                               |
+** | The generated file contains:                                             |
+** |   - The source code of the script, so that errors can be reported like   |
+** |     the interpreter would;                                               |
+** |   - The table of instructions of the executable, which is used to build  |
+** |     again the `Executable` when the program starts, since functions and  |
+** |     error reports refer to it;                                           |
+** |   - A function that implements the executable's body. Each instruction   |
+** |     becomes code specialized for its opcode, with constant operands:     |
+** |     arithmetic and comparisons on ints are done inline (the operands are |
+** |     checked by `Runtime_TopInts`, unless the compiler proved them), and  |
+** |     conditional jumps test the boolean inline. The frequent instructions |
+** |     (PUSHINT, PUSHVAR, ASS, POP, CALL, SELECT, INSERT and the generic    |
+** |     arithmetic) call the runtime's entry point for that instruction,     |
+** |     which goes straight to the object API. Only the remaining ones, and  |
+** |     the operations on ints whose operands turn out not to be ints, call  |
+** |     `Runtime_ExecInstr`. Jumps become `goto`s, so that no fetching,      |
+** |     decoding and dispatching is left to do at runtime. Functions are     |
+** |     entered by jumping to their first instruction through a `switch`;    |
+** |   - A `main` that sets up a runtime, registers the body function as the  |
+** |     native implementation of the executable and runs it.                 |
+** +--------------------------------------------------------------------------+
+*/
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include "../utils/defs.h"
+#include "aot.h"
+
+#define MAX_OPS 3
+
+typedef struct {
+	Opcode  opcode;
+	Operand ops[MAX_OPS];
+	int     opc;
+	_Bool   entry;  // Functions may start here.
+	_Bool   target; // Jumps may land here.
+} Instr;
+
+static void write_c_string(FILE *fp, const char *str, int len)
+{
+	fprintf(fp, "\"");
+
+	for(int i = 0; i < len; i += 1)
+	{
+		unsigned char c = str[i];
+
+		if(c == '\n')
+		{
+			fprintf(fp, "\\n");
+
+			// Break the literal after newlines to 
+			// keep the generated file readable.
+			if(i+1 < len)
+				fprintf(fp, "\"\n\t\"");
+		}
+		else if(c == '"' || c == '\\' || c == '?')
+			fprintf(fp, "\\%c", c);
+		else if(c >= 32 && c < 127)
+			fprintf(fp, "%c", c);
+		else
+			fprintf(fp, "\\%03o", c);
+	}
+
+	fprintf(fp, "\"");
+}
+
+static void write_operand(FILE *fp, Operand *op)
+{
+	switch(op->type)
+	{
+		case OPTP_INT:
+		fprintf(fp, "{ .type = OPTP_INT, .as_int = %lldLL }", op->as_int);
+		break;
+
+		case OPTP_FLOAT:
+		if(isfinite(op->as_float))
+			fprintf(fp, "{ .type = OPTP_FLOAT, .as_float = %a }", op->as_float);
+		else
+			// Infinities and NaNs have no literal,
+			// so their bits are stored instead.
+			fprintf(fp, "{ .type = OPTP_FLOAT, .as_int = %lldLL }", op->as_int);
+		break;
+
+		case OPTP_STRING:
+		fprintf(fp, "{ .type = OPTP_STRING, .as_string = ");
+		write_c_string(fp, op->as_string, strlen(op->as_string));
+		fprintf(fp, " }");
+		break;
+
+		case OPTP_PROMISE:
+		UNREACHABLE;
+		break;
+	}
+}
+
+// Returns the C operator that implements an arithmetic
+// or relational instruction on ints, or NULL if there's
+// no inline version of it. The [guarded] flag is set to
+// false when the compiler proved the operands to be ints.
+static const char *get_int_operator(Opcode opcode, _Bool *guarded)
+{
+	switch(opcode)
+	{
+		case OPCODE_ADDI: case OPCODE_SUBI: case OPCODE_MULI:
+		case OPCODE_LSSI: case OPCODE_GRTI: case OPCODE_LEQI: case OPCODE_GEQI:
+		*guarded = 0;
+		break;
+
+		case OPCODE_ADD: case OPCODE_SUB: case OPCODE_MUL:
+		case OPCODE_LSS: case OPCODE_GRT: case OPCODE_LEQ: case OPCODE_GEQ:
+		case OPCODE_EQL: case OPCODE_NQL:
+		case OPCODE_ADDGI: case OPCODE_SUBGI: case OPCODE_MULGI:
+		case OPCODE_LSSGI: case OPCODE_GRTGI: case OPCODE_LEQGI: case OPCODE_GEQGI:
+		*guarded = 1;
+		break;
+
+		default: 
+		return NULL;
+	}
+
+	switch(Executable_GetGenericOpcode(opcode))
+	{
+		case OPCODE_ADD: return "+";
+		case OPCODE_SUB: return "-";
+		case OPCODE_MUL: return "*";
+		case OPCODE_LSS: return "<";
+		case OPCODE_GRT: return ">";
+		case OPCODE_LEQ: return "<=";
+		case OPCODE_GEQ: return ">=";
+		case OPCODE_EQL: return "==";
+		case OPCODE_NQL: return "!=";
+		default: break;
+	}
+	UNREACHABLE;
+	return NULL;
+}
+
+// Writes the call that executes the instruction in
+// the general case, as the condition of an [if].
+static void write_general_case(FILE *fp, Instr *instr, int index)
+{
+	const char *name = Executable_GetOpcodeName(instr->opcode);
+
+	switch(instr->opcode)
+	{
+		case OPCODE_ADD: case OPCODE_SUB: case OPCODE_MUL: case OPCODE_DIV:
+		case OPCODE_LSS: case OPCODE_GRT: case OPCODE_LEQ: case OPCODE_GEQ:
+		fprintf(fp, "Runtime_ExecMathOp(runtime, error, %d, OPCODE_%s) < 0", index, name);
+		break;
+
+		default:
+		fprintf(fp, "Runtime_ExecInstr(runtime, error, %d, OPCODE_%s, code[%d].ops, %d) < 0", index, name, index, instr->opc);
+		break;
+	}
+}
+
+static void write_instr(FILE *fp, Instr *instrs, int index)
+{
+	Instr *instr = instrs + index;
+	const char *name = Executable_GetOpcodeName(instr->opcode);
+
+	if(instr->entry || instr->target)
+		fprintf(fp, "L%d:\n", index);
+
+	_Bool guarded;
+	const char *oper = get_int_operator(instr->opcode, &guarded);
+
+	if(oper != NULL)
+	{
+		// Operations on ints are done inline, and the
+		// arithmetic ones only call the runtime to 
+		// allocate the result.
+		fprintf(fp, "\tif(Runtime_TopInts(runtime, %d, &lop, &rop))\n", guarded);
+
+		switch(Executable_GetGenericOpcode(instr->opcode))
+		{
+			case OPCODE_ADD:
+			case OPCODE_SUB:
+			case OPCODE_MUL:
+			fprintf(fp, "\t{\n");
+			fprintf(fp, "\t\tif(Runtime_ExecIntResult(runtime, error, %d, lop %s rop) < 0) return;\n", index, oper);
+			fprintf(fp, "\t}\n");
+			break;
+
+			default:
+			fprintf(fp, "\t\tRuntime_ReplaceTopWithBool(runtime, error, lop %s rop);\n", oper);
+			break;
+		}
+
+		fprintf(fp, "\telse if(");
+		write_general_case(fp, instr, index);
+		fprintf(fp, ") return;\n");
+		return;
+	}
+
+	switch(instr->opcode)
+	{
+		case OPCODE_NOPE:
+		break;
+
+		case OPCODE_JUMP:
+		fprintf(fp, "\tgoto L%lld;\n", instr->ops[0].as_int);
+		break;
+
+		case OPCODE_RETURN:
+		fprintf(fp, "\t(void) Runtime_ExecInstr(runtime, error, %d, OPCODE_%s, code[%d].ops, %d);\n", index, name, index, instr->opc);
+		fprintf(fp, "\treturn;\n");
+		break;
+
+		case OPCODE_JUMPIFANDPOP:
+		case OPCODE_JUMPIFNOTANDPOP:
+		fprintf(fp, "\tif(Runtime_PopCondition(runtime, error, &cond))\n");
+		fprintf(fp, "\t{\n");
+		fprintf(fp, "\t\tif(%scond) goto L%lld;\n", instr->opcode == OPCODE_JUMPIFNOTANDPOP ? "!" : "", instr->ops[0].as_int);
+		fprintf(fp, "\t}\n");
+		fprintf(fp, "\telse\n");
+		fprintf(fp, "\t{\n");
+		fprintf(fp, "\t\tnext = Runtime_ExecInstr(runtime, error, %d, OPCODE_%s, code[%d].ops, %d);\n", index, name, index, instr->opc);
+		fprintf(fp, "\t\tif(next < 0) return;\n");
+		fprintf(fp, "\t\tif(next == %lld) goto L%lld;\n", instr->ops[0].as_int, instr->ops[0].as_int);
+		fprintf(fp, "\t}\n");
+		break;
+
+		case OPCODE_PUSHINT:
+		fprintf(fp, "\tif(Runtime_ExecPushInt(runtime, error, %d, code[%d].ops[0].as_int) < 0) return;\n", index, index);
+		break;
+
+		case OPCODE_PUSHVAR:
+		fprintf(fp, "\tif(Runtime_ExecPushVar(runtime, error, %d, code[%d].ops[0].as_string) < 0) return;\n", index, index);
+		break;
+
+		case OPCODE_ASS:
+		fprintf(fp, "\tif(Runtime_ExecAssign(runtime, error, %d, code[%d].ops[0].as_string) < 0) return;\n", index, index);
+		break;
+
+		case OPCODE_POP:
+		fprintf(fp, "\tif(!Runtime_Pop(runtime, error, %lld)) return;\n", instr->ops[0].as_int);
+		break;
+
+		case OPCODE_CALL:
+		fprintf(fp, "\tif(Runtime_ExecCall(runtime, error, %d, %lld, %lld) < 0) return;\n", index, instr->ops[0].as_int, instr->ops[1].as_int);
+		break;
+
+		case OPCODE_SELECT:
+		fprintf(fp, "\tif(Runtime_ExecSelect(runtime, error, %d) < 0) return;\n", index);
+		break;
+
+		case OPCODE_INSERT:
+		case OPCODE_INSERT2:
+		fprintf(fp, "\tif(Runtime_ExecInsert(runtime, error, %d, OPCODE_%s) < 0) return;\n", index, name);
+		break;
+
+		default:
+		fprintf(fp, "\tif(");
+		write_general_case(fp, instr, index);
+		fprintf(fp, ") return;\n");
+		break;
+	}
+}
+
+static const char prologue[] = 
+	"/* This file was generated by the noja ahead-of-time compiler.\n"
+	"** Build it by linking it to the noja runtime:\n"
+	"**\n"
+	"**   $ gcc out.c -I<noja>/src -L<noja>/build -lnoja-runtime -lm -lpthread\n"
+	"*/\n"
+	"#include <stdio.h>\n"
+	"#include \"utils/bpalloc.h\"\n"
+	"#include \"common/executable.h\"\n"
+	"#include \"runtime/runtimei.h\"\n"
+	"#include \"builtins/basic.h\"\n"
+	"\n"
+	"typedef struct {\n"
+	"\tOpcode  opcode;\n"
+	"\tint     offset, length, caller, opc;\n"
+	"\tOperand ops[3];\n"
+	"} Instr;\n"
+	"\n";
+
+static const char epilogue[] = 
+	"static Executable *build(Error *error)\n"
+	"{\n"
+	"\tSource *src = Source_FromString(source_name, source_body, sizeof(source_body)-1, error);\n"
+	"\n"
+	"\tif(src == NULL)\n"
+	"\t\treturn NULL;\n"
+	"\n"
+	"\tBPAlloc *alloc = BPAlloc_Init(-1);\n"
+	"\tExeBuilder *exeb = alloc == NULL ? NULL : ExeBuilder_New(alloc);\n"
+	"\tExecutable *exe = NULL;\n"
+	"\n"
+	"\tif(exeb == NULL)\n"
+	"\t\tError_Report(error, 1, \"No memory\");\n"
+	"\telse\n"
+	"\t{\n"
+	"\t\tint i, n = sizeof(code) / sizeof(code[0]);\n"
+	"\n"
+	"\t\tfor(i = 0; i < n; i += 1)\n"
+	"\t\t{\n"
+	"\t\t\tExeBuilder_SetInlinedCall(exeb, code[i].caller);\n"
+	"\n"
+	"\t\t\tif(!ExeBuilder_Append(exeb, error, code[i].opcode, code[i].ops, code[i].opc, code[i].offset, code[i].length))\n"
+	"\t\t\t\tbreak;\n"
+	"\t\t}\n"
+	"\n"
+	"\t\tif(i == n)\n"
+	"\t\t\texe = ExeBuilder_Finalize(exeb, error);\n"
+	"\n"
+	"\t\tif(exe != NULL && !Executable_SetSource(exe, src))\n"
+	"\t\t{\n"
+	"\t\t\tError_Report(error, 1, \"No memory\");\n"
+	"\t\t\tExecutable_Free(exe);\n"
+	"\t\t\texe = NULL;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\n"
+	"\tif(alloc != NULL)\n"
+	"\t\tBPAlloc_Free(alloc);\n"
+	"\tSource_Free(src);\n"
+	"\treturn exe;\n"
+	"}\n"
+	"\n"
+	"int main(void)\n"
+	"{\n"
+	"\tError error;\n"
+	"\tError_Init(&error);\n"
+	"\n"
+	"\tExecutable *exe = build(&error);\n"
+	"\n"
+	"\tif(exe == NULL)\n"
+	"\t{\n"
+	"\t\tfprintf(stderr, \"Internal Error: %s.\\n\", error.message);\n"
+	"\t\tError_Free(&error);\n"
+	"\t\treturn -1;\n"
+	"\t}\n"
+	"\n"
+	"\tRuntime *runt = Runtime_New(-1, 1024*1024, NULL, NULL);\n"
+	"\n"
+	"\tif(runt == NULL)\n"
+	"\t{\n"
+	"\t\tfprintf(stderr, \"Internal Error: Couldn't initialize runtime.\\n\");\n"
+	"\t\tExecutable_Free(exe);\n"
+	"\t\treturn -1;\n"
+	"\t}\n"
+	"\n"
+	"\tRuntime_SetNativeBody(runt, exe, body);\n"
+	"\n"
+	"\tRuntimeError rerror;\n"
+	"\tRuntimeError_Init(&rerror, runt);\n"
+	"\n"
+	"\tint retc = -1;\n"
+	"\tObject *bins = Object_NewStaticMap(bins_basic, runt, (Error*) &rerror);\n"
+	"\n"
+	"\tif(bins != NULL)\n"
+	"\t{\n"
+	"\t\tObject *rets[8];\n"
+	"\t\tRuntime_SetBuiltins(runt, bins);\n"
+	"\t\tretc = run(runt, (Error*) &rerror, exe, 0, NULL, NULL, 0, rets, sizeof(rets)/sizeof(rets[0]));\n"
+	"\t}\n"
+	"\n"
+	"\tif(retc < 0)\n"
+	"\t{\n"
+	"\t\tfprintf(stderr, \"Runtime Error: %s.\\n\", rerror.base.message);\n"
+	"\n"
+	"\t\tif(rerror.snapshot != NULL)\n"
+	"\t\t\tSnapshot_Print(rerror.snapshot, stderr);\n"
+	"\n"
+	"\t\tRuntimeError_Free(&rerror);\n"
+	"\t}\n"
+	"\n"
+	"\tRuntime_Free(runt);\n"
+	"\tExecutable_Free(exe);\n"
+	"\treturn retc < 0 ? -1 : 0;\n"
+	"}\n";
+
+/* Symbol: generate_c
+ *
+ *   Writes to [fp] a C translation unit that implements
+ *   the program described by [exe]. The executable must
+ *   have a source associated to it.
+ *
+ * Returns:
+ *   1 on success, 0 otherwise. If an error occurred, it
+ *   is reported through the [error] structure.
+ */
+_Bool generate_c(Executable *exe, FILE *fp, Error *error)
+{
+	Source *src = Executable_GetSource(exe);
+
+	if(src == NULL)
+	{
+		Error_Report(error, 1, "Executable has no source");
+		return 0;
+	}
+
+	int count = Executable_GetInstrCount(exe);
+	Instr *instrs = malloc(sizeof(Instr) * (count + 1));
+
+	if(instrs == NULL)
+	{
+		Error_Report(error, 1, "No memory");
+		return 0;
+	}
+
+	for(int i = 0; i < count; i += 1)
+	{
+		instrs[i].opc = MAX_OPS;
+		instrs[i].entry = 0;
+		instrs[i].target = 0;
+		(void) Executable_Fetch(exe, i, &instrs[i].opcode, instrs[i].ops, &instrs[i].opc);
+	}
+
+	// Mark the instructions that need a label. The
+	// jump targets are checked because the code that
+	// uses them wouldn't compile otherwise.
+	instrs[0].entry = 1;
+
+	for(int i = 0; i < count; i += 1)
+	{
+		long long int target = instrs[i].ops[0].as_int;
+		
+		switch(instrs[i].opcode)
+		{
+			case OPCODE_PUSHFUN:
+			case OPCODE_JUMP:
+			case OPCODE_JUMPIFANDPOP:
+			case OPCODE_JUMPIFNOTANDPOP:
+			if(target < 0 || target >= count)
+			{
+				Error_Report(error, 1, "Instruction %d refers to the invalid index %lld", i, target);
+				free(instrs);
+				return 0;
+			}
+
+			if(instrs[i].opcode == OPCODE_PUSHFUN)
+				instrs[target].entry = 1;
+			else
+				instrs[target].target = 1;
+			break;
+
+			default: 
+			break;
+		}
+	}
+
+	fputs(prologue, fp);
+
+	fprintf(fp, "static const char source_name[] = ");
+	const char *name = Source_GetName(src);
+	write_c_string(fp, name == NULL ? "" : name, name == NULL ? 0 : strlen(name));
+	fprintf(fp, ";\n\n");
+
+	fprintf(fp, "static const char source_body[] = \n\t");
+	write_c_string(fp, Source_GetBody(src), Source_GetSize(src));
+	fprintf(fp, ";\n\n");
+
+	fprintf(fp, "static Instr code[] = {\n");
+
+	for(int i = 0; i < count; i += 1)
+	{
+		fprintf(fp, "\t{ OPCODE_%s, %d, %d, %d, %d, { ", 
+			Executable_GetOpcodeName(instrs[i].opcode), 
+			Executable_GetInstrOffset(exe, i), 
+			Executable_GetInstrLength(exe, i),
+			Executable_GetInlinedCall(exe, i),
+			instrs[i].opc);
+
+		for(int j = 0; j < instrs[i].opc; j += 1)
+		{
+			if(j > 0)
+				fprintf(fp, ", ");
+			write_operand(fp, instrs[i].ops + j);
+		}
+
+		fprintf(fp, " } },\n");
+	}
+
+	fprintf(fp, "};\n\n");
+
+	fprintf(fp, "static void body(Runtime *runtime, Error *error, int index)\n");
+	fprintf(fp, "{\n");
+	fprintf(fp, "\tint next;\n");
+	fprintf(fp, "\tlong long int lop, rop;\n");
+	fprintf(fp, "\t_Bool cond;\n");
+	fprintf(fp, "\n");
+	fprintf(fp, "\tswitch(index)\n");
+	fprintf(fp, "\t{\n");
+	
+	for(int i = 0; i < count; i += 1)
+		if(instrs[i].entry)
+			fprintf(fp, "\t\tcase %d: goto L%d;\n", i, i);
+
+	fprintf(fp, "\t\tdefault: Error_Report(error, 1, \"Invalid entry point %%d\", index); return;\n");
+	fprintf(fp, "\t}\n");
+	fprintf(fp, "\n");
+
+	for(int i = 0; i < count; i += 1)
+		write_instr(fp, instrs, i);
+
+	// Reached when the last instruction isn't a 
+	// return, like the interpreter would do.
+	fprintf(fp, "\t(void) next;\n");
+	fprintf(fp, "\t(void) lop;\n");
+	fprintf(fp, "\t(void) rop;\n");
+	fprintf(fp, "\t(void) cond;\n");
+	fprintf(fp, "\tError_Report(error, 1, \"Invalid instruction index\");\n");
+	fprintf(fp, "}\n\n");
+
+	fputs(epilogue, fp);
+
+	free(instrs);
+	return 1;
+}
@@ -45,12 +45,26 @@
 
 #include <assert.h>
 #include <setjmp.h>
+#include <string.h>
 #include <stdlib.h>
 #include "../utils/defs.h"
 #include "compile.h"
+#include "infer.h"
+#include "inline.h"
 #include "ASTi.h"
 
-static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_dest, Error *error);
+typedef struct {
+	ExeBuilder   *exeb;
+	BPAlloc      *alloc;
+	TypeScope    *scope;    // Types inferred for the function being compiled.
+	NameList     *locals;   // Locals of the function being compiled.
+	int           depth;    // How many functions contain the code being compiled.
+	InlineCallee *callees;  // Functions that can be inlined.
+	InlineCallee *inlining; // Function whose body is being inlined, if any.
+	Profile      *profile;  // Types observed by a previous run, if any.
+} CodegenContext;
+
+static _Bool emit_instr_for_node(CodegenContext *ctx, Node *node, Promise *break_dest, Error *error);
 
 static Opcode exprkind_to_opcode(ExprKind kind)
 {
@@ -77,19 +91,237 @@ static Opcode exprkind_to_opcode(ExprKind kind)
 	}
 }
 
-static _Bool emit_instr_for_funccall(ExeBuilder *exeb, CallExprNode *expr, Promise *break_dest, int returns, Error *error)
+static Opcode specialize_opcode(Opcode opcode, StaticType type)
+{
+	_Bool is_int = (type == STATIC_INT);
+
+	switch(opcode)
+	{
+		case OPCODE_ADD: return is_int ? OPCODE_ADDI : OPCODE_ADDF;
+		case OPCODE_SUB: return is_int ? OPCODE_SUBI : OPCODE_SUBF;
+		case OPCODE_MUL: return is_int ? OPCODE_MULI : OPCODE_MULF;
+		case OPCODE_DIV: return is_int ? OPCODE_DIVI : OPCODE_DIVF;
+		case OPCODE_LSS: return is_int ? OPCODE_LSSI : OPCODE_LSSF;
+		case OPCODE_GRT: return is_int ? OPCODE_GRTI : OPCODE_GRTF;
+		case OPCODE_LEQ: return is_int ? OPCODE_LEQI : OPCODE_LEQF;
+		case OPCODE_GEQ: return is_int ? OPCODE_GEQI : OPCODE_GEQF;
+		default: break;
+	}
+	return opcode;
+}
+
+// Like [specialize_opcode], but for instructions whose
+// types are only suggested by the profile.
+static Opcode specialize_opcode_guarded(Opcode opcode, StaticType type)
+{
+	_Bool is_int = (type == STATIC_INT);
+
+	switch(opcode)
+	{
+		case OPCODE_ADD: return is_int ? OPCODE_ADDGI : OPCODE_ADDGF;
+		case OPCODE_SUB: return is_int ? OPCODE_SUBGI : OPCODE_SUBGF;
+		case OPCODE_MUL: return is_int ? OPCODE_MULGI : OPCODE_MULGF;
+		case OPCODE_DIV: return is_int ? OPCODE_DIVGI : OPCODE_DIVGF;
+		case OPCODE_LSS: return is_int ? OPCODE_LSSGI : OPCODE_LSSGF;
+		case OPCODE_GRT: return is_int ? OPCODE_GRTGI : OPCODE_GRTGF;
+		case OPCODE_LEQ: return is_int ? OPCODE_LEQGI : OPCODE_LEQGF;
+		case OPCODE_GEQ: return is_int ? OPCODE_GEQGI : OPCODE_GEQGF;
+		default: break;
+	}
+	return opcode;
+}
+
+// Returns the name used for the variable [name]
+// by the code being compiled.
+static const char *rename_var(CodegenContext *ctx, const char *name)
+{
+	InlineCallee *callee = ctx->inlining;
+
+	if(callee != NULL)
+		for(int i = 0; i < callee->paramc; i += 1)
+			if(!strcmp(callee->params[i], name))
+				return callee->renamed[i];
+	return name;
+}
+
+static InlineCallee *get_inlinable_callee(CodegenContext *ctx, CallExprNode *expr, int returns)
+{
+	// Only calls inside of the global scope or of
+	// functions defined in it are inlined, and only 
+	// one level deep.
+	if(returns != 1 || ctx->inlining != NULL || ctx->depth > 1)
+		return NULL;
+
+	if(expr->func->kind != NODE_EXPR || ((ExprNode*) expr->func)->kind != EXPR_IDENT)
+		return NULL;
+
+	InlineCallee *callee = get_inline_callee(ctx->callees, ((IdentExprNode*) expr->func)->val);
+
+	if(callee == NULL)
+		return NULL;
+
+	// The function must have been defined before the
+	// call, or before the definition of the function
+	// containing the call, since that can't be called
+	// before it's defined.
+	if(!callee->defined)
+		return NULL;
+
+	if(ctx->depth > 0)
+	{
+		// The caller must not define the names used
+		// by the callee, or they would refer to the
+		// caller's variables instead of the global ones.
+		if(name_in_list(ctx->locals, callee->func->name))
+			return NULL;
+
+		for(NameList *name = callee->free; name; name = name->next)
+			if(name_in_list(ctx->locals, name->name))
+				return NULL;
+	}
+
+	return callee;
+}
+
+static _Bool emit_instr_for_inlined_body(CodegenContext *ctx, CallExprNode *expr, InlineCallee *callee, Error *error)
+{
+	ExeBuilder *exeb = ctx->exeb;
+	FunctionNode *func = callee->func;
+
+	// Assign the arguments like the function's
+	// prologue would do, but with the new names.
+	// The first argument is on top of the stack.
+	// Missing arguments default to none.
+	for(int i = 0; i < callee->paramc; i += 1)
+	{
+		if(i >= expr->argc)
+			if(!ExeBuilder_Append(exeb, error, OPCODE_PUSHNNE, NULL, 0, expr->base.base.offset, expr->base.base.length))
+				return 0;
+
+		Operand op = (Operand) { .type = OPTP_STRING, .as_string = callee->renamed[i] };
+		if(!ExeBuilder_Append(exeb, error, OPCODE_ASS, &op, 1, expr->base.base.offset, expr->base.base.length))
+			return 0;
+
+		op = (Operand) { .type = OPTP_INT, .as_int = 1 };
+		if(!ExeBuilder_Append(exeb, error, OPCODE_POP, &op, 1, expr->base.base.offset, expr->base.base.length))
+			return 0;
+	}
+
+	// Drop the additional arguments.
+	if(expr->argc > callee->paramc)
+	{
+		Operand op = (Operand) { .type = OPTP_INT, .as_int = expr->argc - callee->paramc };
+		if(!ExeBuilder_Append(exeb, error, OPCODE_POP, &op, 1, expr->base.base.offset, expr->base.base.length))
+			return 0;
+	}
+
+	Node *stmt = func->body;
+
+	if(stmt->kind == NODE_COMP)
+		stmt = ((CompoundNode*) stmt)->head;
+
+	_Bool returned = 0;
+
+	// The instructions of the body remember the call,
+	// so that stack traces show it as if the callee
+	// had its own frame.
+	ExeBuilder_SetInlinedCall(exeb, expr->base.base.offset);
+
+	for(; stmt != NULL; stmt = stmt->next)
+	{
+		if(stmt->kind == NODE_RETURN)
+		{
+			// The return value is the value of the call.
+			if(!emit_instr_for_node(ctx, ((ReturnNode*) stmt)->val, NULL, error))
+				return 0;
+
+			returned = 1;
+			break;
+		}
+
+		if(!emit_instr_for_node(ctx, stmt, NULL, error))
+			return 0;
+
+		Operand op = (Operand) { .type = OPTP_INT, .as_int = 1 };
+		if(!ExeBuilder_Append(exeb, error, OPCODE_POP, &op, 1, stmt->offset, 0))
+			return 0;
+
+		if(func->body->kind != NODE_COMP)
+			break;
+	}
+
+	if(!returned)
+		if(!ExeBuilder_Append(exeb, error, OPCODE_PUSHNNE, NULL, 0, func->body->offset, 0))
+			return 0;
+
+	ExeBuilder_SetInlinedCall(exeb, -1);
+
+	// Set the renamed arguments to none, so that they
+	// don't keep their values alive in the caller's
+	// variables once the call is over.
+	if(callee->paramc > 0)
+	{
+		if(!ExeBuilder_Append(exeb, error, OPCODE_PUSHNNE, NULL, 0, expr->base.base.offset, expr->base.base.length))
+			return 0;
+
+		for(int i = 0; i < callee->paramc; i += 1)
+		{
+			Operand op = (Operand) { .type = OPTP_STRING, .as_string = callee->renamed[i] };
+			if(!ExeBuilder_Append(exeb, error, OPCODE_ASS, &op, 1, expr->base.base.offset, expr->base.base.length))
+				return 0;
+		}
+
+		Operand op = (Operand) { .type = OPTP_INT, .as_int = 1 };
+		if(!ExeBuilder_Append(exeb, error, OPCODE_POP, &op, 1, expr->base.base.offset, expr->base.base.length))
+			return 0;
+	}
+
+	return 1;
+}
+
+static _Bool emit_instr_for_inlined_call(CodegenContext *ctx, CallExprNode *expr, InlineCallee *callee, Promise *break_dest, Error *error)
 {
+	// Evaluate all of the arguments before assigning
+	// them, since they may contain inlined calls to 
+	// the same function.
+	for(Node *arg = expr->argv; arg; arg = arg->next)
+		if(!emit_instr_for_node(ctx, arg, break_dest, error))
+			return 0;
+
+	// The inferred types of the caller don't apply
+	// to the callee's variables.
+	TypeScope *scope = ctx->scope;
+
+	ctx->scope = NULL;
+	ctx->inlining = callee;
+
+	_Bool ok = emit_instr_for_inlined_body(ctx, expr, callee, error);
+
+	ctx->scope = scope;
+	ctx->inlining = NULL;
+	return ok;
+}
+
+static _Bool emit_instr_for_funccall(CodegenContext *ctx, CallExprNode *expr, Promise *break_dest, int returns, Error *error)
+{
+	ExeBuilder *exeb = ctx->exeb;
+
+	InlineCallee *callee = get_inlinable_callee(ctx, expr, returns);
+
+	if(callee != NULL)
+		return emit_instr_for_inlined_call(ctx, expr, callee, break_dest, error);
+
 	Node *arg = expr->argv;
     
 	while(arg)
 	{
-		if(!emit_instr_for_node(exeb, arg, break_dest, error))
+		if(!emit_instr_for_node(ctx, arg, break_dest, error))
 			return 0;
 
 		arg = arg->next;
 	}
 
-	if(!emit_instr_for_node(exeb, expr->func, break_dest, error))
+	if(!emit_instr_for_node(ctx, expr->func, break_dest, error))
 		return 0;
 
 	Operand ops[2];
@@ -114,8 +346,10 @@ static _Bool flatten_tuple_tree(ExprNode *root, ExprNode **tuple, int max, int *
 	return 1;
 }
 
-static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_dest, Error *error)
+static _Bool emit_instr_for_node(CodegenContext *ctx, Node *node, Promise *break_dest, Error *error)
 {
+	ExeBuilder *exeb = ctx->exeb;
+
 	assert(node != NULL);
 
 	switch(node->kind)
@@ -148,12 +382,36 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 					OperExprNode *oper = (OperExprNode*) expr;
 
 					for(Node *operand = oper->head; operand; operand = operand->next)
-						if(!emit_instr_for_node(exeb, operand, break_dest, error))
+						if(!emit_instr_for_node(ctx, operand, break_dest, error))
 							return 0;
 
-					if(!ExeBuilder_Append(exeb, error,
-						exprkind_to_opcode(expr->kind), 
-						NULL, 0, node->offset, node->length))
+					Opcode opcode = exprkind_to_opcode(expr->kind);
+
+					// When both operands are known to be ints or
+					// floats, use the specialized instructions.
+					// If they aren't known but the profile says
+					// the instruction only saw ints or floats,
+					// use the guarded versions, which check the
+					// types and fall back to the generic operation.
+					if(oper->count == 2)
+					{
+						StaticType ltype = typeof_expr(ctx->scope, oper->head);
+						StaticType rtype = typeof_expr(ctx->scope, oper->head->next);
+
+						if(ltype == rtype && ltype != STATIC_UNKNOWN)
+							opcode = specialize_opcode(opcode, ltype);
+						else
+						{
+							unsigned char bits = Profile_Get(ctx->profile, ExeBuilder_InstrCount(exeb));
+
+							if(bits == PROFILE_INT)
+								opcode = specialize_opcode_guarded(opcode, STATIC_INT);
+							else if(bits == PROFILE_FLOAT)
+								opcode = specialize_opcode_guarded(opcode, STATIC_FLOAT);
+						}
+					}
+
+					if(!ExeBuilder_Append(exeb, error, opcode, NULL, 0, node->offset, node->length))
 						return 0;
 					return 1;
 				}
@@ -176,14 +434,14 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 
 					if(count == 1) /* No tuple. */
 					{
-						if(!emit_instr_for_node(exeb, rop, break_dest, error))
+						if(!emit_instr_for_node(ctx, rop, break_dest, error))
 							return 0;
 					}
 					else
 					{
 						if(((ExprNode*) rop)->kind == EXPR_CALL)
 						{
-							if(!emit_instr_for_funccall(exeb, (CallExprNode*) rop, break_dest, count, error))
+							if(!emit_instr_for_funccall(ctx, (CallExprNode*) rop, break_dest, count, error))
 								return 0;
 						}
 						else
@@ -200,7 +458,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 						{
 							case EXPR_IDENT:
 							{
-								const char *name = ((IdentExprNode*) tuple_item)->val;
+								const char *name = rename_var(ctx, ((IdentExprNode*) tuple_item)->val);
 
 								Operand op = { .type = OPTP_STRING, .as_string = name };
 								if(!ExeBuilder_Append(exeb, error, OPCODE_ASS, &op, 1, tuple_item->base.offset, tuple_item->base.length))
@@ -213,10 +471,10 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 								Node *idx = ((IndexSelectionExprNode*) tuple_item)->idx;
 								Node *set = ((IndexSelectionExprNode*) tuple_item)->set;
 
-								if(!emit_instr_for_node(exeb, set, break_dest, error))
+								if(!emit_instr_for_node(ctx, set, break_dest, error))
 									return 0;
 
-								if(!emit_instr_for_node(exeb, idx, break_dest, error))
+								if(!emit_instr_for_node(ctx, idx, break_dest, error))
 									return 0;
 
 								if(!ExeBuilder_Append(exeb, error, OPCODE_INSERT2, NULL, 0, tuple_item->base.offset, tuple_item->base.length))
@@ -264,7 +522,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 				case EXPR_IDENT:
 				{
 					IdentExprNode *p = (IdentExprNode*) expr;
-					Operand op = { .type = OPTP_STRING, .as_string = p->val };
+					Operand op = { .type = OPTP_STRING, .as_string = rename_var(ctx, p->val) };
 					return ExeBuilder_Append(exeb, error, OPCODE_PUSHVAR, &op, 1, node->offset, node->length);
 				}
 
@@ -292,7 +550,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 						if(!ExeBuilder_Append(exeb, error, OPCODE_PUSHINT, &op, 1, item->offset, item->length))
 							return 0;
 
-						if(!emit_instr_for_node(exeb, item, break_dest, error))
+						if(!emit_instr_for_node(ctx, item, break_dest, error))
 							return 0;
 
 						if(!ExeBuilder_Append(exeb, error, OPCODE_INSERT, NULL, 0, item->offset, item->length))
@@ -319,10 +577,10 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 								
 					while(item)
 					{
-						if(!emit_instr_for_node(exeb, key, break_dest, error))
+						if(!emit_instr_for_node(ctx, key, break_dest, error))
 							return 0;
 
-						if(!emit_instr_for_node(exeb, item, break_dest, error))
+						if(!emit_instr_for_node(ctx, item, break_dest, error))
 							return 0;
 
 						if(!ExeBuilder_Append(exeb, error, OPCODE_INSERT, NULL, 0, item->offset, item->length))
@@ -336,16 +594,16 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 				}
 
 				case EXPR_CALL:
-				return emit_instr_for_funccall(exeb, (CallExprNode*) expr, break_dest, 1, error);
+				return emit_instr_for_funccall(ctx, (CallExprNode*) expr, break_dest, 1, error);
 
 				case EXPR_SELECT:
 				{
 					IndexSelectionExprNode *sel = (IndexSelectionExprNode*) expr;
 					
-					if(!emit_instr_for_node(exeb, sel->set, break_dest, error))
+					if(!emit_instr_for_node(ctx, sel->set, break_dest, error))
 						return 0;
 
-					if(!emit_instr_for_node(exeb, sel->idx, break_dest, error))
+					if(!emit_instr_for_node(ctx, sel->idx, break_dest, error))
 						return 0;
 
 					return ExeBuilder_Append(exeb, error, OPCODE_SELECT, NULL, 0, node->offset, node->length);
@@ -384,7 +642,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 		{
 			IfElseNode *ifelse = (IfElseNode*) node;
 
-			if(!emit_instr_for_node(exeb, ifelse->condition, break_dest, error))
+			if(!emit_instr_for_node(ctx, ifelse->condition, break_dest, error))
 				return 0;
 
 			if(ifelse->false_branch)
@@ -402,7 +660,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 				if(!ExeBuilder_Append(exeb, error, OPCODE_JUMPIFNOTANDPOP, &op, 1, node->offset, node->length))
 					return 0;
 
-				if(!emit_instr_for_node(exeb, ifelse->true_branch, break_dest, error))
+				if(!emit_instr_for_node(ctx, ifelse->true_branch, break_dest, error))
 					return 0;
 
 				if(ifelse->true_branch->kind == NODE_EXPR)
@@ -419,7 +677,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 				long long int temp = ExeBuilder_InstrCount(exeb);
 				Promise_Resolve(else_offset, &temp, sizeof(temp));
 
-				if(!emit_instr_for_node(exeb, ifelse->false_branch, break_dest, error))
+				if(!emit_instr_for_node(ctx, ifelse->false_branch, break_dest, error))
 					return 0;
 
 				if(ifelse->false_branch->kind == NODE_EXPR)
@@ -448,7 +706,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 				if(!ExeBuilder_Append(exeb, error, OPCODE_JUMPIFNOTANDPOP, &(Operand) { .type = OPTP_PROMISE, .as_promise = done_offset }, 1, node->offset, node->length))
 					return 0;
 
-				if(!emit_instr_for_node(exeb, ifelse->true_branch, break_dest, error))
+				if(!emit_instr_for_node(ctx, ifelse->true_branch, break_dest, error))
 					return 0;
 
 				if(ifelse->true_branch->kind == NODE_EXPR)
@@ -492,14 +750,14 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 			long long int temp = ExeBuilder_InstrCount(exeb);
 			Promise_Resolve(start_offset, &temp, sizeof(temp));
 
-			if(!emit_instr_for_node(exeb, whl->condition, break_dest, error))
+			if(!emit_instr_for_node(ctx, whl->condition, break_dest, error))
 				return 0;
 
 			Operand op = { .type = OPTP_PROMISE, .as_promise = end_offset };
 			if(!ExeBuilder_Append(exeb, error, OPCODE_JUMPIFNOTANDPOP, &op, 1, whl->condition->offset, whl->condition->length))
 				return 0;
 
-			if(!emit_instr_for_node(exeb, whl->body, end_offset, error))
+			if(!emit_instr_for_node(ctx, whl->body, end_offset, error))
 				return 0;
 
 			if(whl->body->kind == NODE_EXPR)
@@ -541,7 +799,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 
 			long long int start = ExeBuilder_InstrCount(exeb);
 
-			if(!emit_instr_for_node(exeb, dowhl->body, end_offset, error))
+			if(!emit_instr_for_node(ctx, dowhl->body, end_offset, error))
 				return 0;
 
 			if(dowhl->body->kind == NODE_EXPR)
@@ -551,7 +809,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 					return 0;
 			}
 
-			if(!emit_instr_for_node(exeb, dowhl->condition, break_dest, error))
+			if(!emit_instr_for_node(ctx, dowhl->condition, break_dest, error))
 				return 0;
 
 			Operand op = { .type = OPTP_INT, .as_int = start };
@@ -572,7 +830,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 
 			while(stmt)
 			{
-				if(!emit_instr_for_node(exeb, stmt, break_dest, error))
+				if(!emit_instr_for_node(ctx, stmt, break_dest, error))
 					return 0;
 
 				if(stmt->kind == NODE_EXPR)
@@ -598,7 +856,7 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 				return 0;
 
 			for(int i = 0; i < count; i += 1)
-				if(!emit_instr_for_node(exeb, (Node*) tuple[i], break_dest, error))
+				if(!emit_instr_for_node(ctx, (Node*) tuple[i], break_dest, error))
 					return 0;
 
 			Operand op = (Operand) { .type = OPTP_INT, .as_int = count };
@@ -676,7 +934,25 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 					arg = (ArgumentNode*) arg->base.next;
 				}
 
-				if(!emit_instr_for_node(exeb, func->body, NULL, error))
+				// The function's body is a new scope.
+				TypeScope *outer_scope  = ctx->scope;
+				NameList  *outer_locals = ctx->locals;
+
+				ctx->scope  = infer_types(func->body, func->argv, ctx->alloc, error);
+				ctx->locals = collect_locals(func, ctx->alloc, error);
+
+				if(ctx->scope == NULL || ctx->locals == NULL)
+					return 0;
+
+				ctx->depth += 1;
+
+				_Bool ok = emit_instr_for_node(ctx, func->body, NULL, error);
+
+				ctx->depth -= 1;
+				ctx->scope  = outer_scope;
+				ctx->locals = outer_locals;
+
+				if(!ok)
 					return 0;
 
 				if(func->body->kind == NODE_EXPR)
@@ -697,6 +973,16 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
 			temp = ExeBuilder_InstrCount(exeb);
 			Promise_Resolve(jump_index, &temp, sizeof(temp));
 
+			// From now on calls from the global scope
+			// can be inlined.
+			if(ctx->depth == 0)
+			{
+				InlineCallee *callee = get_inline_callee(ctx->callees, func->name);
+
+				if(callee != NULL && callee->func == func)
+					callee->defined = 1;
+			}
+
 			Promise_Free(func_index);
 			Promise_Free(jump_index);
 			return 1;
@@ -731,6 +1017,18 @@ static _Bool emit_instr_for_node(ExeBuilder *exeb, Node *node, Promise *break_de
  *
  */
 Executable *compile(AST *ast, BPAlloc *alloc, Error *error)
+{
+	return compile_with_profile(ast, alloc, NULL, error);
+}
+
+/* Symbol: compile_with_profile
+ * 
+ *   Like [compile], but the arithmetic and relational 
+ *   operations that only saw ints or floats in [profile]
+ *   are compiled to their specialized instructions.
+ *   The profile must refer to the same source.
+ */
+Executable *compile_with_profile(AST *ast, BPAlloc *alloc, Profile *profile, Error *error)
 {
 	assert(ast != NULL);
 	assert(error != NULL);
@@ -750,7 +1048,19 @@ Executable *compile(AST *ast, BPAlloc *alloc, Error *error)
 
 	if(exeb != NULL)
 	{
-		if(!emit_instr_for_node(exeb, ast->root, NULL, error))
+		CodegenContext ctx = { .exeb = exeb, .alloc = alloc2, .profile = profile };
+
+		ctx.scope = infer_types(ast->root, NULL, alloc2, error);
+
+		if(ctx.scope == NULL)
+			return 0;
+
+		ctx.callees = find_inline_callees(ast->root, alloc2, error);
+
+		if(error->occurred)
+			return 0;
+
+		if(!emit_instr_for_node(&ctx, ast->root, NULL, error))
 			return 0;
 
 		Operand op = (Operand) { .type = OPTP_INT, .as_int = 0 };
@@ -33,6 +33,8 @@
 #include "../utils/error.h"
 #include "../utils/bpalloc.h"
 #include "../common/executable.h"
+#include "../common/profile.h"
 #include "AST.h"
 Executable *compile(AST *ast, BPAlloc *alloc, Error *error);
+Executable *compile_with_profile(AST *ast, BPAlloc *alloc, Profile *profile, Error *error);
 #endif
\ No newline at end of file
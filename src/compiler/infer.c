@@ -0,0 +1,474 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+** |                                                                          | 
+** |                          WHAT IS THIS FILE?                              |
+** | This file implements the static type inference pass of the compiler.     |
+** | It determines which variables of a function (or of the global scope)     |
+** | are guaranteed to always hold an int or a float, so that the compiler    |
+** | can emit arithmetic and relational instructions that don't need to check |
+** | the type of their operands.                                              |
+** |                                                                          |
+** |                          HOW DOES IT WORK?                               |
+** | Since variables are resolved by name at runtime, a variable read before  |
+** | its first assignment may refer to a variable of an enclosing scope or to |
+** | a built-in. For this reason only variables whose first mention in the    |
+** | scope is a top-level statement of the form `x = <literal>;` are          |
+** | considered. The type of such variables is assumed to be the type of the  |
+** | literal. Then all of the assignments of the scope are checked: when a    |
+** | variable is assigned something that isn't known to be of its type, the   |
+** | assumption is dropped. This is repeated until no assumption is dropped,  |
+** | since dropping one may change the type of other expressions.             |
+** |                                                                          |
+** | Nested functions can't assign the variables of the enclosing scopes, so  |
+** | they're not considered, other than for the name they define.             |
+** +--------------------------------------------------------------------------+
+*/
+
+#include <string.h>
+#include "../utils/defs.h"
+#include "infer.h"
+
+typedef struct Variable Variable;
+struct Variable {
+	Variable  *next;
+	const char *name;
+	StaticType  type;
+};
+
+struct xTypeScope {
+	Variable *vars;
+	BPAlloc  *alloc;
+	Error    *error;
+	_Bool     changed;
+};
+
+static Variable *lookup(TypeScope *scope, const char *name)
+{
+	for(Variable *var = scope->vars; var != NULL; var = var->next)
+		if(!strcmp(var->name, name))
+			return var;
+	return NULL;
+}
+
+static Variable *declare(TypeScope *scope, const char *name, StaticType type)
+{
+	Variable *var = BPAlloc_Malloc(scope->alloc, sizeof(Variable));
+
+	if(var == NULL)
+	{
+		Error_Report(scope->error, 1, "No memory");
+		return NULL;
+	}
+
+	var->name = name;
+	var->type = type;
+	var->next = scope->vars;
+	scope->vars = var;
+	return var;
+}
+
+/* Symbol: typeof_expr
+ *
+ *   Determines the type of the value of an expression
+ *   given the variable types inferred for the scope.
+ *
+ * Returns:
+ *   STATIC_INT or STATIC_FLOAT when the type is known,
+ *   STATIC_UNKNOWN otherwise.
+ */
+StaticType typeof_expr(TypeScope *scope, Node *node)
+{
+	if(scope == NULL || node->kind != NODE_EXPR)
+		return STATIC_UNKNOWN;
+
+	ExprNode *expr = (ExprNode*) node;
+
+	switch(expr->kind)
+	{
+		case EXPR_INT: return STATIC_INT;
+		case EXPR_FLOAT: return STATIC_FLOAT;
+
+		case EXPR_IDENT:
+		{
+			Variable *var = lookup(scope, ((IdentExprNode*) expr)->val);
+			return var == NULL ? STATIC_UNKNOWN : var->type;
+		}
+
+		case EXPR_POS:
+		case EXPR_NEG:
+		return typeof_expr(scope, ((OperExprNode*) expr)->head);
+
+		case EXPR_ADD:
+		case EXPR_SUB:
+		case EXPR_MUL:
+		case EXPR_DIV:
+		{
+			Node *lop = ((OperExprNode*) expr)->head;
+			Node *rop = lop->next;
+
+			StaticType ltype = typeof_expr(scope, lop);
+			StaticType rtype = typeof_expr(scope, rop);
+
+			if(ltype == STATIC_UNKNOWN || rtype == STATIC_UNKNOWN)
+				return STATIC_UNKNOWN;
+
+			// Mixing ints and floats gives floats.
+			if(ltype == STATIC_INT && rtype == STATIC_INT)
+				return STATIC_INT;
+			return STATIC_FLOAT;
+		}
+
+		case EXPR_ASS:
+		{
+			Node *lop = ((OperExprNode*) expr)->head;
+			Node *rop = lop->next;
+
+			if(((ExprNode*) lop)->kind == EXPR_PAIR)
+				return STATIC_UNKNOWN;
+			return typeof_expr(scope, rop);
+		}
+
+		default: break;
+	}
+	return STATIC_UNKNOWN;
+}
+
+static _Bool mention(TypeScope *scope, Node *node);
+
+static _Bool mention_name(TypeScope *scope, const char *name)
+{
+	return lookup(scope, name) != NULL || declare(scope, name, STATIC_UNKNOWN) != NULL;
+}
+
+static _Bool mention_list(TypeScope *scope, Node *head)
+{
+	for(Node *node = head; node != NULL; node = node->next)
+		if(!mention(scope, node))
+			return 0;
+	return 1;
+}
+
+// Marks as mentioned all of the variables that 
+// appear in [node] by declaring them as unknown.
+static _Bool mention(TypeScope *scope, Node *node)
+{
+	if(node == NULL)
+		return 1;
+
+	switch(node->kind)
+	{
+		case NODE_EXPR:
+		{
+			ExprNode *expr = (ExprNode*) node;
+			switch(expr->kind)
+			{
+				case EXPR_IDENT:
+				return mention_name(scope, ((IdentExprNode*) expr)->val);
+
+				case EXPR_LIST:
+				return mention_list(scope, ((ListExprNode*) expr)->items);
+
+				case EXPR_MAP:
+				return mention_list(scope, ((MapExprNode*) expr)->keys)
+					&& mention_list(scope, ((MapExprNode*) expr)->items);
+
+				case EXPR_CALL:
+				return mention(scope, ((CallExprNode*) expr)->func)
+					&& mention_list(scope, ((CallExprNode*) expr)->argv);
+
+				case EXPR_SELECT:
+				return mention(scope, ((IndexSelectionExprNode*) expr)->set)
+					&& mention(scope, ((IndexSelectionExprNode*) expr)->idx);
+
+				case EXPR_INT: case EXPR_FLOAT: case EXPR_STRING:
+				case EXPR_NONE: case EXPR_TRUE: case EXPR_FALSE:
+				return 1;
+
+				default:
+				return mention_list(scope, ((OperExprNode*) expr)->head);
+			}
+			UNREACHABLE;
+			return 0;
+		}
+
+		case NODE_IFELSE:
+		return mention(scope, ((IfElseNode*) node)->condition)
+			&& mention(scope, ((IfElseNode*) node)->true_branch)
+			&& mention(scope, ((IfElseNode*) node)->false_branch);
+
+		case NODE_WHILE:
+		return mention(scope, ((WhileNode*) node)->condition)
+			&& mention(scope, ((WhileNode*) node)->body);
+
+		case NODE_DOWHILE:
+		return mention(scope, ((DoWhileNode*) node)->body)
+			&& mention(scope, ((DoWhileNode*) node)->condition);
+
+		case NODE_COMP:
+		return mention_list(scope, ((CompoundNode*) node)->head);
+
+		case NODE_RETURN:
+		return mention(scope, ((ReturnNode*) node)->val);
+
+		case NODE_FUNC:
+		return mention_name(scope, ((FunctionNode*) node)->name);
+
+		case NODE_ARG:
+		return mention_name(scope, ((ArgumentNode*) node)->name);
+
+		case NODE_BREAK:
+		return 1;
+	}
+	UNREACHABLE;
+	return 0;
+}
+
+static void drop(TypeScope *scope, Node *target)
+{
+	ExprNode *expr = (ExprNode*) target;
+
+	if(expr->kind == EXPR_PAIR)
+	{
+		for(Node *item = ((OperExprNode*) expr)->head; item != NULL; item = item->next)
+			drop(scope, item);
+		return;
+	}
+
+	if(expr->kind == EXPR_IDENT)
+	{
+		Variable *var = lookup(scope, ((IdentExprNode*) expr)->val);
+
+		if(var != NULL && var->type != STATIC_UNKNOWN)
+		{
+			var->type = STATIC_UNKNOWN;
+			scope->changed = 1;
+		}
+	}
+}
+
+// Drops the assumptions that are contradicted
+// by the assignments inside [node].
+static void check(TypeScope *scope, Node *node)
+{
+	if(node == NULL)
+		return;
+
+	switch(node->kind)
+	{
+		case NODE_EXPR:
+		{
+			ExprNode *expr = (ExprNode*) node;
+			switch(expr->kind)
+			{
+				case EXPR_ASS:
+				{
+					Node *lop = ((OperExprNode*) expr)->head;
+					Node *rop = lop->next;
+
+					check(scope, rop);
+
+					if(((ExprNode*) lop)->kind == EXPR_IDENT)
+					{
+						Variable *var = lookup(scope, ((IdentExprNode*) lop)->val);
+
+						if(var != NULL && var->type != STATIC_UNKNOWN && typeof_expr(scope, rop) != var->type)
+						{
+							var->type = STATIC_UNKNOWN;
+							scope->changed = 1;
+						}
+					}
+					else
+					{
+						drop(scope, lop);
+						check(scope, lop);
+					}
+					break;
+				}
+
+				case EXPR_LIST:
+				for(Node *item = ((ListExprNode*) expr)->items; item; item = item->next)
+					check(scope, item);
+				break;
+
+				case EXPR_MAP:
+				for(Node *item = ((MapExprNode*) expr)->keys; item; item = item->next)
+					check(scope, item);
+				for(Node *item = ((MapExprNode*) expr)->items; item; item = item->next)
+					check(scope, item);
+				break;
+
+				case EXPR_CALL:
+				check(scope, ((CallExprNode*) expr)->func);
+				for(Node *arg = ((CallExprNode*) expr)->argv; arg; arg = arg->next)
+					check(scope, arg);
+				break;
+
+				case EXPR_SELECT:
+				check(scope, ((IndexSelectionExprNode*) expr)->set);
+				check(scope, ((IndexSelectionExprNode*) expr)->idx);
+				break;
+
+				case EXPR_INT: case EXPR_FLOAT: case EXPR_STRING:
+				case EXPR_NONE: case EXPR_TRUE: case EXPR_FALSE:
+				case EXPR_IDENT:
+				break;
+
+				default:
+				for(Node *operand = ((OperExprNode*) expr)->head; operand; operand = operand->next)
+					check(scope, operand);
+				break;
+			}
+			break;
+		}
+
+		case NODE_IFELSE:
+		check(scope, ((IfElseNode*) node)->condition);
+		check(scope, ((IfElseNode*) node)->true_branch);
+		check(scope, ((IfElseNode*) node)->false_branch);
+		break;
+
+		case NODE_WHILE:
+		check(scope, ((WhileNode*) node)->condition);
+		check(scope, ((WhileNode*) node)->body);
+		break;
+
+		case NODE_DOWHILE:
+		check(scope, ((DoWhileNode*) node)->body);
+		check(scope, ((DoWhileNode*) node)->condition);
+		break;
+
+		case NODE_COMP:
+		for(Node *stmt = ((CompoundNode*) node)->head; stmt; stmt = stmt->next)
+			check(scope, stmt);
+		break;
+
+		case NODE_RETURN:
+		check(scope, ((ReturnNode*) node)->val);
+		break;
+
+		case NODE_FUNC:
+		{
+			// The function's body is a different scope,
+			// but the definition assigns its name.
+			Variable *var = lookup(scope, ((FunctionNode*) node)->name);
+
+			if(var != NULL && var->type != STATIC_UNKNOWN)
+			{
+				var->type = STATIC_UNKNOWN;
+				scope->changed = 1;
+			}
+			break;
+		}
+
+		case NODE_ARG:
+		case NODE_BREAK:
+		break;
+	}
+}
+
+// Declares the variables assigned a literal by the top
+// level statements of [node] before any other mention.
+// Compound statements are executed unconditionally, so
+// their statements are considered top level too.
+static _Bool find_candidates(TypeScope *scope, Node *node)
+{
+	if(node->kind == NODE_COMP)
+	{
+		for(Node *stmt = ((CompoundNode*) node)->head; stmt; stmt = stmt->next)
+			if(!find_candidates(scope, stmt))
+				return 0;
+		return 1;
+	}
+
+	ExprNode *expr = (ExprNode*) node;
+
+	if(node->kind == NODE_EXPR && expr->kind == EXPR_ASS)
+	{
+		Node *lop = ((OperExprNode*) expr)->head;
+		Node *rop = lop->next;
+
+		if(((ExprNode*) lop)->kind == EXPR_IDENT 
+			&& lookup(scope, ((IdentExprNode*) lop)->val) == NULL
+			&& rop->kind == NODE_EXPR
+			&& (((ExprNode*) rop)->kind == EXPR_INT || ((ExprNode*) rop)->kind == EXPR_FLOAT))
+		{
+			StaticType type = ((ExprNode*) rop)->kind == EXPR_INT ? STATIC_INT : STATIC_FLOAT;
+			
+			if(declare(scope, ((IdentExprNode*) lop)->val, type) == NULL)
+				return 0;
+		}
+	}
+
+	return mention(scope, node);
+}
+
+/* Symbol: infer_types
+ *
+ *   Infers the types of the variables of the scope with
+ *   the given [body] and arguments [argv].
+ *
+ * Returns:
+ *   The inferred types, that can be queried with 
+ *   [typeof_expr], or NULL if an error occurred.
+ */
+TypeScope *infer_types(Node *body, Node *argv, BPAlloc *alloc, Error *error)
+{
+	TypeScope *scope = BPAlloc_Malloc(alloc, sizeof(TypeScope));
+
+	if(scope == NULL)
+	{
+		Error_Report(error, 1, "No memory");
+		return NULL;
+	}
+
+	scope->vars  = NULL;
+	scope->alloc = alloc;
+	scope->error = error;
+	scope->changed = 0;
+
+	// Arguments hold values of any type.
+	if(!mention_list(scope, argv))
+		return NULL;
+
+	// Find the candidates by looking for literal
+	// assignments at the top level of the scope.
+	if(!find_candidates(scope, body))
+		return NULL;
+
+	// Drop the assumptions that don't hold until
+	// there's nothing left to drop.
+	do
+	{
+		scope->changed = 0;
+		check(scope, body);
+	}
+	while(scope->changed);
+
+	return scope;
+}
@@ -0,0 +1,457 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+** |                                                                          | 
+** |                          WHAT IS THIS FILE?                              |
+** | This file finds the functions that the compiler can inline, which means  |
+** | substituting their body in place of the call.                            |
+** |                                                                          |
+** |                          HOW DOES IT WORK?                               |
+** | Since variables are resolved by name at runtime, a function can only be  |
+** | inlined if the name always refers to it. This is true for functions      |
+** | defined unconditionally at the global scope whose name isn't assigned    |
+** | anywhere else in the global scope (functions can't assign the variables  |
+** | of the enclosing scopes).                                                |
+** |                                                                          |
+** | The body of the function must also be small and simple: a sequence of    |
+** | expression statements optionally ending with a `return` of one value.    |
+** | The only variables it can assign are its arguments, so that they're the  |
+** | only names that need to be renamed when the body is moved inside another |
+** | function. Every other name refers to a global or a built-in, and it's    |
+** | up to the compiler to check that the caller doesn't define it.           |
+** +--------------------------------------------------------------------------+
+*/
+
+#include <string.h>
+#include "../utils/defs.h"
+#include "inline.h"
+
+#define MAX_INLINE_NODES 32
+
+typedef struct {
+	BPAlloc  *alloc;
+	Error    *error;
+	NameList *assigned;  // Names assigned (including functions and arguments).
+	NameList *read;      // Names read.
+	int       nodes;     // Number of nodes visited.
+	_Bool     tuples;    // There are assignments to tuples.
+	_Bool     failed;
+} Scan;
+
+static void add_name(Scan *scan, NameList **list, const char *name)
+{
+	if(scan->failed)
+		return;
+
+	NameList *item = BPAlloc_Malloc(scan->alloc, sizeof(NameList));
+
+	if(item == NULL)
+	{
+		Error_Report(scan->error, 1, "No memory");
+		scan->failed = 1;
+		return;
+	}
+
+	item->name = name;
+	item->next = *list;
+	*list = item;
+}
+
+_Bool name_in_list(NameList *list, const char *name)
+{
+	for(; list != NULL; list = list->next)
+		if(!strcmp(list->name, name))
+			return 1;
+	return 0;
+}
+
+static int count_in_list(NameList *list, const char *name)
+{
+	int n = 0;
+	for(; list != NULL; list = list->next)
+		if(!strcmp(list->name, name))
+			n += 1;
+	return n;
+}
+
+static void scan_node(Scan *scan, Node *node);
+
+static void scan_list(Scan *scan, Node *head)
+{
+	for(Node *node = head; node != NULL; node = node->next)
+		scan_node(scan, node);
+}
+
+static void scan_target(Scan *scan, Node *target)
+{
+	ExprNode *expr = (ExprNode*) target;
+
+	scan->nodes += 1;
+
+	switch(expr->kind)
+	{
+		case EXPR_IDENT:
+		add_name(scan, &scan->assigned, ((IdentExprNode*) expr)->val);
+		break;
+
+		case EXPR_PAIR:
+		scan->tuples = 1;
+		for(Node *item = ((OperExprNode*) expr)->head; item; item = item->next)
+			scan_target(scan, item);
+		break;
+
+		case EXPR_SELECT:
+		scan_node(scan, ((IndexSelectionExprNode*) expr)->set);
+		scan_node(scan, ((IndexSelectionExprNode*) expr)->idx);
+		break;
+
+		default: 
+		scan_node(scan, target);
+		break;
+	}
+}
+
+// Collects the names assigned and read by [node]
+// without entering the bodies of functions.
+static void scan_node(Scan *scan, Node *node)
+{
+	if(node == NULL)
+		return;
+
+	scan->nodes += 1;
+
+	switch(node->kind)
+	{
+		case NODE_EXPR:
+		{
+			ExprNode *expr = (ExprNode*) node;
+			switch(expr->kind)
+			{
+				case EXPR_IDENT:
+				add_name(scan, &scan->read, ((IdentExprNode*) expr)->val);
+				break;
+
+				case EXPR_ASS:
+				scan_target(scan, ((OperExprNode*) expr)->head);
+				scan_node(scan, ((OperExprNode*) expr)->head->next);
+				break;
+
+				case EXPR_LIST:
+				scan_list(scan, ((ListExprNode*) expr)->items);
+				break;
+
+				case EXPR_MAP:
+				scan_list(scan, ((MapExprNode*) expr)->keys);
+				scan_list(scan, ((MapExprNode*) expr)->items);
+				break;
+
+				case EXPR_CALL:
+				scan_node(scan, ((CallExprNode*) expr)->func);
+				scan_list(scan, ((CallExprNode*) expr)->argv);
+				break;
+
+				case EXPR_SELECT:
+				scan_node(scan, ((IndexSelectionExprNode*) expr)->set);
+				scan_node(scan, ((IndexSelectionExprNode*) expr)->idx);
+				break;
+
+				case EXPR_INT: case EXPR_FLOAT: case EXPR_STRING:
+				case EXPR_NONE: case EXPR_TRUE: case EXPR_FALSE:
+				break;
+
+				default:
+				scan_list(scan, ((OperExprNode*) expr)->head);
+				break;
+			}
+			break;
+		}
+
+		case NODE_IFELSE:
+		scan_node(scan, ((IfElseNode*) node)->condition);
+		scan_node(scan, ((IfElseNode*) node)->true_branch);
+		scan_node(scan, ((IfElseNode*) node)->false_branch);
+		break;
+
+		case NODE_WHILE:
+		scan_node(scan, ((WhileNode*) node)->condition);
+		scan_node(scan, ((WhileNode*) node)->body);
+		break;
+
+		case NODE_DOWHILE:
+		scan_node(scan, ((DoWhileNode*) node)->body);
+		scan_node(scan, ((DoWhileNode*) node)->condition);
+		break;
+
+		case NODE_COMP:
+		scan_list(scan, ((CompoundNode*) node)->head);
+		break;
+
+		case NODE_RETURN:
+		scan_node(scan, ((ReturnNode*) node)->val);
+		break;
+
+		case NODE_FUNC:
+		add_name(scan, &scan->assigned, ((FunctionNode*) node)->name);
+		break;
+
+		case NODE_ARG:
+		add_name(scan, &scan->assigned, ((ArgumentNode*) node)->name);
+		break;
+
+		case NODE_BREAK:
+		break;
+	}
+}
+
+/* Symbol: collect_locals
+ *
+ *   Lists the names that are local to [func], which
+ *   are its arguments and the names it assigns.
+ *
+ * Returns:
+ *   The list of names. If an error occurred, NULL 
+ *   is returned and [error] is filled out.
+ */
+NameList *collect_locals(FunctionNode *func, BPAlloc *alloc, Error *error)
+{
+	Scan scan = { .alloc = alloc, .error = error };
+
+	scan_list(&scan, func->argv);
+	scan_node(&scan, func->body);
+
+	if(scan.failed)
+		return NULL;
+
+	// The list may be empty, so return a dummy
+	// entry to distinguish it from a failure.
+	add_name(&scan, &scan.assigned, "");
+	
+	if(scan.failed)
+		return NULL;
+
+	return scan.assigned;
+}
+
+// Checks whether the body of [func] is simple enough
+// to be inlined.
+static _Bool is_inlinable(FunctionNode *func, Scan *scan)
+{
+	Node *stmt = func->body;
+
+	if(stmt->kind == NODE_COMP)
+		stmt = ((CompoundNode*) stmt)->head;
+
+	for(; stmt != NULL; stmt = stmt->next)
+	{
+		if(stmt->kind == NODE_RETURN)
+		{
+			// Returns must be at the end and can't
+			// return more than one value.
+			if(stmt->next != NULL && func->body->kind == NODE_COMP)
+				return 0;
+
+			ExprNode *val = (ExprNode*) ((ReturnNode*) stmt)->val;
+
+			if(val->kind == EXPR_PAIR)
+				return 0;
+		}
+		else if(stmt->kind != NODE_EXPR)
+			return 0;
+
+		if(func->body->kind != NODE_COMP)
+			break;
+	}
+
+	scan_list(scan, func->argv);
+	scan_node(scan, func->body);
+
+	if(scan->failed || scan->tuples || scan->nodes > MAX_INLINE_NODES)
+		return 0;
+
+	// It can only assign its arguments.
+	for(NameList *name = scan->assigned; name; name = name->next)
+	{
+		_Bool is_arg = 0;
+		for(Node *arg = func->argv; arg; arg = arg->next)
+			if(!strcmp(((ArgumentNode*) arg)->name, name->name))
+				is_arg = 1;
+
+		if(!is_arg)
+			return 0;
+	}
+
+	// Recursive functions aren't inlined.
+	if(name_in_list(scan->read, func->name))
+		return 0;
+
+	return 1;
+}
+
+// Collects the functions defined unconditionally
+// at the global scope.
+static _Bool find_definitions(Node *node, InlineCallee **list, BPAlloc *alloc, Error *error)
+{
+	if(node->kind == NODE_COMP)
+	{
+		for(Node *stmt = ((CompoundNode*) node)->head; stmt; stmt = stmt->next)
+			if(!find_definitions(stmt, list, alloc, error))
+				return 0;
+		return 1;
+	}
+
+	if(node->kind != NODE_FUNC)
+		return 1;
+
+	FunctionNode *func = (FunctionNode*) node;
+
+	Scan scan = { .alloc = alloc, .error = error };
+
+	if(!is_inlinable(func, &scan))
+		return !scan.failed;
+
+	InlineCallee *callee = BPAlloc_Malloc(alloc, sizeof(InlineCallee));
+
+	if(callee == NULL)
+	{
+		Error_Report(error, 1, "No memory");
+		return 0;
+	}
+
+	callee->func = func;
+	callee->paramc = func->argc;
+	callee->params  = BPAlloc_Malloc(alloc, sizeof(char*) * (func->argc + 1));
+	callee->renamed = BPAlloc_Malloc(alloc, sizeof(char*) * (func->argc + 1));
+	callee->free = NULL;
+	callee->defined = 0;
+
+	if(callee->params == NULL || callee->renamed == NULL)
+	{
+		Error_Report(error, 1, "No memory");
+		return 0;
+	}
+
+	// The arguments are stored in reverse order by
+	// the parser.
+	int i = func->argc;
+	for(Node *arg = func->argv; arg; arg = arg->next)
+	{
+		i -= 1;
+
+		// The '$' can't appear in identifiers, so
+		// the renamed arguments can't collide with
+		// the caller's variables.
+		const char *name = ((ArgumentNode*) arg)->name;
+		int len = strlen(func->name) + 1 + strlen(name);
+
+		char *renamed = BPAlloc_Malloc(alloc, len + 1);
+
+		if(renamed == NULL)
+		{
+			Error_Report(error, 1, "No memory");
+			return 0;
+		}
+
+		strcpy(renamed, func->name);
+		strcat(renamed, "$");
+		strcat(renamed, name);
+
+		callee->params[i] = name;
+		callee->renamed[i] = renamed;
+	}
+
+	for(NameList *name = scan.read; name; name = name->next)
+		if(!name_in_list(scan.assigned, name->name))
+		{
+			NameList *item = BPAlloc_Malloc(alloc, sizeof(NameList));
+
+			if(item == NULL)
+			{
+				Error_Report(error, 1, "No memory");
+				return 0;
+			}
+
+			item->name = name->name;
+			item->next = callee->free;
+			callee->free = item;
+		}
+
+	callee->next = *list;
+	*list = callee;
+	return 1;
+}
+
+/* Symbol: find_inline_callees
+ *
+ *   Finds the functions that can be inlined in the 
+ *   program with the given [root].
+ *
+ * Returns:
+ *   The list of functions that can be inlined. If 
+ *   there are none or an error occurred, NULL is 
+ *   returned. The two cases can be distinguished 
+ *   by checking [error].
+ */
+InlineCallee *find_inline_callees(Node *root, BPAlloc *alloc, Error *error)
+{
+	InlineCallee *list = NULL;
+
+	if(!find_definitions(root, &list, alloc, error))
+		return NULL;
+
+	if(list == NULL)
+		return NULL;
+
+	// Drop the functions whose name is assigned more
+	// than once in the global scope.
+	Scan scan = { .alloc = alloc, .error = error };
+	
+	scan_node(&scan, root);
+
+	if(scan.failed)
+		return NULL;
+
+	InlineCallee **prev = &list;
+
+	while(*prev != NULL)
+	{
+		if(count_in_list(scan.assigned, (*prev)->func->name) > 1)
+			*prev = (*prev)->next;
+		else
+			prev = &(*prev)->next;
+	}
+
+	return list;
+}
+
+InlineCallee *get_inline_callee(InlineCallee *list, const char *name)
+{
+	for(; list != NULL; list = list->next)
+		if(!strcmp(list->func->name, name))
+			return list;
+	return NULL;
+}
@@ -0,0 +1,58 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+*/
+
+#ifndef INLINE_H
+#define INLINE_H
+#include "../utils/error.h"
+#include "../utils/bpalloc.h"
+#include "ASTi.h"
+
+typedef struct NameList NameList;
+struct NameList {
+	NameList   *next;
+	const char *name;
+};
+
+typedef struct InlineCallee InlineCallee;
+struct InlineCallee {
+	InlineCallee *next;
+	FunctionNode *func;
+	int           paramc;
+	const char  **params;  // Names of the arguments inside the callee (in source order).
+	const char  **renamed; // Names of the arguments inside the caller.
+	NameList     *free;    // Names that the callee doesn't define.
+	_Bool         defined; // The definition was already compiled.
+};
+
+InlineCallee *find_inline_callees(Node *root, BPAlloc *alloc, Error *error);
+InlineCallee *get_inline_callee(InlineCallee *list, const char *name);
+NameList     *collect_locals(FunctionNode *func, BPAlloc *alloc, Error *error);
+_Bool         name_in_list(NameList *list, const char *name);
+#endif
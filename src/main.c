@@ -32,17 +32,76 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <limits.h>
 #include "compiler/parse.h"
 #include "compiler/compile.h"
+#include "compiler/aot.h"
 #include "runtime/runtime.h"
 #include "builtins/basic.h"
 
 static const char usage[] = 
 	"Usage patterns:\n"
-	"    $ noja run file.noja\n"
-	"    $ noja run inline \"print('some noja code');\"\n"
+	"    $ noja run [options] file.noja\n"
+	"    $ noja run [options] inline \"print('some noja code');\"\n"
 	"    $ noja dis file.noja\n"
-	"    $ noja dis inline \"print('some noja code');\"\n";
+	"    $ noja dis inline \"print('some noja code');\"\n"
+	"    $ noja aot file.noja -o out.c\n"
+	"\n"
+	"Options:\n"
+	"    --jit               Compile hot functions to machine code\n"
+	"    --profile-out file  Save the operand types observed while running\n"
+	"    --profile-in  file  Specialize the code using a saved profile\n"
+	"    --heap-min size     Minimum size of the heap (default 1M)\n"
+	"    --heap-max size     Maximum size of the heap (default unlimited)\n"
+	"    --gc-target-occupancy percent\n"
+	"                        How much of the heap live objects should\n"
+	"                        occupy after a collection (default 50)\n"
+	"    --gc-threads count  Threads used by major collections (default 1)\n"
+	"    --gc-pause-budget usecs\n"
+	"                        Make major collections incremental, with\n"
+	"                        pauses of about this many microseconds\n";
+
+typedef struct {
+	_Bool jit;
+	const char *profile_in;
+	const char *profile_out;
+	int heap_min;
+	int heap_max;
+	int gc_occupancy;
+	int gc_threads;
+	int gc_pause_budget;
+} Options;
+
+/* Symbol: parse_size
+ *
+ *   Parses a size in bytes, optionally followed by the
+ *   suffix K, M or G.
+ *
+ * Returns:
+ *   1 if [str] is a valid size that fits an int, 0 
+ *   otherwise.
+ */
+static _Bool parse_size(const char *str, int *size)
+{
+	char *end;
+	long long int value = strtoll(str, &end, 10);
+
+	if(end == str || value < 0)
+		return 0;
+
+	switch(*end)
+	{
+		case 'k': case 'K': value <<= 10; end += 1; break;
+		case 'm': case 'M': value <<= 20; end += 1; break;
+		case 'g': case 'G': value <<= 30; end += 1; break;
+	}
+
+	if(*end != '\0' || value > INT_MAX)
+		return 0;
+
+	*size = value;
+	return 1;
+}
 
 static void print_error(const char *type, Error *error)
 {
@@ -70,7 +129,7 @@ static void print_error(const char *type, Error *error)
 	fprintf(stderr, "\n");
 }
 
-static Executable *build(Source *src)
+static Executable *build(Source *src, Profile *profile)
 {
 	Executable *exe;
 	
@@ -99,7 +158,7 @@ static Executable *build(Source *src)
 		return 0;
 	}
 	
-	exe = compile(ast, alloc, &error);
+	exe = compile_with_profile(ast, alloc, profile, &error);
 
 	// We're done with the AST, independently from
 	// the compilation result.
@@ -116,14 +175,51 @@ static Executable *build(Source *src)
 	return exe;
 }
 
-static _Bool interpret(Source *src)
+static Profile *load_profile(const char *file)
 {
-	Executable *exe = build(src);
+	Error error;
+	Error_Init(&error);
+
+	Profile *profile = Profile_Load(file, &error);
+
+	if(profile == NULL)
+	{
+		print_error(NULL, &error);
+		Error_Free(&error);
+		return NULL;
+	}
+
+	return profile;
+}
+
+static _Bool interpret(Source *src, Options *opts)
+{
+	Profile *profile = NULL;
+
+	if(opts->profile_in != NULL)
+		profile = load_profile(opts->profile_in);
+
+	Executable *exe = build(src, profile);
+
+	if(profile != NULL)
+	{
+		// The profile is checked against the executable
+		// that was built with it. That has the same shape
+		// of the one built without it, since the profile
+		// only changes which instructions are specialized.
+		if(exe != NULL && !Profile_Matches(profile, exe))
+		{
+			fprintf(stderr, "Warning: The profile %s refers to a different source or build. It will be ignored.\n", opts->profile_in);
+			Executable_Free(exe);
+			exe = build(src, NULL);
+		}
+		Profile_Free(profile);
+	}
 
 	if(exe == NULL)
 		return 0;
 
-	Runtime *runt = Runtime_New(-1, 1024*1024, NULL, NULL);
+	Runtime *runt = Runtime_New(-1, opts->heap_min, NULL, NULL);
 
 	if(runt == NULL)
 	{
@@ -136,6 +232,25 @@ static _Bool interpret(Source *src)
 		return 0;
 	}
 
+	Heap_SetSizeLimits(Runtime_GetHeap(runt), opts->heap_min, opts->heap_max, opts->gc_occupancy);
+	Heap_SetCollectorThreads(Runtime_GetHeap(runt), opts->gc_threads);
+	Heap_SetPauseBudget(Runtime_GetHeap(runt), opts->gc_pause_budget);
+
+	if(opts->jit && !Runtime_EnableJIT(runt))
+		fprintf(stderr, "Warning: The JIT isn't supported on this platform.\n");
+
+	profile = NULL;
+
+	if(opts->profile_out != NULL)
+	{
+		profile = Profile_New(exe);
+
+		if(profile == NULL)
+			fprintf(stderr, "Warning: Couldn't allocate the profile.\n");
+		else
+			Runtime_SetProfile(runt, exe, profile);
+	}
+
 	// We use a [RuntimeError] instead of a simple [Error]
 	// because the [RuntimeError] makes a snapshot of the
 	// runtime state when an error is reported. Other than
@@ -179,6 +294,20 @@ static _Bool interpret(Source *src)
 		RuntimeError_Free(&error);
 	}
 
+	if(profile != NULL)
+	{
+		Error error2;
+		Error_Init(&error2);
+
+		if(!Profile_Save(profile, opts->profile_out, &error2))
+		{
+			print_error(NULL, &error2);
+			Error_Free(&error2);
+		}
+
+		Profile_Free(profile);
+	}
+
 	Runtime_Free(runt);
 	Executable_Free(exe);
 
@@ -187,7 +316,7 @@ static _Bool interpret(Source *src)
 
 static _Bool disassemble(Source *src)
 {
-	Executable *exe = build(src);
+	Executable *exe = build(src, NULL);
 
 	if(exe == NULL)
 		return 0;
@@ -196,7 +325,7 @@ static _Bool disassemble(Source *src)
 	return 1;
 }
 
-static _Bool interpret_file(const char *file)
+static _Bool interpret_file(const char *file, Options *opts)
 {
 	Error error;
 	Error_Init(&error);
@@ -211,13 +340,13 @@ static _Bool interpret_file(const char *file)
 		return 0;
 	}
 
-	_Bool r = interpret(src);
+	_Bool r = interpret(src, opts);
 
 	Source_Free(src);
 	return r;
 }
 
-static _Bool interpret_code(const char *code)
+static _Bool interpret_code(const char *code, Options *opts)
 {
 	Error error;
 	Error_Init(&error);
@@ -232,7 +361,7 @@ static _Bool interpret_code(const char *code)
 		return 0;
 	}
 
-	_Bool r = interpret(src);
+	_Bool r = interpret(src, opts);
 
 	Source_Free(src);
 	return r;
@@ -280,6 +409,54 @@ static _Bool disassemble_code(const char *code)
 	return r;
 }
 
+static _Bool translate_file(const char *file, const char *output)
+{
+	Error error;
+	Error_Init(&error);
+	
+	Source *src = Source_FromFile(file, &error);
+
+	if(src == NULL)
+	{
+		assert(error.occurred == 1);
+		print_error(NULL, &error);
+		Error_Free(&error);
+		return 0;
+	}
+
+	Executable *exe = build(src, NULL);
+
+	Source_Free(src);
+
+	if(exe == NULL)
+		return 0;
+
+	FILE *fp = output == NULL ? stdout : fopen(output, "w");
+
+	if(fp == NULL)
+	{
+		Error_Report(&error, 0, "Couldn't open %s", output);
+		print_error(NULL, &error);
+		Error_Free(&error);
+		Executable_Free(exe);
+		return 0;
+	}
+
+	_Bool r = generate_c(exe, fp, &error);
+
+	if(fp != stdout)
+		fclose(fp);
+
+	if(!r)
+	{
+		print_error("Translation", &error);
+		Error_Free(&error);
+	}
+
+	Executable_Free(exe);
+	return r;
+}
+
 int main(int argc, char **argv)
 {
 	assert(argc > 0);
@@ -296,6 +473,120 @@ int main(int argc, char **argv)
 	{
 		Error error;
 		Error_Init(&error);
+
+		Options opts = { 
+			.jit = 0, 
+			.profile_in = NULL, 
+			.profile_out = NULL, 
+			.heap_min = 1024*1024,
+			.heap_max = 0,
+			.gc_occupancy = 50,
+			.gc_threads = 1,
+			.gc_pause_budget = 0,
+		};
+
+		// Consume the options, which must come
+		// before the source.
+		while(argc > 2 && !strncmp(argv[2], "--", 2))
+		{
+			if(!strcmp(argv[2], "--jit"))
+				opts.jit = 1;
+			else if(!strcmp(argv[2], "--profile-in") && argc > 3)
+			{
+				opts.profile_in = argv[3];
+				argv += 1;
+				argc -= 1;
+			}
+			else if(!strcmp(argv[2], "--profile-out") && argc > 3)
+			{
+				opts.profile_out = argv[3];
+				argv += 1;
+				argc -= 1;
+			}
+			else if((!strcmp(argv[2], "--heap-min") || !strcmp(argv[2], "--heap-max")) && argc > 3)
+			{
+				int *size = !strcmp(argv[2], "--heap-min") ? &opts.heap_min : &opts.heap_max;
+
+				if(!parse_size(argv[3], size))
+				{
+					Error_Report(&error, 0, "Invalid size %s for option %s", argv[3], argv[2]);
+					print_error(NULL, &error);
+					Error_Free(&error);
+					return -1;
+				}
+
+				argv += 1;
+				argc -= 1;
+			}
+			else if(!strcmp(argv[2], "--gc-target-occupancy") && argc > 3)
+			{
+				char *end;
+				long int percent = strtol(argv[3], &end, 10);
+
+				if(end == argv[3] || *end != '\0' || percent < 1 || percent > 99)
+				{
+					Error_Report(&error, 0, "The target occupancy must be a percentage between 1 and 99");
+					print_error(NULL, &error);
+					Error_Free(&error);
+					return -1;
+				}
+
+				opts.gc_occupancy = percent;
+				argv += 1;
+				argc -= 1;
+			}
+			else if(!strcmp(argv[2], "--gc-threads") && argc > 3)
+			{
+				char *end;
+				long int count = strtol(argv[3], &end, 10);
+
+				if(end == argv[3] || *end != '\0' || count < 1 || count > 64)
+				{
+					Error_Report(&error, 0, "The number of collector threads must be between 1 and 64");
+					print_error(NULL, &error);
+					Error_Free(&error);
+					return -1;
+				}
+
+				opts.gc_threads = count;
+				argv += 1;
+				argc -= 1;
+			}
+			else if(!strcmp(argv[2], "--gc-pause-budget") && argc > 3)
+			{
+				char *end;
+				long int usecs = strtol(argv[3], &end, 10);
+
+				if(end == argv[3] || *end != '\0' || usecs < 1 || usecs > INT_MAX)
+				{
+					Error_Report(&error, 0, "The pause budget must be a positive number of microseconds");
+					print_error(NULL, &error);
+					Error_Free(&error);
+					return -1;
+				}
+
+				opts.gc_pause_budget = usecs;
+				argv += 1;
+				argc -= 1;
+			}
+			else
+			{
+				Error_Report(&error, 0, "Unknown option %s", argv[2]);
+				print_error(NULL, &error);
+				Error_Free(&error);
+				return -1;
+			}
+			argv += 1;
+			argc -= 1;
+		}
+
+		if(opts.heap_max > 0 && opts.heap_min > opts.heap_max)
+		{
+			Error_Report(&error, 0, "The minimum heap size is bigger than the maximum");
+			print_error(NULL, &error);
+			Error_Free(&error);
+			return -1;
+		}
 		
 		if(argc == 2)
 		{
@@ -316,10 +607,10 @@ int main(int argc, char **argv)
 				Error_Free(&error);
 				return -1;
 			}
-			r = interpret_code(argv[3]);
+			r = interpret_code(argv[3], &opts);
 		}
 		else
-			r = interpret_file(argv[2]);
+			r = interpret_file(argv[2], &opts);
 		return r ? 0 : -1;
 	}
 	
@@ -355,6 +646,41 @@ int main(int argc, char **argv)
 		return r ? 0 : -1;
 	}
 
+	if(!strcmp(argv[1], "aot"))
+	{
+		// $ noja aot file.noja [-o out.c]
+		Error error;
+		Error_Init(&error);
+
+		const char *input  = NULL;
+		const char *output = NULL;
+
+		for(int i = 2; i < argc; i += 1)
+		{
+			if(!strcmp(argv[i], "-o") && i+1 < argc)
+				output = argv[++i];
+			else if(input == NULL)
+				input = argv[i];
+			else
+			{
+				Error_Report(&error, 0, "Unexpected argument %s", argv[i]);
+				print_error(NULL, &error);
+				Error_Free(&error);
+				return -1;
+			}
+		}
+
+		if(input == NULL)
+		{
+			Error_Report(&error, 0, "Missing source file");
+			print_error(NULL, &error);
+			Error_Free(&error);
+			return -1;
+		}
+
+		return translate_file(input, output) ? 0 : -1;
+	}
+
 	if(!strcmp(argv[1], "help"))
 	{
 		fprintf(stdout, usage);
@@ -26,69 +26,165 @@
 ** | You should have received a copy of the GNU General Public License along  |
 ** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
 ** +--------------------------------------------------------------------------+
-** |                                                                          | 
-** |                          WHAT IS THIS FILE?                              |
+** |                           WHAT IS THIS FILE?                             |
 ** | This is the implementation of the "Heap", an object that provides the    |
 ** | rest of the program with memory and manages it by claiming it back       |
 ** | implicitly when it's not in use anymore. To determine which memory is    |
 ** | used or not, the heap system must be aware of the object graph. This is  |
 ** | the reason why the Heap is tightly coupled to the object model.          |
 ** |                                                                          |
-** |                          HOW DOES IT WORK?                               |
-** | The collection algorithm is move-and-compact. The allocator is a         |
-** | bump-pointer allocator. When the base pool of memory is filled up,       |
-** | further allocations are forwarded to the stdlib's malloc, but are kept   |
-** | track of by putting them in a linked list. When the language's runtime   |
-** | system decides to free up some memory, a new heap is allocated and the   |
-** | live objects are moved to it, then the old heap is freed. The references |
-** | between live objects are updated when moving them. Some objects implement|
-** | destructors that must be called when a new heap is allocated and they're |
-** | not moved to it. An auxiliary list of allocated objects with destructors |
-** | is stored alongside the heap. When the live objects are moved and the    |
-** | ones to be destroyed are left in the old one, the list of objects with   |
-** | destructors is iterated over and the objects in it that weren't moved are|
-** | destroied and removed from the list. This approach becomes linearly      |
-** | slower with the number of allocated objects with destructors, but it's   |
-** | assumed that not many of them implement them.                            |
-** | If during a collection the new memory pool is filled up, then an error is|
-** | thrown to the parent system.                                             |
+** |                           HOW DOES IT WORK?                              |
+** | The heap is split in two generations. New objects are allocated in a     |
+** | small pool called the "nursery" using a bump-pointer allocator. When the |
+** | nursery fills up, a "minor collection" moves the objects in it that are  |
+** | still alive to the "old generation", and then the nursery is reused from |
+** | the start. Since most objects die young, a minor collection only moves a |
+** | small number of objects. The old generation is a list of big segments    |
+** | that are also filled using a bump-pointer allocator. When it's about to  |
+** | grow past its size limit, a "major collection" moves all of the live     |
+** | objects of both generations to a new list of segments, then the previous |
+** | segments are freed. If the nursery is filled up before the runtime has a |
+** | chance to collect it, further allocations are bump-allocated from chunks |
+** | obtained with malloc, which are freed all together after the next        |
+** | collection. That will then be a major one.                               |
+** | Some objects implement destructors that must be called when they're not  |
+** | moved by a collection. An auxiliary list of allocated objects with       |
+** | destructors is stored alongside the heap. When the live objects are      |
+** | moved and the ones to be destroyed are left behind, the list of objects  |
+** | with destructors is iterated over and the objects in it that weren't     |
+** | moved are removed from it. The ones that were allocated after the last   |
+** | minor collection are at the end of the list, so minor collections only   |
+** | iterate over those. The objects to be destroyed are copied to a queue,   |
+** | and their destructors are called by [Heap_RunDestructors] after the      |
+** | collection, so that they don't make the pause longer.                    |
+** |                                                                          |
+** |                          HOW BIG IS THE HEAP?                            |
+** | After a major collection, the size limit of the old generation is set so |
+** | that the live objects occupy a given percentage of it (50% by default).  |
+** | This way the heap grows when most objects survive, so that collections   |
+** | don't get more frequent, and shrinks when they don't. The limit is kept  |
+** | between a minimum and a maximum size. If the live objects don't fit in   |
+** | the maximum size, the collection fails and an error is thrown to the     |
+** | parent system.                                                           |
+** | The segments and the nursery are mapped directly with mmap. The segments |
+** | freed by a major collection are kept for reuse, but the memory of the    |
+** | ones that won't be needed before the next major collection is given back |
+** | to the system with madvise.                                              |
 ** |                                                                          |
 ** |                       HOW ARE POINTERS UPDATED?                          |
-** | Basically, when an object is moved from the old to the new heap, the     |
-** | location of the object in the old heap is overwritten with a placeholder |
-** | object that holds the new location. Then all of it's references are      |
-** | iterated over and if they refer to placeholders they're updated with the |
+** | Basically, when an object is moved to its new location, the old location |
+** | of the object is overwritten with a placeholder object that holds the    |
+** | new location. The roots are moved first. Then the moved objects are      |
+** | scanned one after the other in the order they were copied, which is the  |
+** | order they appear in the new pool, and all of their references are       |
+** | iterated over. If they refer to placeholders they're updated with the    |
 ** | new location of the object. If the references don't refer to placeholder |
-** | objects, then the referred objects are moved too. This is a recursive    |
-** | process that, when applied to the root object of the program, moves all  |
-** | reachable objects to the new heap and updates the pointers. The          |
-** | complexity of this algorithm is proportional to the number of live       |
-** | objects.                                                                 | 
+** | objects, then the referred objects are moved too, which appends them to  |
+** | the pool. When the scan reaches the end of the pool, all reachable       |
+** | objects were moved and all the pointers updated. This is known as        |
+** | "Cheney's algorithm". The complexity of this algorithm is proportional   |
+** | to the number of live objects, and unlike a recursive visit it doesn't   |
+** | use more of the C stack for deeper object graphs.                        |
+** | Since extensions are copied in the same pool, they're preceded by a      |
+** | header word that tells the scan to skip them. The header can't be        |
+** | mistaken for an object since it starts with a value that isn't a valid   |
+** | type index, while objects start with the index of their type.            |
+** |                                                                          |
+** |                      WHAT IS THE REMEMBERED SET?                         |
+** | A minor collection only follows the references of objects in the         |
+** | nursery, which means that young objects only referred to by old objects  |
+** | would be lost. To avoid that, when a reference is stored into an old     |
+** | object, the object is added to the "remembered set" (this is the "write  |
+** | barrier"). A minor collection uses the objects in the remembered set as  |
+** | additional roots. Objects don't change after they're created other than  |
+** | by insertion in lists, maps and buffers, so that's where the write       |
+** | barrier is. Since all of the surviving young objects are moved to the    |
+** | old generation, the remembered set is emptied after each collection.     |
 ** |                                                                          |
-** |                  WHAT IS A BUMP-POINTER ALLOCATOR?                       |
+** |                       WHAT IS THE IMMORTAL SPACE?                        |
+** | Objects that live as long as the runtime, like the builtins, can be      |
+** | allocated in the "immortal space" (see [Heap_SetImmortal]). It's made of |
+** | chunks that are only freed with the heap. Its objects are marked as      |
+** | static, so collections never move or scan them. For this reason they     |
+** | can't refer to objects outside of the immortal space, other than static  |
+** | ones, and they can't have destructors.                                   |
+** |                                                                          |
+** |                   WHAT IS A BUMP-POINTER ALLOCATOR?                      |
 ** | A bump-pointer allocator is a minimal memory management system. A        |
 ** | contiguous pool of memory is allocated. On a higher level, allocations   |
-** | are stacked one after another until the pool is all used up. This is done|
-** | by having a pointer that points to the first free buffer of the pool.    |
-** | Initially, it points to the first byte of the pool. When N bytes are     |
-** | requested, the value of the pointer is given to the caller and then it's |
-** | incremented by the allocated amount. When the pool has less free memory  |
-** | than what is requested, the allocation fails.                            |
+** | are stacked one after another until the pool is all used up. This is     |
+** | done by having a pointer that points to the first free buffer of the     |
+** | pool. Initially, it points to the first byte of the pool. When N bytes   |
+** | are requested, the value of the pointer is given to the caller and then  |
+** | it's incremented by the allocated amount. When the pool has less free    |
+** | memory than what is requested, the allocation fails.                     |
+** |                                                                          |
+** |                    WHAT IS THE LARGE OBJECT SPACE?                       |
+** | Extensions bigger than a threshold (like the items of big lists or the   |
+** | bodies of big strings and buffers) aren't allocated in the nursery. Each |
+** | of them is mapped in its own pages and it's never moved. They're stored  |
+** | in an hash table by address, so that a collection can tell which         |
+** | extensions are in it. Instead of copying them, the collection marks      |
+** | them, and when it's done the ones that weren't marked are unmapped. Like |
+** | the other allocations, large ones are young until they survive their     |
+** | first collection, and minor collections only free young ones.            |
+** |                                                                          |
+** |                HOW ARE MAJOR COLLECTIONS PARALLELIZED?                   |
+** | When the heap is configured to use more than one thread and the old      |
+** | generation is big enough, the scan of a major collection is run by       |
+** | multiple threads. The roots are moved by the thread that runs the        |
+** | collection, then they're divided between the threads. Each thread has a  |
+** | deque of moved objects that still need to be scanned. It pushes and pops |
+** | objects at the bottom of its own deque, and when it's empty it steals    |
+** | objects from the top of the others. The collection is over when all      |
+** | threads are out of work.                                                 |
+** | To avoid taking a lock for each object, the threads copy objects into    |
+** | private buffers of the old generation (PLABs). Two threads may try to    |
+** | move the same object at the same time, so the first one sets a busy flag |
+** | on it with an atomic compare-and-swap, and the others wait until it's    |
+** | marked as moved. Since the buffers may not be filled up, the segments    |
+** | aren't scanned sequentially after a parallel collection. That's fine     |
+** | since later scans start after the last buffer.                           |
+** |                                                                          |
+** |              HOW ARE MAJOR COLLECTIONS MADE INCREMENTAL?                 |
+** | When a pause budget is set, a major collection can be spread over many   |
+** | pauses. The collection that starts it is a minor one, and the ones that  |
+** | follow are minor too, but after collecting the nursery each of them uses |
+** | what's left of the budget to copy some of the old generation to a new    |
+** | list of segments. The program keeps using the originals, so they're left |
+** | as they are and the copies are tracked by an hash table. If an object    |
+** | changes after it was copied, the write barrier puts it in the remembered |
+** | set, and the minor collection marks its copy as "dirty".                 |
+** | When all of the old objects were copied, a last pause completes the      |
+** | collection. The dirty copies are updated and then the collection goes on |
+** | as a major one, which looks up the copies of the originals in the table. |
+** | It only needs to move the objects that weren't copied, like the young    |
+** | ones, and to scan the dirty copies again. Big containers that change     |
+** | while the collection is in progress are only updated by the last pause,  |
+** | so its length depends on their size.                                     |
 ** +--------------------------------------------------------------------------+
 */
 #include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include "objects.h"
+#include "../utils/bpalloc.h"
 
 #if USING_VALGRIND
 #include <valgrind/memcheck.h>
 #endif
 
-typedef struct OflowAlloc OflowAlloc;
-struct OflowAlloc {
-	OflowAlloc *prev;
+typedef struct Segment Segment;
+struct Segment {
+	Segment *next;
+	int size, used;
 	char body[];
 };
 
@@ -97,260 +193,2409 @@ typedef struct {
 	_Bool (*destructor)(Object*, Error*);
 } PendingDestruct;
 
+// An object with a destructor that a collection
+// found dead. It's followed by a copy of the object
+// that is [size] bytes long.
+typedef struct {
+	_Bool (*destructor)(Object*, Error*);
+	int size;
+} DeadObject;
+
+// An allocation of the large object space.
+typedef struct {
+	void *addr;
+	int   size;
+	_Bool young;
+	_Bool marked;
+} LargeObject;
+
+// An object of the old generation that was copied by
+// the incremental collection in progress.
+typedef struct {
+	Object *original;
+	Object *copy;
+} Replica;
+
+// Extensions of at least this size are allocated
+// in the large object space.
+#define LARGE_OBJECT_THRESHOLD 8192
+
+// Header of the extensions moved by a collection.
+// The mark overlaps the type index of the object
+// headers and isn't a valid index, so that the two
+// can be told apart.
+typedef struct {
+	unsigned int mark;
+	unsigned int size;
+} ExtensionHeader;
+
+#define EXTENSION_MARK 0xFFFFFFFF
+
+#define SEGMENT_SIZE (1 << 20)
+
+// The segments freed by major collections are kept
+// for reuse, up to this many. The memory of the ones
+// that the old generation isn't expected to need 
+// soon is given back to the system.
+#define MAX_FREE_SEGMENTS 64
+
+// Mappings at least this big are hinted to be backed
+// by huge pages.
+#define HUGE_PAGE_SIZE (1 << 21)
+
+// The immortal space is allocated in chunks
+// of this size.
+#define IMMORTAL_CHUNK_SIZE (1 << 16)
+
+// The queue of the dead objects with destructors
+// is freed once emptied if it grew past this size.
+#define DEAD_QUEUE_SIZE (1 << 16)
+
+// What doesn't fit in the nursery is allocated
+// from chunks of this size, which are freed all
+// together after the next major collection.
+#define OFLOW_CHUNK_SIZE (1 << 16)
+
+// Set on an object while a collector thread is
+// copying it. It's never set outside of a parallel
+// collection.
+#define Object_BUSY 8
+
+// Major collections are only parallel when the
+// old generation is at least this big, since
+// starting the threads has a cost.
+#define PARALLEL_THRESHOLD SEGMENT_SIZE
+
+// Set on the copies made by an incremental collection
+// once their references were copied too. It's removed
+// when the collection is completed.
+#define Object_SCANNED 16
+
+// Set on the copies made by an incremental collection
+// when their original changed after they were made.
+#define Object_DIRTY 32
+
+// The references of the copies made by incremental
+// collections are copied at most this many at a time,
+// so that big containers can be scanned over many 
+// pauses.
+#define SCAN_CHUNK 2048
+
+#define MAX_COLLECTOR_THREADS 64
+
+// Size of the to-space buffers of the collector
+// threads. Bigger allocations don't use them.
+#define PLAB_SIZE (32 << 10)
+
+// Capacity of the work-stealing deques. It
+// must be a power of 2.
+#define DEQUE_SIZE (1 << 14)
+
+typedef struct Worker Worker;
+
 struct xHeap {
+
+	// The state of the nursery. It must be the 
+	// first member, since the inline allocation
+	// fast path accesses it (see [Heap_Malloc]).
+	HeapYoung young;
+
+	// Number of objects in the old generation.
 	int objcount;
-	int   size;
-	int   used;
-	int   total;
-	void *body;
-	OflowAlloc *oflow;
+
+	// The old generation. Its segments are
+	// filled in the order of the list.
+	Segment *head, *tail;
+	int total;
+	int limit;
+
+	// Segments freed by major collections
+	// that can be reused.
+	Segment *free_segments;
+	int      free_count;
+
+	// The immortal space.
+	BPAlloc *immortal;
+	_Bool    allocating_immortal;
+
+	// Sizing policy of the old generation.
+	int min_size;
+	int max_size;
+	int occupancy;
+
+	// The young generation. The nursery is twice
+	// as big as the amount of memory that triggers
+	// a minor collection, so that what's allocated
+	// between two safepoints rarely overflows it.
+	int   nursery_size;
+	BPAlloc *oflow;
+
+	// The large object space. It's an hash table
+	// of the allocations, by address.
+	LargeObject *los;
+	int los_capacity;
+	int los_count;
+	int los_young;
+
+	// Old objects that may refer to young ones.
+	Object **remset;
+	int remset_size, remset_used;
+	_Bool remset_failed;
+
+	// Objects with destructors. The ones from the
+	// [pend_old]-th on were allocated after the last
+	// minor collection. The dead ones are queued into
+	// [dead] until their destructors are called.
 	PendingDestruct *pend;
-	int pend_size, pend_used;
+	int pend_size, pend_used, pend_old;
+	char *dead;
+	int dead_size, dead_used;
 
 	_Bool collecting;
+	_Bool collecting_minor;
 	_Bool collection_failed;
 	int movedcount;
-	void *old_body;
-	int   old_used;
-	int   old_total;
-	OflowAlloc *old_oflow;
+	Segment *scan_segment;
+	int      scan;
+	Segment *old_head;
+	BPAlloc *old_oflow;
 	Error *error;
+
+	// Parallel collections. The lock protects
+	// the allocation of the old generation and
+	// the shared overflow stack of the work
+	// to be scanned.
+	int   threads;
+	_Bool collecting_parallel;
+	pthread_mutex_t lock;
+	Worker  *workers;
+	int      nworkers;
+	Object **overflow;
+	int overflow_size, overflow_used;
+	int idle;
+
+	// Incremental collections. While one is in
+	// progress, the live objects of the old generation
+	// are copied to a second list of segments by the
+	// minor collections, but the program keeps using
+	// the originals. The pause budget is in micro
+	// seconds and it's 0 when they're disabled.
+	int pause_budget;
+	int max_pause;
+	struct timespec pause_start;
+	_Bool incr_starting;
+	_Bool incr_active;
+	_Bool incr_finishing;
+	_Bool incr_scanned;
+	Replica *replicas;
+	int replicas_capacity, replicas_count;
+	Object **incr_roots;
+	int incr_roots_size, incr_roots_used;
+	Object **incr_dirty;
+	int incr_dirty_size, incr_dirty_used;
+	int incr_dirty_deferred;
+	_Bool incr_dirty_lost;
+	int incr_start_total;
+	Segment *incr_head, *incr_tail;
+	int      incr_total;
+	Segment *incr_scan_segment;
+	int      incr_scan;
+	Object  *incr_partial;
+	int      incr_partial_index;
+	Object ***incr_refs;
+	int       incr_refs_size, incr_refs_used;
 };
 
+static void *map_pages(long int size);
+
+/* Symbol: Heap_New
+ *
+ *   Creates a heap. The [size] is the initial and minimum
+ *   size of the old generation and it determines the size 
+ *   of the nursery. By default the old generation can grow
+ *   indefinitely. See [Heap_SetSizeLimits].
+ *
+ * Returns:
+ *   The new heap or NULL if it couldn't be allocated.
+ */
 Heap *Heap_New(int size)
 {
 	if(size < 0)
 		size = 65536;
 
-	Heap *heap = malloc(sizeof(Heap));
+	Heap *heap = malloc(sizeof(Heap));
+
+	if(heap == NULL)
+		return NULL;
+
+	int nursery_size = size / 8;
+
+	if(nursery_size < 4096)
+		nursery_size = 4096;
+
+	heap->objcount = 0;
+	heap->head = NULL;
+	heap->tail = NULL;
+	heap->total = 0;
+	heap->limit = size;
+	heap->min_size = size;
+	heap->max_size = 0;
+	heap->occupancy = 50;
+	heap->nursery_size = nursery_size;
+	heap->young.used = 0;
+	heap->young.limit = 2 * nursery_size;
+	heap->young.total = 0;
+	heap->young.objcount = 0;
+	heap->young.nursery = map_pages(2 * nursery_size);
+	heap->free_segments = NULL;
+	heap->free_count = 0;
+	heap->immortal = NULL;
+	heap->allocating_immortal = 0;
+
+	if(heap->young.nursery == NULL)
+	{
+		free(heap);
+		return NULL;
+	}
+	heap->los = NULL;
+	heap->los_capacity = 0;
+	heap->los_count = 0;
+	heap->los_young = 0;
+	heap->remset = NULL;
+	heap->remset_size = 0;
+	heap->remset_used = 0;
+	heap->remset_failed = 0;
+	heap->pend = NULL;
+	heap->pend_size = 0;
+	heap->pend_used = 0;
+	heap->pend_old = 0;
+	heap->dead = NULL;
+	heap->dead_size = 0;
+	heap->dead_used = 0;
+	heap->oflow = NULL;
+	heap->collecting = 0;
+	heap->threads = 1;
+	heap->collecting_parallel = 0;
+	heap->workers = NULL;
+	heap->nworkers = 0;
+	heap->overflow = NULL;
+	heap->overflow_size = 0;
+	heap->overflow_used = 0;
+	heap->idle = 0;
+	heap->pause_budget = 0;
+	heap->max_pause = 0;
+	heap->incr_starting = 0;
+	heap->incr_active = 0;
+	heap->incr_finishing = 0;
+	heap->incr_scanned = 0;
+	heap->replicas = NULL;
+	heap->replicas_capacity = 0;
+	heap->replicas_count = 0;
+	heap->incr_roots = NULL;
+	heap->incr_roots_size = 0;
+	heap->incr_roots_used = 0;
+	heap->incr_dirty = NULL;
+	heap->incr_dirty_size = 0;
+	heap->incr_dirty_used = 0;
+	heap->incr_dirty_deferred = 0;
+	heap->incr_dirty_lost = 0;
+	heap->incr_start_total = 0;
+	heap->incr_head = NULL;
+	heap->incr_tail = NULL;
+	heap->incr_total = 0;
+	heap->incr_scan_segment = NULL;
+	heap->incr_scan = 0;
+	heap->incr_partial = NULL;
+	heap->incr_partial_index = 0;
+	heap->incr_refs = NULL;
+	heap->incr_refs_size = 0;
+	heap->incr_refs_used = 0;
+
+	pthread_mutex_init(&heap->lock, NULL);
+
+#if USING_VALGRIND
+	VALGRIND_CREATE_MEMPOOL(heap, 0, 0);
+#endif
+
+	return heap;
+}
+
+static long int get_page_size(void)
+{
+	static long int page_size = 0;
+
+	if(page_size == 0)
+		page_size = sysconf(_SC_PAGESIZE);
+
+	return page_size;
+}
+
+static long int round_to_pages(long int size)
+{
+	long int page_size = get_page_size();
+
+	return (size + page_size - 1) / page_size * page_size;
+}
+
+/* Symbol: map_pages
+ *
+ *   Maps [size] bytes of memory, rounded up to a
+ *   multiple of the page size. The mapping is hinted
+ *   to be backed by huge pages if it's big enough.
+ *
+ * Returns:
+ *   The address of the mapping or NULL.
+ */
+static void *map_pages(long int size)
+{
+	size = round_to_pages(size);
+
+	void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if(addr == MAP_FAILED)
+		return NULL;
+
+#ifdef MADV_HUGEPAGE
+	if(size >= HUGE_PAGE_SIZE)
+		madvise(addr, size, MADV_HUGEPAGE);
+#endif
+
+	return addr;
+}
+
+static void unmap_pages(void *addr, long int size)
+{
+	munmap(addr, round_to_pages(size));
+}
+
+static Segment *new_segment(Heap *heap, int size)
+{
+	Segment *segment;
+
+	if(size == SEGMENT_SIZE && heap->free_segments != NULL)
+	{
+		segment = heap->free_segments;
+		heap->free_segments = segment->next;
+		heap->free_count -= 1;
+	}
+	else
+	{
+		segment = map_pages(sizeof(Segment) + size);
+
+		if(segment == NULL)
+			return NULL;
+	}
+
+	segment->next = NULL;
+	segment->size = size;
+	segment->used = 0;
+	return segment;
+}
+
+/* Symbol: free_segments
+ *
+ *   Frees a list of segments. The ones of the default
+ *   size are kept for reuse. See [trim_free_segments].
+ */
+static void free_segments(Heap *heap, Segment *segment)
+{
+	while(segment)
+	{
+		Segment *next = segment->next;
+
+		if(segment->size == SEGMENT_SIZE && heap->free_count < MAX_FREE_SEGMENTS)
+		{
+			segment->next = heap->free_segments;
+			heap->free_segments = segment;
+			heap->free_count += 1;
+		}
+		else
+			unmap_pages(segment, sizeof(Segment) + segment->size);
+
+		segment = next;
+	}
+}
+
+/* Symbol: trim_free_segments
+ *
+ *   Gives the memory of the free segments back to the
+ *   system, except for the ones the old generation will
+ *   use before it reaches its limit. The segments stay
+ *   mapped, and their pages are zeroed when touched.
+ */
+static void trim_free_segments(Heap *heap)
+{
+	long long int room = (long long int) heap->limit - heap->total;
+
+	for(Segment *segment = heap->free_segments; segment; segment = segment->next)
+	{
+		if(room > 0)
+			room -= SEGMENT_SIZE;
+		else
+		{
+			// The segment header is in the first page.
+			long int page_size = get_page_size();
+			madvise((char*) segment + page_size, round_to_pages(sizeof(Segment) + SEGMENT_SIZE) - page_size, MADV_DONTNEED);
+		}
+	}
+}
+
+void Heap_Free(Heap *heap)
+{
+
+#if USING_VALGRIND
+	VALGRIND_DESTROY_MEMPOOL(heap);
+#endif
+
+	Error error;
+	Error_Init(&error);
+
+	while(!Heap_RunDestructors(heap, &error))
+	{
+		// Errors occurred! We can't do anything about
+		// it now though.
+		Error_Free(&error);
+		Error_Init(&error);
+	}
+
+	for(int i = 0; i < heap->pend_used; i += 1)
+	{
+		heap->pend[i].destructor(heap->pend[i].object, &error);
+		if(error.occurred)
+		{
+			// Errors occurred! We can't do anything about
+			// it now though.
+			Error_Free(&error);
+			Error_Init(&error);
+		}
+	}
+
+	if(heap->oflow != NULL)
+		BPAlloc_Free(heap->oflow);
+
+	if(heap->immortal != NULL)
+		BPAlloc_Free(heap->immortal);
+
+	for(int i = 0; i < heap->los_capacity; i += 1)
+		if(heap->los[i].addr != NULL)
+			munmap(heap->los[i].addr, heap->los[i].size);
+
+	free_segments(heap, heap->head);
+	free_segments(heap, heap->incr_head);
+
+	while(heap->free_segments)
+	{
+		Segment *next = heap->free_segments->next;
+		unmap_pages(heap->free_segments, sizeof(Segment) + SEGMENT_SIZE);
+		heap->free_segments = next;
+	}
+	free(heap->replicas);
+	free(heap->incr_roots);
+	free(heap->incr_dirty);
+	free(heap->incr_refs);
+	free(heap->los);
+	free(heap->remset);
+	free(heap->pend);
+	free(heap->dead);
+	free(heap->overflow);
+	unmap_pages(heap->young.nursery, 2 * heap->nursery_size);
+	pthread_mutex_destroy(&heap->lock);
+	free(heap);
+}
+
+/* Symbol: Heap_SetSizeLimits
+ *
+ *   Sets the policy used to resize the old generation.
+ *   After each major collection, the old generation is
+ *   allowed to grow until the live objects occupy the
+ *   [occupancy] percent of it, so that it grows when
+ *   most objects survive and shrinks when they don't.
+ *   The size is never less than [min_size] and never
+ *   more than [max_size] bytes. If [max_size] is 0,
+ *   there's no upper limit. When the live objects 
+ *   don't fit in [max_size] bytes, the collection
+ *   fails with an "Out of heap" error.
+ */
+void Heap_SetSizeLimits(Heap *heap, int min_size, int max_size, int occupancy)
+{
+	assert(min_size >= 0 && max_size >= 0);
+	assert(occupancy > 0 && occupancy < 100);
+
+	heap->min_size = min_size;
+	heap->max_size = max_size;
+	heap->occupancy = occupancy;
+
+	if(heap->limit < min_size)
+		heap->limit = min_size;
+
+	if(max_size > 0 && heap->limit > max_size)
+		heap->limit = max_size;
+}
+
+/* Symbol: Heap_SetCollectorThreads
+ *
+ *   Sets the number of threads that run major
+ *   collections. When it's 1, which is the default,
+ *   collections only use the calling thread.
+ */
+void Heap_SetCollectorThreads(Heap *heap, int threads)
+{
+	assert(threads > 0);
+
+	if(threads > MAX_COLLECTOR_THREADS)
+		threads = MAX_COLLECTOR_THREADS;
+
+	heap->threads = threads;
+}
+
+/* Symbol: Heap_SetPauseBudget
+ *
+ *   Makes major collections incremental. Instead of
+ *   moving all of the live objects at once, they're
+ *   copied a bit at a time by the minor collections
+ *   that follow, each of which tries not to take more
+ *   than [usecs] microseconds. The collection is then
+ *   completed by a shorter pause. If [usecs] is 0,
+ *   which is the default, major collections aren't
+ *   incremental.
+ */
+void Heap_SetPauseBudget(Heap *heap, int usecs)
+{
+	assert(usecs >= 0);
+	heap->pause_budget = usecs;
+}
+
+int Heap_GetPauseBudget(Heap *heap)
+{
+	return heap->pause_budget;
+}
+
+/* Symbol: Heap_GetMaxPause
+ *
+ * Returns:
+ *   The duration in microseconds of the longest 
+ *   collection so far.
+ */
+int Heap_GetMaxPause(Heap *heap)
+{
+	return heap->max_pause;
+}
+
+unsigned int Heap_GetSize(Heap *heap)
+{
+	return heap->limit;
+}
+
+unsigned int Heap_GetObjectCount(Heap *heap)
+{
+	return heap->objcount + heap->young.objcount;
+}
+
+float Heap_GetUsagePercentage(Heap *heap)
+{
+	return 100.0 * heap->young.total / heap->nursery_size;
+}
+
+static inline _Bool is_young(Heap *heap, void *addr)
+{
+	uintptr_t start = (uintptr_t) heap->young.nursery;
+	uintptr_t end   = start + 2 * heap->nursery_size;
+
+	return (uintptr_t) addr >= start && (uintptr_t) addr < end;
+}
+
+static inline int round_object_size(int size)
+{
+	// The object must be big enough to be replaced
+	// by a MovedObject when collected.
+	if(size < (int) sizeof(MovedObject))
+		size = sizeof(MovedObject);
+
+	return size;
+}
+
+static inline int get_object_size(Object *obj)
+{
+	TypeObject *type = Object_TypeOf(obj);
+
+	if(type->get_size != NULL)
+		return round_object_size(type->get_size(obj));
+
+	return round_object_size(type->size);
+}
+
+static void *bump_malloc(Heap *heap, int size, Error *err);
+
+static LargeObject *find_large_object(LargeObject *table, int capacity, void *addr)
+{
+	assert(capacity > 0);
+
+	unsigned int mask = capacity - 1;
+	unsigned int i = ((uintptr_t) addr >> 12) & mask;
+
+	while(table[i].addr != NULL && table[i].addr != addr)
+		i = (i + 1) & mask;
+
+	return &table[i];
+}
+
+static _Bool grow_large_object_table(Heap *heap)
+{
+	int new_capacity = heap->los_capacity == 0 ? 32 : 2 * heap->los_capacity;
+
+	LargeObject *new_table = calloc(new_capacity, sizeof(LargeObject));
+
+	if(new_table == NULL)
+		return 0;
+
+	for(int i = 0; i < heap->los_capacity; i += 1)
+		if(heap->los[i].addr != NULL)
+			*find_large_object(new_table, new_capacity, heap->los[i].addr) = heap->los[i];
+
+	free(heap->los);
+	heap->los = new_table;
+	heap->los_capacity = new_capacity;
+	return 1;
+}
+
+/* Symbol: large_malloc
+ *
+ *   Allocates [size] bytes in the large object space.
+ *   Allocations that aren't [young] are made by the
+ *   incremental collections. They're marked already,
+ *   since they're reachable from their copies.
+ */
+static void *large_malloc(Heap *heap, int size, _Bool young, Error *err)
+{
+	if(2 * (heap->los_count + 1) > heap->los_capacity)
+		if(!grow_large_object_table(heap))
+		{
+			Error_Report(err, 1, "No memory");
+			return NULL;
+		}
+
+	int mapped_size = round_to_pages(size);
+
+	void *addr = map_pages(mapped_size);
+
+	if(addr == NULL)
+	{
+		Error_Report(err, 1, "No memory");
+		return NULL;
+	}
+
+	*find_large_object(heap->los, heap->los_capacity, addr) = (LargeObject) { 
+		.addr = addr, .size = mapped_size, .young = young, .marked = !young
+	};
+
+	heap->los_count += 1;
+
+	if(young)
+	{
+		heap->los_young += 1;
+		heap->young.total += mapped_size;
+	}
+	return addr;
+}
+
+static void remove_large_object(Heap *heap, void *addr)
+{
+	LargeObject *large = find_large_object(heap->los, heap->los_capacity, addr);
+	assert(large->addr == addr);
+
+	munmap(large->addr, large->size);
+
+	heap->los_count -= 1;
+	if(large->young)
+		heap->los_young -= 1;
+
+	// The entries that follow are moved back so that
+	// the lookups don't stop at the removed one.
+	unsigned int mask = heap->los_capacity - 1;
+	unsigned int hole = large - heap->los;
+	unsigned int i = hole;
+
+	while(1)
+	{
+		i = (i + 1) & mask;
+
+		if(heap->los[i].addr == NULL)
+			break;
+
+		unsigned int home = ((uintptr_t) heap->los[i].addr >> 12) & mask;
+
+		// If the entry's home is cyclically in (hole, i],
+		// it's reachable without passing by the hole.
+		_Bool reachable = hole <= i ? (home > hole && home <= i) : (home > hole || home <= i);
+
+		if(!reachable)
+		{
+			heap->los[hole] = heap->los[i];
+			hole = i;
+		}
+	}
+
+	heap->los[hole] = (LargeObject) { .addr = NULL };
+}
+
+/* Symbol: sweep_large_objects
+ *
+ *   Frees the allocations of the large object space
+ *   that weren't marked by a collection and unmarks
+ *   the others. A minor collection only frees young
+ *   allocations since it doesn't know if old ones
+ *   are referenced.
+ */
+static void sweep_large_objects(Heap *heap, _Bool minor)
+{
+	if(heap->los_count == 0 || (minor && heap->los_young == 0))
+		return;
+
+	// The allocations that are kept are moved
+	// to a new table, so that the freed ones 
+	// leave no holes.
+	LargeObject *new_table = calloc(heap->los_capacity, sizeof(LargeObject));
+
+	for(int i = 0; i < heap->los_capacity; i += 1)
+	{
+		LargeObject large = heap->los[i];
+
+		if(large.addr == NULL)
+			continue;
+
+		// If the new table couldn't be allocated, 
+		// they're all kept until the next collection.
+		_Bool keep = large.marked || (minor && !large.young) || new_table == NULL;
+
+		if(!keep)
+		{
+			munmap(large.addr, large.size);
+			heap->los_count -= 1;
+			continue;
+		}
+
+		// Old allocations were counted in the old 
+		// generation already, unless this is a major
+		// collection, which counts them from zero.
+		if(large.young || !minor)
+			heap->total += large.size;
+
+		// Old allocations are only marked by the
+		// incremental collection in progress, so
+		// minor collections leave their marks.
+		if(large.young || !minor)
+			large.marked = 0;
+		large.young = 0;
+
+		if(new_table == NULL)
+			heap->los[i] = large;
+		else
+			*find_large_object(new_table, heap->los_capacity, large.addr) = large;
+	}
+
+	if(new_table != NULL)
+	{
+		free(heap->los);
+		heap->los = new_table;
+	}
+
+	heap->los_young = 0;
+}
+
+/* Symbol: update_fast_path
+ *
+ *   Enables the inline allocation fast path unless
+ *   objects must be allocated somewhere else than 
+ *   the nursery. It's disabled by setting the limit
+ *   of the nursery to 0.
+ */
+static void update_fast_path(Heap *heap)
+{
+	if(heap->collecting || heap->allocating_immortal)
+		heap->young.limit = 0;
+	else
+		heap->young.limit = 2 * heap->nursery_size;
+}
+
+/* Symbol: Heap_SetImmortal
+ *
+ *   Makes the following allocations happen in the 
+ *   immortal space, or not. The objects allocated
+ *   there must only refer to static or immortal 
+ *   objects, and their types can't have a [free]
+ *   method.
+ *
+ * Returns:
+ *   The previous value, so that it can be restored.
+ */
+_Bool Heap_SetImmortal(Heap *heap, _Bool immortal)
+{
+	assert(!heap->collecting);
+
+	_Bool previous = heap->allocating_immortal;
+	heap->allocating_immortal = immortal;
+	update_fast_path(heap);
+	return previous;
+}
+
+static void *immortal_malloc(Heap *heap, int size, Error *err)
+{
+	if(heap->immortal == NULL)
+		heap->immortal = BPAlloc_Init(IMMORTAL_CHUNK_SIZE);
+
+	void *addr = heap->immortal == NULL ? NULL : BPAlloc_Malloc(heap->immortal, size);
+
+	if(addr == NULL)
+		Error_Report(err, 1, "No memory");
+
+	return addr;
+}
+
+/* Symbol: Heap_SlowMalloc
+ *
+ *   The slow path of [Heap_Malloc] and [Heap_MallocSized].
+ *   It handles the objects that have a destructor or an 
+ *   [init] method, the allocations that don't fit in the
+ *   nursery and those made while collecting or in the 
+ *   immortal space.
+ *
+ *   The first time an object of a given type is
+ *   allocated, its [fast_size] is computed so that
+ *   the following ones can take the fast path.
+ */
+void *Heap_SlowMalloc(Heap *heap, TypeObject *type, int size, Error *err)
+{
+	// The type must be in the type table.
+	assert(Object_Types[type->index] == type);
+
+	size = round_object_size(size);
+
+#if !USING_VALGRIND
+	if(type->fast_size == 0 && type->free == NULL && type->init == NULL)
+		type->fast_size = round_object_size(type->size);
+#endif
+
+	if(heap->allocating_immortal)
+	{
+		assert(type->free == NULL);
+
+		Object *obj = immortal_malloc(heap, size, err);
+
+		if(obj == NULL)
+			return NULL;
+
+		obj->type_index = type->index;
+		obj->flags = Object_STATIC;
+
+		if(type->init && !type->init(obj, err))
+			return NULL;
+
+		return obj;
+	}
+
+	_Bool requires_destruct = type->free != NULL;
+
+	if(requires_destruct)
+	{
+		// This type of object requires
+		// a destructor to be called.
+		if(heap->pend == NULL)
+		{
+			int n = 8;
+
+			heap->pend = malloc(n * sizeof(PendingDestruct));
+				
+			if(heap->pend == NULL)
+			{
+				Error_Report(err, 1, "No memory");
+				return NULL;
+			}
+
+			heap->pend_used = 0;
+			heap->pend_old = 0;
+			heap->pend_size = n;
+		}
+		else if(heap->pend_size == heap->pend_used)
+		{
+			int factor = 2;
+
+			void *new_pend = realloc(heap->pend, factor * heap->pend_size * sizeof(PendingDestruct));
+
+			if(new_pend == NULL)
+			{
+				Error_Report(err, 1, "No memory");
+				return NULL;
+			}
+
+			heap->pend = new_pend;
+			heap->pend_size *= factor;
+		}
+
+		assert(heap->pend_size > heap->pend_used);
+	}
+
+	// Objects are never allocated in the
+	// large object space.
+	void *addr = bump_malloc(heap, size, err);
+
+	if(addr == NULL)
+		return NULL;
+
+	Object *obj = addr;
+
+	obj->type_index = type->index;
+	obj->flags = 0;
+
+	if(type->init && !type->init(obj, err))
+		return NULL;
+
+	if(requires_destruct)
+		heap->pend[heap->pend_used++] = (PendingDestruct) { .object = obj, .destructor = type->free };
+
+	if(heap->collecting)
+		heap->objcount += 1;
+	else
+		heap->young.objcount += 1;
+
+	return (Object*) addr;
+}
+
+void *Heap_RawMalloc(Heap *heap, int size, Error *err)
+{
+	assert(err);
+	assert(heap);
+	assert(size > -1);
+
+	if(heap->allocating_immortal)
+		return immortal_malloc(heap, size, err);
+
+	if(size >= LARGE_OBJECT_THRESHOLD && !heap->collecting)
+		return large_malloc(heap, size, 1, err);
+
+	return bump_malloc(heap, size, err);
+}
+
+static void *bump_malloc(Heap *heap, int size, Error *err)
+{
+	void *addr;
+
+	if(heap->collecting)
+	{
+		// Objects are moved to the old generation.
+
+		Segment *segment = heap->tail;
+		int padding = 0;
+
+		if(segment != NULL && (segment->used & 7))
+		{
+			padding = 8 - (segment->used & 7);
+			segment->used += padding;
+		}
+
+		if(heap->max_size > 0 && heap->total + padding + size > heap->max_size)
+		{
+			Error_Report(err, 1, "Out of heap");
+			return NULL;
+		}
+
+		if(segment == NULL || segment->used + size > segment->size)
+		{
+			int segment_size = SEGMENT_SIZE;
+
+			if(segment_size < size)
+				segment_size = size;
+
+			segment = new_segment(heap, segment_size);
+
+			if(segment == NULL)
+			{
+				Error_Report(err, 1, "No memory");
+				return NULL;
+			}
+
+			if(heap->tail == NULL)
+				heap->head = segment;
+			else
+				heap->tail->next = segment;
+			heap->tail = segment;
+		}
+
+		addr = segment->body + segment->used;
+		segment->used += size;
+		heap->total   += size + padding;
+	}
+	else
+	{
+		// Sizes are rounded up so that the nursery 
+		// stays aligned for the fast path.
+		size = (size + 7) & ~7;
+
+		if(heap->young.used + size > 2 * heap->nursery_size)
+		{
+			if(heap->oflow == NULL)
+				heap->oflow = BPAlloc_Init(OFLOW_CHUNK_SIZE);
+
+			addr = heap->oflow == NULL ? NULL : BPAlloc_Malloc(heap->oflow, size);
+
+			if(addr == NULL)
+			{
+				Error_Report(err, 1, "No memory");
+				return NULL;
+			}
+		}
+		else
+		{
+			addr = heap->young.nursery + heap->young.used;
+			heap->young.used += size;
+		}
+
+		heap->young.total += size;
+	}
+
+	assert(((intptr_t) addr) % 8 == 0);
+
+#if USING_VALGRIND
+	VALGRIND_MEMPOOL_ALLOC(heap, addr, size);
+#endif
+
+	return addr;
+}
+
+/* Symbol: Heap_WriteBarrier
+ *
+ *   Must be called before an object that already exists
+ *   is changed, like when a reference is stored into it,
+ *   so that the object is added to the remembered set 
+ *   if it's old.
+ *
+ *   If the remembered set can't be grown, the next
+ *   collection is a major one, which doesn't need it.
+ */
+void Heap_WriteBarrier(Heap *heap, Object *obj)
+{
+	assert(heap != NULL && obj != NULL);
+
+	if(obj->flags & (Object_STATIC | Object_REMEMBERED))
+		return;
+
+	if(is_young(heap, obj))
+		return;
+
+	if(heap->remset_used == heap->remset_size)
+	{
+		int new_size = heap->remset_size == 0 ? 32 : 2 * heap->remset_size;
+
+		void *temp = realloc(heap->remset, new_size * sizeof(Object*));
+
+		if(temp == NULL)
+		{
+			heap->remset_failed = 1;
+			return;
+		}
+
+		heap->remset = temp;
+		heap->remset_size = new_size;
+	}
+
+	heap->remset[heap->remset_used++] = obj;
+	obj->flags |= Object_REMEMBERED;
+}
+
+static _Bool needs_major_collection(Heap *heap)
+{
+	// Overflow allocations can't be told apart
+	// from old ones.
+	if(heap->oflow != NULL || heap->remset_failed)
+		return 1;
+
+	// A minor collection moves at most all of
+	// the nursery to the old generation, which
+	// shouldn't grow past its limit because of
+	// it. Extensions may get twice as big because
+	// of their header.
+	return heap->total + 2 * heap->young.used + 8 > heap->limit;
+}
+
+static _Bool can_be_incremental(Heap *heap)
+{
+	if(heap->pause_budget == 0 || heap->oflow != NULL || heap->remset_failed)
+		return 0;
+
+	// The minor collections that do the incremental
+	// collection must not fail because the old
+	// generation can't grow.
+	return heap->max_size == 0 || heap->total + 2 * heap->young.used + 8 <= heap->max_size;
+}
+
+static _Bool needs_final_pause(Heap *heap)
+{
+	if(heap->incr_scanned || !can_be_incremental(heap))
+		return 1;
+
+	// The old generation keeps growing while the
+	// incremental collection is in progress. If it
+	// grows too much, the collection is completed
+	// at once.
+	return heap->total + 2 * heap->young.used + 8 > 2 * (long long int) heap->limit;
+}
+
+static void begin_final_pause(Heap *heap);
+
+_Bool Heap_StartCollection(Heap *heap, Error *error)
+{
+	assert(heap->collecting == 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &heap->pause_start);
+	heap->incr_start_total = heap->total;
+
+	heap->collecting = 1;
+	heap->collecting_parallel = 0;
+	update_fast_path(heap);
+	heap->collection_failed = 0;
+	heap->movedcount = 0;
+	heap->error = error;
+
+	// The scan starts from the first object moved
+	// by this collection. If there's no segment, it
+	// starts from the head, once it's allocated.
+	heap->scan_segment = heap->tail;
+	heap->scan = heap->tail ? heap->tail->used : 0;
+
+	_Bool minor;
+
+	if(heap->incr_active)
+		minor = !needs_final_pause(heap);
+	else if(needs_major_collection(heap))
+	{
+		// If the major collection is incremental, this
+		// is a minor collection that starts it.
+		minor = can_be_incremental(heap);
+		heap->incr_starting = minor;
+	}
+	else
+		minor = 1;
+
+	if(minor)
+	{
+		heap->collecting_minor = 1;
+		return 1;
+	}
+
+	heap->collecting_parallel = heap->threads > 1 && heap->total >= PARALLEL_THRESHOLD;
+
+	if(heap->incr_active)
+	{
+		begin_final_pause(heap);
+		return 1;
+	}
+
+	heap->old_head = heap->head;
+	heap->old_oflow = heap->oflow;
+	heap->head = NULL;
+	heap->tail = NULL;
+	heap->total = 0;
+	heap->oflow = NULL;
+	heap->collecting_minor = 0;
+	heap->scan_segment = NULL;
+	heap->scan = 0;
+	return 1;
+}
+
+void Heap_CollectExtension(void **referer, unsigned int size, void *userp);
+static void collect_reference(Object **referer, void *userp);
+static void copy_extension(Heap *heap, void **referer, unsigned int size);
+
+static void collect_children(Heap *heap, Object *obj)
+{
+	// Collect all of the references to
+	// extensions allocate using the GC'd
+	// heap.
+	Object_WalkExtensions(obj, Heap_CollectExtension, heap);
+
+	// Now collect all of the children.
+	Object_WalkReferences(obj, collect_reference, heap);
+}
+
+static Object *next_moved(Heap *heap)
+{
+	// The objects and extensions that were moved 
+	// are at the end of the old generation, from
+	// the offset [heap->scan] of the segment
+	// [heap->scan_segment]. This returns the next
+	// object from there, skipping extensions.
+
+	while(1)
+	{
+		if(heap->scan_segment == NULL)
+		{
+			heap->scan_segment = heap->head;
+			heap->scan = 0;
+
+			if(heap->scan_segment == NULL)
+				return NULL;
+		}
+
+		// Allocations are aligned to 8 bytes.
+		if(heap->scan & 7)
+			heap->scan = (heap->scan & ~7) + 8;
+
+		if(heap->scan >= heap->scan_segment->used)
+		{
+			if(heap->scan_segment->next == NULL)
+				return NULL;
+
+			heap->scan_segment = heap->scan_segment->next;
+			heap->scan = 0;
+			continue;
+		}
+
+		void *addr = heap->scan_segment->body + heap->scan;
+
+		ExtensionHeader header = *(ExtensionHeader*) addr;
+
+		if(header.mark == EXTENSION_MARK)
+		{
+			// It's an extension. There's nothing
+			// to do other than skipping it.
+			heap->scan += sizeof(ExtensionHeader) + header.size;
+			continue;
+		}
+
+		Object *obj = addr;
+		heap->scan += get_object_size(obj);
+		return obj;
+	}
+}
+
+static void scan_moved(Heap *heap)
+{
+	// Collecting the children of the moved objects
+	// moves more of them, which appends them to the
+	// old generation.
+
+	Object *obj;
+
+	while(!heap->collection_failed && (obj = next_moved(heap)) != NULL)
+		collect_children(heap, obj);
+}
+
+static long long int elapsed_usecs(struct timespec *start)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static Replica *find_replica(Replica *table, int capacity, Object *original)
+{
+	assert(capacity > 0);
+
+	// Fibonacci hashing. The high bits of the product
+	// depend on all of the bits of the address.
+	unsigned int mask = capacity - 1;
+	unsigned int i = ((((uint64_t) original >> 3) * 11400714819323198485ull) >> 32) & mask;
+
+	while(table[i].original != NULL && table[i].original != original)
+		i = (i + 1) & mask;
+
+	return &table[i];
+}
+
+static _Bool resize_replica_table(Heap *heap, int new_capacity)
+{
+	assert(new_capacity > heap->replicas_capacity);
+
+	Replica *new_table = calloc(new_capacity, sizeof(Replica));
+
+	if(new_table == NULL)
+		return 0;
+
+	for(int i = 0; i < heap->replicas_capacity; i += 1)
+		if(heap->replicas[i].original != NULL)
+			*find_replica(new_table, new_capacity, heap->replicas[i].original) = heap->replicas[i];
+
+	free(heap->replicas);
+	heap->replicas = new_table;
+	heap->replicas_capacity = new_capacity;
+	return 1;
+}
+
+static _Bool grow_replica_table(Heap *heap)
+{
+	return resize_replica_table(heap, heap->replicas_capacity == 0 ? 1024 : 2 * heap->replicas_capacity);
+}
+
+static _Bool push_object(Object ***array, int *size, int *used, Object *obj)
+{
+	if(*used == *size)
+	{
+		int new_size = *size == 0 ? 64 : 2 * *size;
+
+		void *temp = realloc(*array, new_size * sizeof(Object*));
+
+		if(temp == NULL)
+			return 0;
+
+		*array = temp;
+		*size = new_size;
+	}
+
+	(*array)[(*used)++] = obj;
+	return 1;
+}
+
+static void mark_dirty(Heap *heap, Object *obj)
+{
+	if(heap->replicas_count == 0)
+		return;
+
+	Replica *replica = find_replica(heap->replicas, heap->replicas_capacity, obj);
+
+	if(replica->original == NULL || (replica->copy->flags & Object_DIRTY))
+		return;
+
+	replica->copy->flags |= Object_DIRTY;
+
+	// If the copy can't be listed, the final pause
+	// looks for the dirty copies in the whole table.
+	if(!push_object(&heap->incr_dirty, &heap->incr_dirty_size, &heap->incr_dirty_used, obj))
+		heap->incr_dirty_lost = 1;
+}
+
+/* Symbol: next_dirty
+ *
+ *   Iterates over the dirty copies, starting from the 
+ *   [*i]-th. Once it's done, it returns NULL.
+ */
+static Replica *next_dirty(Heap *heap, int *i)
+{
+	if(heap->incr_dirty_lost)
+	{
+		while(*i < heap->replicas_capacity)
+		{
+			Replica *replica = &heap->replicas[(*i)++];
+
+			if(replica->original != NULL && (replica->copy->flags & Object_DIRTY))
+				return replica;
+		}
+	}
+	else
+	{
+		// The same object may be listed more than
+		// once, but it's dirty only the first time.
+		while(*i < heap->incr_dirty_used)
+		{
+			Replica *replica = find_replica(heap->replicas, heap->replicas_capacity, heap->incr_dirty[(*i)++]);
+
+			if(replica->copy->flags & Object_DIRTY)
+				return replica;
+		}
+	}
+	return NULL;
+}
+
+/* Symbol: find_copy
+ *
+ *   Returns the copy of an object made by the incremental
+ *   collection that is being completed or NULL.
+ */
+static Object *find_copy(Heap *heap, Object *obj)
+{
+	if(!heap->incr_finishing || heap->replicas_capacity == 0)
+		return NULL;
+
+	Replica *replica = find_replica(heap->replicas, heap->replicas_capacity, obj);
+
+	return replica->original == obj ? replica->copy : NULL;
+}
+
+static void add_incremental_root(Heap *heap, Object *obj)
+{
+	// The roots are given again to the final
+	// pause, so losing some is only slower.
+	push_object(&heap->incr_roots, &heap->incr_roots_size, &heap->incr_roots_used, obj);
+}
+
+/* Symbol: swap_spaces
+ *
+ *   Swaps the old generation with the segments the
+ *   incremental collection copies objects into, so
+ *   that [bump_malloc] and [next_moved] work on them.
+ */
+static void swap_spaces(Heap *heap)
+{
+	Segment *head = heap->head;
+	Segment *tail = heap->tail;
+	Segment *scan_segment = heap->scan_segment;
+	int total = heap->total;
+	int scan  = heap->scan;
+
+	heap->head = heap->incr_head;
+	heap->tail = heap->incr_tail;
+	heap->scan_segment = heap->incr_scan_segment;
+	heap->total = heap->incr_total;
+	heap->scan  = heap->incr_scan;
+
+	heap->incr_head = head;
+	heap->incr_tail = tail;
+	heap->incr_scan_segment = scan_segment;
+	heap->incr_total = total;
+	heap->incr_scan  = scan;
+}
+
+static Object *replicate(Heap *heap, Object *original)
+{
+	if(original == NULL || (original->flags & Object_STATIC))
+		return original;
+
+	// Only old objects are copied. Old objects only 
+	// refer to young ones if they're in the remembered
+	// set, which makes their copies dirty.
+	if(is_young(heap, original))
+		return original;
+
+	if(4 * (heap->replicas_count + 1) > 3 * heap->replicas_capacity)
+		if(!grow_replica_table(heap))
+		{
+			Error_Report(heap->error, 1, "No memory");
+			heap->collection_failed = 1;
+			return original;
+		}
+
+	Replica *replica = find_replica(heap->replicas, heap->replicas_capacity, original);
+
+	if(replica->original != NULL)
+		return replica->copy;
+
+	int size = get_object_size(original);
+
+	Object *copy = bump_malloc(heap, size, heap->error);
+
+	if(copy == NULL)
+	{
+		heap->collection_failed = 1;
+		return original;
+	}
+
+	memcpy(copy, original, size);
+	copy->flags &= ~(Object_REMEMBERED | Object_SCANNED | Object_DIRTY);
+
+	*replica = (Replica) { .original = original, .copy = copy };
+	heap->replicas_count += 1;
+	return copy;
+}
+
+static void replicate_reference(Object **referer, void *userp)
+{
+	Heap *heap = userp;
+
+	if(!heap->collection_failed)
+		*referer = replicate(heap, *referer);
+}
+
+static void replicate_extension(void **referer, unsigned int size, void *userp)
+{
+	Heap *heap = userp;
+
+	void *old_location = *referer;
+
+	if(heap->collection_failed || old_location == NULL)
+		return;
+
+	if(size < LARGE_OBJECT_THRESHOLD)
+	{
+		copy_extension(heap, referer, size);
+		return;
+	}
+
+	// Large allocations are copied too, or the program
+	// could change them through the originals.
+	void *new_location = large_malloc(heap, size, 0, heap->error);
+
+	if(new_location == NULL)
+	{
+		heap->collection_failed = 1;
+		return;
+	}
+
+	memcpy(new_location, old_location, size);
+
+	*referer = new_location;
+}
+
+static void free_large_copy(void **referer, unsigned int size, void *userp)
+{
+	if(*referer != NULL && size >= LARGE_OBJECT_THRESHOLD)
+		remove_large_object(userp, *referer);
+}
+
+static void find_large_extension(void **referer, unsigned int size, void *userp)
+{
+	(void) referer;
+
+	if(size >= LARGE_OBJECT_THRESHOLD)
+		*(_Bool*) userp = 1;
+}
+
+static void list_reference(Object **referer, void *userp)
+{
+	Heap *heap = userp;
+
+	if(heap->collection_failed)
+		return;
+
+	if(heap->incr_refs_used == heap->incr_refs_size)
+	{
+		int new_size = heap->incr_refs_size == 0 ? 64 : 2 * heap->incr_refs_size;
+
+		void *temp = realloc(heap->incr_refs, new_size * sizeof(Object**));
+
+		if(temp == NULL)
+		{
+			Error_Report(heap->error, 1, "No memory");
+			heap->collection_failed = 1;
+			return;
+		}
+
+		heap->incr_refs = temp;
+		heap->incr_refs_size = new_size;
+	}
+
+	heap->incr_refs[heap->incr_refs_used++] = referer;
+}
+
+/* Symbol: scan_copy
+ *
+ *   Copies at most [SCAN_CHUNK] references of a copy, 
+ *   starting from the [start]-th one. The first chunk
+ *   also copies the extensions and lists the references,
+ *   so that the next chunks don't need to walk the whole
+ *   object again. There can only be one partially scanned
+ *   copy at a time.
+ *
+ * Returns:
+ *   The index of the next reference to be copied or 0
+ *   if there are none left.
+ */
+static int scan_copy(Heap *heap, Object *copy, int start)
+{
+	if(start == 0)
+	{
+		Object_WalkExtensions(copy, replicate_extension, heap);
+
+		copy->flags |= Object_SCANNED;
+
+		heap->incr_refs_used = 0;
+		Object_WalkReferences(copy, list_reference, heap);
+	}
+
+	int end = start + SCAN_CHUNK;
+
+	if(end > heap->incr_refs_used)
+		end = heap->incr_refs_used;
+
+	for(int i = start; i < end; i += 1)
+		replicate_reference(heap->incr_refs[i], heap);
+
+	if(end < heap->incr_refs_used)
+		return end;
+
+	return 0;
+}
+
+static void start_scan(Heap *heap, Object *copy)
+{
+	int next = scan_copy(heap, copy, 0);
+
+	if(next > 0)
+	{
+		heap->incr_partial = copy;
+		heap->incr_partial_index = next;
+	}
+}
+
+/* Symbol: update_copy
+ *
+ *   Copies the original of a dirty copy again. If the
+ *   copy was scanned, its references must be copied
+ *   again too by the caller.
+ */
+static void update_copy(Heap *heap, Replica *replica)
+{
+	Object *copy = replica->copy;
+
+	// The large extensions of the copies that were 
+	// scanned are copies too, and they're replaced.
+	if(copy->flags & Object_SCANNED)
+		Object_WalkExtensions(copy, free_large_copy, heap);
+
+	memcpy(copy, replica->original, get_object_size(replica->original));
+	copy->flags &= ~(Object_REMEMBERED | Object_SCANNED | Object_DIRTY);
+}
+
+/* Symbol: replicate_slice
+ *
+ *   Does some of the work of the incremental collection.
+ *   The objects reachable from the roots given to the
+ *   collections are copied and the dirty copies are
+ *   updated until the pause is [budget] microseconds
+ *   long and at least [min_copy] bytes were copied. If 
+ *   [budget] is negative, it does all of the work.
+ */
+static void replicate_slice(Heap *heap, long long int budget, int min_copy)
+{
+	swap_spaces(heap);
+
+	int start_total = heap->total;
+
+	for(int i = 0; i < heap->incr_roots_used; i += 1)
+		replicate(heap, heap->incr_roots[i]);
+	heap->incr_roots_used = 0;
+
+	int count = 0;
+
+	while(!heap->collection_failed)
+	{
+		Object *copy;
+
+		if(heap->incr_partial != NULL)
+		{
+			// Go on with the scan of a big object.
+			copy = heap->incr_partial;
+			heap->incr_partial_index = scan_copy(heap, copy, heap->incr_partial_index);
+
+			if(heap->incr_partial_index == 0)
+				heap->incr_partial = NULL;
+		}
+
+		// The final pause updates the dirty copies 
+		// on its own.
+		else if(budget >= 0 && heap->incr_dirty_used > heap->incr_dirty_deferred)
+		{
+			Object *original = heap->incr_dirty[--heap->incr_dirty_used];
+			Replica *replica = find_replica(heap->replicas, heap->replicas_capacity, original);
+
+			assert(replica->original == original);
+
+			copy = replica->copy;
+
+			if(!(copy->flags & Object_DIRTY))
+				continue;
+			
+			_Bool scanned = copy->flags & Object_SCANNED;
+			_Bool large = 0;
+
+			// Copies with large extensions are left to
+			// the final pause, or a big container that
+			// changes often would be copied over and
+			// over again.
+			Object_WalkExtensions(original, find_large_extension, &large);
+
+			if(scanned && (large || copy == heap->incr_partial))
+			{
+				// The deferred copies are kept at the 
+				// bottom of the list.
+				heap->incr_dirty[heap->incr_dirty_used++] = heap->incr_dirty[heap->incr_dirty_deferred];
+				heap->incr_dirty[heap->incr_dirty_deferred++] = original;
+				continue;
+			}
+
+			update_copy(heap, replica);
+
+			// If it wasn't scanned, it will be.
+			if(scanned)
+				start_scan(heap, copy);
+		}
+		else if((copy = next_moved(heap)) != NULL)
+			start_scan(heap, copy);
+		else
+		{
+			if(heap->incr_dirty_used == heap->incr_dirty_deferred)
+				heap->incr_scanned = 1;
+			break;
+		}
+
+		// Checking the time for every object would
+		// be too slow. The minimum amount of work
+		// is so that the collection doesn't fall
+		// behind the minor collections.
+		count += 1;
+		if(budget >= 0 && (count % 64 == 0 || heap->incr_partial != NULL) 
+		   && heap->total - start_total >= min_copy 
+		   && elapsed_usecs(&heap->pause_start) >= budget)
+			break;
+	}
+
+	swap_spaces(heap);
+}
+
+/* Symbol: begin_final_pause
+ *
+ *   Turns the collection into a major collection that
+ *   completes the incremental one. All of the remaining
+ *   objects are copied, the copies of the objects that
+ *   changed since they were copied are updated. Then the
+ *   collection continues as a normal major collection,
+ *   which moves the objects that weren't copied yet and
+ *   replaces the references to the originals with ones
+ *   to their copies. See [find_copy].
+ */
+static void begin_final_pause(Heap *heap)
+{
+	heap->collecting_minor = 0;
+
+	replicate_slice(heap, -1, 0);
+
+	// The objects in the remembered set changed
+	// after the last minor collection.
+	for(int i = 0; i < heap->remset_used; i += 1)
+		mark_dirty(heap, heap->remset[i]);
+
+	// The contents of the originals are copied again.
+	// Their references are collected by [rescan_dirty],
+	// so the copies are left dirty.
+	Replica *replica;
+	int i = 0;
+
+	while((replica = next_dirty(heap, &i)) != NULL)
+	{
+		update_copy(heap, replica);
+		replica->copy->flags |= Object_DIRTY;
+	}
+
+	heap->old_head = heap->head;
+	heap->old_oflow = heap->oflow;
+	heap->head = heap->incr_head;
+	heap->tail = heap->incr_tail;
+	heap->total = heap->incr_total;
+	heap->oflow = NULL;
+	heap->incr_head = NULL;
+	heap->incr_tail = NULL;
+	heap->incr_total = 0;
+
+	// The scan starts after the copies.
+	heap->scan_segment = heap->tail;
+	heap->scan = heap->tail ? heap->tail->used : 0;
+
+	heap->movedcount = heap->replicas_count;
+	heap->incr_finishing = 1;
+}
+
+static void rescan_dirty(Heap *heap)
+{
+	Replica *replica;
+	int i = 0;
+
+	while((replica = next_dirty(heap, &i)) != NULL)
+	{
+		replica->copy->flags &= ~Object_DIRTY;
+		collect_children(heap, replica->copy);
+	}
+}
+
+static void end_incremental(Heap *heap)
+{
+	free(heap->replicas);
+	heap->replicas = NULL;
+	heap->replicas_capacity = 0;
+	heap->replicas_count = 0;
+	heap->incr_roots_used = 0;
+	heap->incr_dirty_used = 0;
+	heap->incr_dirty_deferred = 0;
+	heap->incr_dirty_lost = 0;
+	heap->incr_scan_segment = NULL;
+	heap->incr_scan = 0;
+	heap->incr_partial = NULL;
+	heap->incr_active = 0;
+
+	free(heap->incr_refs);
+	heap->incr_refs = NULL;
+	heap->incr_refs_size = 0;
+	heap->incr_refs_used = 0;
+	heap->incr_finishing = 0;
+	heap->incr_scanned = 0;
+}
+
+static void collect_remembered(Heap *heap)
+{
+	for(int i = 0; i < heap->remset_used; i += 1)
+	{
+		Object *obj = heap->remset[i];
+
+		// The old object may refer to extensions
+		// that were reallocated in the nursery, 
+		// other than to young objects.
+		Object_WalkExtensions(obj, Heap_CollectExtension, heap);
+		Object_WalkReferences(obj, collect_reference, heap);
+
+		obj->flags &= ~Object_REMEMBERED;
+
+		// If the incremental collection already copied
+		// the object, the copy is out of date.
+		if(heap->incr_active)
+			mark_dirty(heap, obj);
+	}
+
+	heap->remset_used = 0;
+}
+
+/* Symbol: Worker
+ *
+ *   The state of a thread of a parallel collection.
+ *   Each thread copies objects into its own buffer
+ *   of the old generation (its "PLAB"), so that it
+ *   doesn't need to take the heap's lock for every
+ *   object. The objects it copied and that still
+ *   need to be scanned are pushed at the bottom of
+ *   its deque. Other threads that run out of work
+ *   steal from the top of it.
+ */
+struct Worker {
+	Heap *heap;
+	char *plab, *plab_end;
+	int   movedcount;
+	long  top, bottom;
+	Object *deque[DEQUE_SIZE];
+};
+
+static _Bool collection_failed(Heap *heap)
+{
+	return __atomic_load_n(&heap->collection_failed, __ATOMIC_RELAXED);
+}
+
+static void *plab_malloc(Worker *worker, int size)
+{
+	Heap *heap = worker->heap;
+
+	uintptr_t cur = ((uintptr_t) worker->plab + 7) & ~(uintptr_t) 7;
+
+	if(worker->plab != NULL && cur + size <= (uintptr_t) worker->plab_end)
+	{
+		worker->plab = (char*) cur + size;
+		return (void*) cur;
+	}
+
+	void *addr = NULL;
+
+	pthread_mutex_lock(&heap->lock);
+
+	// Only the first failure is reported.
+	if(!heap->collection_failed)
+	{
+		int plab_size = PLAB_SIZE;
+
+		// Near the maximum size of the heap, the
+		// PLAB would make the collection fail.
+		if(heap->max_size > 0 && heap->total + plab_size > heap->max_size)
+			plab_size = size;
+
+		if(size > PLAB_SIZE / 4)
+
+			// Big objects would waste most of
+			// the PLAB, so they're allocated
+			// on their own.
+			addr = bump_malloc(heap, size, heap->error);
+
+		else
+		{
+			char *plab = bump_malloc(heap, plab_size, heap->error);
+
+			if(plab != NULL)
+			{
+				// The unused part of the previous
+				// PLAB is not counted as used.
+				if(worker->plab != NULL && worker->plab < worker->plab_end)
+					heap->total -= worker->plab_end - worker->plab;
+
+				worker->plab = plab + size;
+				worker->plab_end = plab + plab_size;
+				addr = plab;
+			}
+		}
+
+		if(addr == NULL)
+			__atomic_store_n(&heap->collection_failed, 1, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&heap->lock);
+	return addr;
+}
+
+static void push_overflow(Heap *heap, Object *obj)
+{
+	pthread_mutex_lock(&heap->lock);
+
+	if(heap->overflow_used == heap->overflow_size)
+	{
+		int new_size = heap->overflow_size == 0 ? 1024 : 2 * heap->overflow_size;
+
+		void *temp = realloc(heap->overflow, new_size * sizeof(Object*));
+
+		if(temp == NULL)
+		{
+			if(!heap->collection_failed)
+				Error_Report(heap->error, 1, "No memory");
+			__atomic_store_n(&heap->collection_failed, 1, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&heap->lock);
+			return;
+		}
+
+		heap->overflow = temp;
+		heap->overflow_size = new_size;
+	}
+
+	// The count is also read without the lock
+	// by the threads looking for work.
+	heap->overflow[heap->overflow_used] = obj;
+	__atomic_store_n(&heap->overflow_used, heap->overflow_used + 1, __ATOMIC_RELEASE);
+
+	pthread_mutex_unlock(&heap->lock);
+}
+
+static Object *pop_overflow(Heap *heap)
+{
+	Object *obj = NULL;
+
+	if(__atomic_load_n(&heap->overflow_used, __ATOMIC_ACQUIRE) == 0)
+		return NULL;
+
+	pthread_mutex_lock(&heap->lock);
+
+	if(heap->overflow_used > 0)
+	{
+		obj = heap->overflow[heap->overflow_used - 1];
+		__atomic_store_n(&heap->overflow_used, heap->overflow_used - 1, __ATOMIC_RELEASE);
+	}
+
+	pthread_mutex_unlock(&heap->lock);
+	return obj;
+}
+
+// The deques are the ones described by Chase and Lev 
+// in "Dynamic Circular Work-Stealing Deque", but they
+// don't grow. When a deque is full, the work goes to
+// the overflow stack of the heap.
+
+static void push_work(Worker *worker, Object *obj)
+{
+	long b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED);
+	long t = __atomic_load_n(&worker->top,    __ATOMIC_ACQUIRE);
+
+	if(b - t >= DEQUE_SIZE)
+	{
+		push_overflow(worker->heap, obj);
+		return;
+	}
+
+	__atomic_store_n(&worker->deque[b & (DEQUE_SIZE - 1)], obj, __ATOMIC_RELAXED);
+	__atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELEASE);
+}
+
+static Object *pop_work(Worker *worker)
+{
+	long b = __atomic_load_n(&worker->bottom, __ATOMIC_RELAXED) - 1;
+	__atomic_store_n(&worker->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long t = __atomic_load_n(&worker->top, __ATOMIC_RELAXED);
+
+	if(t > b)
+	{
+		// It's empty.
+		__atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+
+	Object *obj = __atomic_load_n(&worker->deque[b & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+
+	if(t == b)
+	{
+		// It's the last item, so a thief 
+		// may be taking it too.
+		if(!__atomic_compare_exchange_n(&worker->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			obj = NULL;
+		__atomic_store_n(&worker->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+
+	return obj;
+}
+
+static Object *steal_work(Worker *victim)
+{
+	long t = __atomic_load_n(&victim->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long b = __atomic_load_n(&victim->bottom, __ATOMIC_ACQUIRE);
+
+	if(t >= b)
+		return NULL;
+
+	Object *obj = __atomic_load_n(&victim->deque[t & (DEQUE_SIZE - 1)], __ATOMIC_RELAXED);
+
+	if(!__atomic_compare_exchange_n(&victim->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+
+	return obj;
+}
+
+static _Bool has_work(Worker *worker)
+{
+	return __atomic_load_n(&worker->bottom, __ATOMIC_ACQUIRE) 
+	     > __atomic_load_n(&worker->top,    __ATOMIC_ACQUIRE);
+}
+
+static void par_collect_extension(void **referer, unsigned int size, void *userp)
+{
+	Worker *worker = userp;
+	Heap   *heap   = worker->heap;
+
+	void *old_location = *referer;
+
+	if(old_location == NULL || collection_failed(heap))
+		return;
+
+	if(size >= LARGE_OBJECT_THRESHOLD)
+	{
+		LargeObject *large = find_large_object(heap->los, heap->los_capacity, old_location);
+		assert(large->addr == old_location);
+		__atomic_store_n(&large->marked, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	// Extensions have only one owner, so no
+	// other thread is copying this one.
+	ExtensionHeader *header = plab_malloc(worker, sizeof(ExtensionHeader) + size);
 
-	if(heap == NULL)
-		return NULL;
+	if(header == NULL)
+		return;
 
-	heap->objcount = 0;
-	heap->total = 0;
-	heap->size = size;
-	heap->used = 0;
-	heap->body = malloc(size);
-	heap->pend = NULL;
-	heap->pend_size = 0;
-	heap->pend_used = 0;
-	heap->oflow = 0;
-	heap->collecting = 0;
+	*header = (ExtensionHeader) { .mark = EXTENSION_MARK, .size = size };
 
-	if(heap->body == NULL)
-	{
-		free(heap);
-		return NULL;
-	}
+	void *new_location = header + 1;
 
-#if USING_VALGRIND
-	VALGRIND_CREATE_MEMPOOL(heap, 0, 0);
-#endif
+	memcpy(new_location, old_location, size);
 
-	return heap;
+	*referer = new_location;
 }
 
-void Heap_Free(Heap *heap)
+static void par_collect_reference(Object **referer, void *userp)
 {
+	Worker *worker = userp;
+	Heap   *heap   = worker->heap;
 
-#if USING_VALGRIND
-	VALGRIND_DESTROY_MEMPOOL(heap);
-#endif
+	Object *old_location = *referer;
 
-	Error error;
-	Error_Init(&error);
+	if(old_location == NULL || collection_failed(heap))
+		return;
 
-	for(int i = 0; i < heap->pend_used; i += 1)
+	unsigned int flags = __atomic_load_n(&old_location->flags, __ATOMIC_ACQUIRE);
+
+	if(flags & Object_STATIC)
+		return;
+
+	Object *copy = find_copy(heap, old_location);
+
+	if(copy != NULL)
 	{
-		heap->pend[i].destructor(heap->pend[i].object, &error);
-		if(error.occurred)
+		*referer = copy;
+		return;
+	}
+
+	// The thread that sets the busy flag is the one
+	// that copies the object. The others wait for it
+	// to set the moved flag.
+	while(1)
+	{
+		if(flags & Object_MOVED)
 		{
-			// Errors occurred! We can't do anything about
-			// it now though.
-			Error_Free(&error);
-			Error_Init(&error);
+			*referer = ((MovedObject*) old_location)->new_location;
+			return;
 		}
+
+		if(flags & Object_BUSY)
+			flags = __atomic_load_n(&old_location->flags, __ATOMIC_ACQUIRE);
+		
+		else if(__atomic_compare_exchange_n(&old_location->flags, &flags, flags | Object_BUSY, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+			break;
 	}
 
-	while(heap->oflow)
+	int size = get_object_size(old_location);
+
+	Object *new_location = plab_malloc(worker, size);
+
+	if(new_location == NULL)
+
+		// The collection failed, but the object must
+		// still be marked as moved or the threads
+		// waiting for it would never stop.
+		new_location = old_location;
+
+	else
 	{
-		OflowAlloc *prev = heap->oflow->prev;
-		free(heap->oflow);
-		heap->oflow = prev;
+		memcpy(new_location, old_location, size);
+		new_location->flags = flags & ~Object_REMEMBERED;
+		worker->movedcount += 1;
 	}
 
-	free(heap->pend);
-	free(heap->body);
-	free(heap);
-}
+	((MovedObject*) old_location)->new_location = new_location;
+	__atomic_store_n(&old_location->flags, flags | Object_MOVED, __ATOMIC_RELEASE);
 
-void *Heap_GetPointer(Heap *heap)
-{
-	return heap->body;
+	if(new_location != old_location)
+		push_work(worker, new_location);
+
+	*referer = new_location;
 }
 
-unsigned int Heap_GetSize(Heap *heap)
+static void par_collect_children(Worker *worker, Object *obj)
 {
-	return heap->size;
+	Object_WalkExtensions(obj, par_collect_extension, worker);
+	Object_WalkReferences(obj, par_collect_reference, worker);
 }
 
-unsigned int Heap_GetObjectCount(Heap *heap)
+static Object *find_work(Worker *worker)
 {
-	return heap->objcount;
+	Heap *heap = worker->heap;
+
+	Object *obj = pop_work(worker);
+
+	if(obj != NULL)
+		return obj;
+
+	int index = worker - heap->workers;
+
+	for(int i = 1; i < heap->nworkers; i += 1)
+	{
+		obj = steal_work(&heap->workers[(index + i) % heap->nworkers]);
+
+		if(obj != NULL)
+			return obj;
+	}
+
+	return pop_overflow(heap);
 }
 
-float Heap_GetUsagePercentage(Heap *heap)
+static _Bool work_available(Heap *heap)
 {
-	return 100.0 * heap->total / heap->size;
+	if(__atomic_load_n(&heap->overflow_used, __ATOMIC_ACQUIRE) > 0)
+		return 1;
+
+	for(int i = 0; i < heap->nworkers; i += 1)
+		if(has_work(&heap->workers[i]))
+			return 1;
+
+	return 0;
 }
 
-void *Heap_Malloc(Heap *heap, TypeObject *type, Error *err)
+static void *run_worker(void *userp)
 {
-	_Bool requires_destruct = type->free != NULL;
+	Worker *worker = userp;
+	Heap   *heap   = worker->heap;
 
-	if(requires_destruct)
+	while(1)
 	{
-		// This type of object requires
-		// a destructor to be called.
-		if(heap->pend == NULL)
-		{
-			int n = 8;
+		Object *obj;
 
-			heap->pend = malloc(n * sizeof(PendingDestruct));
-				
-			if(heap->pend == NULL)
-			{
-				Error_Report(err, 1, "No memory");
-				return NULL;
-			}
+		while((obj = find_work(worker)) != NULL)
+			par_collect_children(worker, obj);
 
-			heap->pend_used = 0;
-			heap->pend_size = n;
-		}
-		else if(heap->pend_size == heap->pend_used)
-		{
-			int factor = 2;
+		// A thread only pushes work while it's not
+		// idle and it becomes idle when its deque
+		// is empty, so when all threads are idle
+		// the collection is over.
+		__atomic_fetch_add(&heap->idle, 1, __ATOMIC_SEQ_CST);
 
-			void *new_pend = realloc(heap->pend, factor * heap->pend_size * sizeof(PendingDestruct));
+		while(1)
+		{
+			if(__atomic_load_n(&heap->idle, __ATOMIC_SEQ_CST) == heap->nworkers)
+				return NULL;
 
-			if(new_pend == NULL)
+			if(work_available(heap))
 			{
-				Error_Report(err, 1, "No memory");
-				return NULL;
+				__atomic_fetch_sub(&heap->idle, 1, __ATOMIC_SEQ_CST);
+				break;
 			}
 
-			heap->pend = new_pend;
-			heap->pend_size *= factor;
+			sched_yield();
 		}
+	}
+}
 
-		assert(heap->pend_size > heap->pend_used);
+/* Symbol: parallel_scan
+ *
+ *   Does the work of [scan_moved] with the collector
+ *   threads. The roots were already moved by the
+ *   calling thread, so they're divided between the
+ *   deques of the threads before they're started.
+ *
+ * Returns:
+ *   0 if the threads couldn't be allocated, in which
+ *   case nothing was done, 1 otherwise.
+ */
+static _Bool parallel_scan(Heap *heap)
+{
+	Worker *workers = malloc(heap->threads * sizeof(Worker));
+
+	if(workers == NULL)
+		return 0;
+
+	for(int i = 0; i < heap->threads; i += 1)
+	{
+		workers[i].heap = heap;
+		workers[i].plab = NULL;
+		workers[i].plab_end = NULL;
+		workers[i].movedcount = 0;
+		workers[i].top = 0;
+		workers[i].bottom = 0;
 	}
 
-	int size = type->size;
+	heap->workers = workers;
+	heap->nworkers = heap->threads;
+	heap->idle = 0;
 
-	if(size < (int) sizeof(MovedObject))
-		size = sizeof(MovedObject);
+	{
+		Object *obj;
+		int i = 0;
+
+		while((obj = next_moved(heap)) != NULL)
+		{
+			push_work(&workers[i], obj);
+			i = (i + 1) % heap->nworkers;
+		}
+	}
 
-	void *addr = Heap_RawMalloc(heap, type->size, err);
+	// The calling thread is the first worker.
+	pthread_t threads[MAX_COLLECTOR_THREADS];
+	int started = 1;
 
-	if(addr == NULL)
-		return NULL;
+	while(started < heap->threads)
+	{
+		if(pthread_create(&threads[started], NULL, run_worker, &workers[started]))
+			break;
+		started += 1;
+	}
 
-	Object *obj = addr;
+	if(started < heap->threads)
+	{
+		// The threads that couldn't be started
+		// are left out, but their work isn't.
+		for(int i = started; i < heap->threads; i += 1)
+		{
+			Object *obj;
+			while((obj = pop_work(&workers[i])) != NULL)
+				push_work(&workers[0], obj);
+		}
+		heap->nworkers = started;
+	}
 
-	obj->type = type;
-	obj->flags = 0;
+	run_worker(&workers[0]);
 
-	if(type->init && !type->init(obj, err))
-		return NULL;
+	for(int i = 1; i < started; i += 1)
+		pthread_join(threads[i], NULL);
 
-	obj->type = type;
-	obj->flags = 0;
+	for(int i = 0; i < heap->threads; i += 1)
+	{
+		if(workers[i].plab != NULL && workers[i].plab < workers[i].plab_end)
+			heap->total -= workers[i].plab_end - workers[i].plab;
 
-	if(requires_destruct)
-		heap->pend[heap->pend_used++] = (PendingDestruct) { .object = obj, .destructor = obj->type->free };
+		heap->movedcount += workers[i].movedcount;
+	}
 
-	heap->objcount += 1;
+	heap->workers = NULL;
+	heap->overflow_used = 0;
+	free(workers);
 
-	return (Object*) addr;
+	// The PLABs left holes in the segments, so 
+	// they can't be scanned again. Later scans 
+	// start after them.
+	heap->scan_segment = heap->tail;
+	heap->scan = heap->tail ? heap->tail->used : 0;
+	return 1;
 }
 
-void *Heap_RawMalloc(Heap *heap, int size, Error *err)
+/* Symbol: queue_dead_object
+ *
+ *   Copies a dead object with a destructor to the queue
+ *   of the ones to be destroyed. If the queue can't be
+ *   grown, the destructor is called right away.
+ *
+ * Returns:
+ *   0 if the destructor was called and it failed, 1
+ *   otherwise.
+ */
+static _Bool queue_dead_object(Heap *heap, PendingDestruct pending)
 {
-	assert(err);
-	assert(heap);
-	assert(size > -1);
-
-	void *addr;
+	int size = get_object_size(pending.object);
+	int entry_size = sizeof(DeadObject) + ((size + 7) & ~7);
 
-	int padding = heap->used;
+	if(heap->dead_used + entry_size > heap->dead_size)
+	{
+		int new_size = heap->dead_size == 0 ? 1024 : 2 * heap->dead_size;
 
-	if(heap->used & 7)
-		heap->used = (heap->used & ~7) + 8;
+		while(new_size < heap->dead_used + entry_size)
+			new_size *= 2;
 
-	padding = heap->used - padding;
+		void *temp = realloc(heap->dead, new_size);
 
-	if(heap->used + size > heap->size)
-	{
-		if(heap->collecting)
+		if(temp == NULL)
 		{
-			Error_Report(err, 1, "Out of heap");
-			return NULL;
+			pending.destructor(pending.object, heap->error);
+			return !heap->error->occurred;
 		}
 
-		OflowAlloc *oflow = malloc(sizeof(OflowAlloc) + size);
-
-		if(oflow == 0)
-			return 0;
+		heap->dead = temp;
+		heap->dead_size = new_size;
+	}
 
-		oflow->prev = heap->oflow;
-		heap->oflow = oflow;
+	DeadObject *dead = (DeadObject*) (heap->dead + heap->dead_used);
+	dead->destructor = pending.destructor;
+	dead->size = entry_size - sizeof(DeadObject);
+	memcpy(dead + 1, pending.object, size);
 
-		addr = oflow->body;
-	}
-	else
-	{
-		assert(heap->used + size <= heap->size);
-		addr = heap->body + heap->used;
-		heap->used += size;
-	}
+	heap->dead_used += entry_size;
+	return 1;
+}
 
-	heap->total += size + padding;
+/* Symbol: Heap_RunDestructors
+ *
+ *   Calls the destructors of the objects that the last
+ *   collections found dead. The destructors get a copy
+ *   of the object, so they must only release resources
+ *   that aren't managed by the heap. It's meant to be
+ *   called after each collection.
+ *
+ * Returns:
+ *   0 if a destructor failed, 1 otherwise. The queue 
+ *   only holds the objects that weren't destroyed yet.
+ */
+_Bool Heap_RunDestructors(Heap *heap, Error *error)
+{
+	int offset = 0;
 
-	assert(((intptr_t) addr) % 8 == 0);
+	while(offset < heap->dead_used)
+	{
+		DeadObject *dead = (DeadObject*) (heap->dead + offset);
 
-#if USING_VALGRIND
-	VALGRIND_MEMPOOL_ALLOC(heap, addr, size);
-#endif
+		offset += sizeof(DeadObject) + dead->size;
 
-	return addr;
-}
+		dead->destructor((Object*) (dead + 1), error);
 
-_Bool Heap_StartCollection(Heap *heap, Error *error)
-{
-	assert(heap->collecting == 0);
+		if(error->occurred)
+		{
+			memmove(heap->dead, heap->dead + offset, heap->dead_used - offset);
+			heap->dead_used -= offset;
+			return 0;
+		}
+	}
 
-	void *new_body = malloc(heap->size);
+	heap->dead_used = 0;
 
-	if(new_body == NULL)
+	// A big queue isn't kept around.
+	if(heap->dead_size > DEAD_QUEUE_SIZE)
 	{
-		Error_Report(error, 1, "No memory");
-		return 0;
+		free(heap->dead);
+		heap->dead = NULL;
+		heap->dead_size = 0;
 	}
 
-	heap->old_body = heap->body;
-	heap->old_used = heap->used;
-	heap->old_total = heap->total;
-	heap->old_oflow = heap->oflow;
-	heap->total = 0;
-	heap->body = new_body;
-	heap->used = 0;
-	heap->oflow = NULL;
-	heap->collecting = 1;
-	heap->collection_failed = 0;
-	heap->movedcount = 0;
-	heap->error = error;
 	return 1;
 }
 
@@ -358,32 +2603,57 @@ _Bool Heap_StopCollection(Heap *heap)
 {
 	assert(heap->collecting == 1);
 
-	if(heap->collection_failed)
+	if(heap->collecting_minor)
+		collect_remembered(heap);
+	else if(heap->incr_finishing)
+		rescan_dirty(heap);
+
+	if(!heap->collecting_parallel || !parallel_scan(heap))
+		scan_moved(heap);
+
+	if(!heap->collecting_minor)
 	{
-		free(heap->old_body);
-		return 0;
+		// Every object was moved, so the objects
+		// the remembered set refers to are gone.
+		heap->remset_used = 0;
+		heap->remset_failed = 0;
 	}
 
+	if(heap->collection_failed)
+		return 0;
+
+	sweep_large_objects(heap, heap->collecting_minor);
+
 	/* Call destructors here */
 	{
-		int i = 0;
+		// Minor collections only look at the objects
+		// allocated after the previous one.
+		int i = heap->collecting_minor ? heap->pend_old : 0;
 	
 		while(i < heap->pend_used)
 		{
 			Object *obj = heap->pend[i].object;
 
-			if(obj->flags & Object_MOVED)
+			if(heap->collecting_minor && !is_young(heap, obj))
+			{
+				// Objects allocated outside of the
+				// nursery aren't affected by minor
+				// collections.
+				i += 1;
+			}
+			else if(obj->flags & Object_MOVED)
 			{
 				heap->pend[i].object = ((MovedObject*) heap->pend[i].object)->new_location;
 				i += 1;
 			}
+			else if(find_copy(heap, obj) != NULL)
+			{
+				heap->pend[i].object = find_copy(heap, obj);
+				i += 1;
+			}
 			else
 			{
-				// We need to call the destructor.
-
-				heap->pend[i].destructor(obj, heap->error);
-						
-				if(heap->error->occurred) 
+				if(!queue_dead_object(heap, heap->pend[i]))
 					return 0; // There will be leaks.
 				
 				heap->pend[i] = heap->pend[heap->pend_used-1];
@@ -391,6 +2661,8 @@ _Bool Heap_StopCollection(Heap *heap)
 			}
 		}
 
+		heap->pend_old = heap->pend_used;
+
 		if(heap->pend_size / 2 > heap->pend_used)
 		{
 			// Downsize
@@ -404,17 +2676,91 @@ _Bool Heap_StopCollection(Heap *heap)
 		}
 	}
 
-	while(heap->old_oflow)
+	if(heap->collecting_minor)
+		heap->objcount += heap->movedcount;
+	else
+	{
+		if(heap->old_oflow != NULL)
+		{
+			BPAlloc_Free(heap->old_oflow);
+			heap->old_oflow = NULL;
+		}
+
+		free_segments(heap, heap->old_head);
+		heap->old_head = NULL;
+
+		heap->objcount = heap->movedcount;
+
+		// Resize the old generation so that the
+		// live objects occupy the chosen part of it.
+		long long int limit = (long long int) heap->total * 100 / heap->occupancy;
+
+		if(limit < heap->min_size)
+			limit = heap->min_size;
+
+		if(heap->max_size > 0 && limit > heap->max_size)
+			limit = heap->max_size;
+
+		if(limit > INT_MAX)
+			limit = INT_MAX;
+
+		heap->limit = limit;
+
+		trim_free_segments(heap);
+
+		if(heap->incr_finishing)
+			end_incremental(heap);
+	}
+
+	// The nursery is empty now.
+	heap->young.used = 0;
+	heap->young.total = 0;
+	heap->young.objcount = 0;
+
+	if(heap->incr_starting)
 	{
-		OflowAlloc *prev = heap->old_oflow->prev;
-		free(heap->old_oflow);
-		heap->old_oflow = prev;
+		heap->incr_starting = 0;
+		heap->incr_active = 1;
+
+		// The table of the copies is made big enough
+		// for all of the objects, so that it rarely
+		// needs to grow.
+		int capacity = 1024;
+		while(capacity < 2 * heap->objcount)
+			capacity *= 2;
+
+		resize_replica_table(heap, capacity);
 	}
 
-	free(heap->old_body);
+	if(heap->incr_active)
+	{
+		// Now that there are no young objects, the
+		// incremental collection can go on using
+		// what's left of the pause budget.
+		heap->collecting_minor = 0;
+		// Twice as much as what was promoted is copied, so
+		// that the collection ends before the old generation
+		// grows too much, but big promotions would make the
+		// pause too long.
+		long long int min_copy = 2LL * (heap->total - heap->incr_start_total);
+
+		if(min_copy > heap->nursery_size)
+			min_copy = heap->nursery_size;
+
+		replicate_slice(heap, heap->pause_budget, min_copy);
+
+		if(heap->collection_failed)
+			return 0;
+	}
 
 	heap->collecting = 0;
-	heap->objcount = heap->movedcount;
+	update_fast_path(heap);
+
+	long long int pause = elapsed_usecs(&heap->pause_start);
+
+	if(pause > heap->max_pause)
+		heap->max_pause = pause > INT_MAX ? INT_MAX : pause;
+
 	return 1;
 }
 
@@ -430,95 +2776,146 @@ void Heap_CollectExtension(void **referer, unsigned int size, void *userp)
 	if(heap->collection_failed || old_location == NULL)
 		return;
 
-	void *new_location = Heap_RawMalloc(heap, size, heap->error);
+	if(size >= LARGE_OBJECT_THRESHOLD)
+	{
+		// It's in the large object space. It isn't
+		// moved, but it's marked so that it isn't
+		// freed.
+		LargeObject *large = find_large_object(heap->los, heap->los_capacity, old_location);
+		assert(large->addr == old_location);
+
+		// Minor collections don't mark old ones.
+		if(!heap->collecting_minor || large->young)
+			large->marked = 1;
+		return;
+	}
+
+	// Extensions of old objects are only
+	// moved by major collections.
+	if(heap->collecting_minor && !is_young(heap, old_location))
+		return;
 
-	if(new_location == NULL)
+	copy_extension(heap, referer, size);
+}
+
+static void copy_extension(Heap *heap, void **referer, unsigned int size)
+{
+	void *old_location = *referer;
+
+	ExtensionHeader *header = Heap_RawMalloc(heap, sizeof(ExtensionHeader) + size, heap->error);
+
+	if(header == NULL)
 	{
 		heap->collection_failed = 1;
 		return;
 	}
 
+	*header = (ExtensionHeader) { .mark = EXTENSION_MARK, .size = size };
+
+	void *new_location = header + 1;
+
 	memcpy(new_location, old_location, size);
 
 	*referer = new_location;
 }
 
+static void add_incremental_root(Heap *heap, Object *obj);
+
+/* Symbol: Heap_CollectReference
+ *
+ *   Moves the object referred by [referer], if it 
+ *   wasn't moved already, and updates the reference. 
+ *   It's used by the parent system to tell the heap
+ *   which are the roots of the object graph.
+ */
 void Heap_CollectReference(Object **referer, void *userp)
 {
 	Heap *heap = userp;
 
+	collect_reference(referer, heap);
+
+	// The incremental collection starts copying
+	// from the roots it's given.
+	if(heap->collecting_minor && (heap->incr_starting || heap->incr_active))
+		if(*referer != NULL && !is_young(heap, *referer))
+			add_incremental_root(heap, *referer);
+}
+
+static void collect_reference(Object **referer, void *userp)
+{
+	Heap *heap = userp;
+
 	assert(referer != NULL);
 	assert(heap->collecting);
 
 	Object *old_location = *referer;
+	Object *copy;
 
 	if(heap->collection_failed || old_location == NULL)
 		return;
 
+	// Minor collections don't follow the 
+	// references of old objects. The ones
+	// that refer to young objects are in 
+	// the remembered set.
+	if(heap->collecting_minor && !is_young(heap, old_location))
+		return;
+
 	if(old_location->flags & Object_MOVED)
 	
 		// The object was already moved.
 		*referer = ((MovedObject*) old_location)->new_location;
 
+	else if(old_location->flags & Object_STATIC)
+	
+		// The object doesn't need to be moved
+		// since it was statically allocated.
+		return;
+
+	else if((copy = find_copy(heap, old_location)) != NULL)
+
+		// The object was copied by the incremental
+		// collection.
+		*referer = copy;
+
 	else
 	{
-		Object *new_location;
-
 		// This object wasn't moved to
 		// the new heap yet.
 
-		if(old_location->flags & Object_STATIC)
-	
-			// The object doesn't need to be moved
-			// since it was statically allocated.
-			new_location = old_location;
-		else
-		{
-			// Get some information.
-			TypeObject *type = old_location->type;
-			int size         = type->size;
+		// Get some information.
+		int size = get_object_size(old_location);
 
-			// Copy the object to a new location.
-			{
-				new_location = Heap_RawMalloc(heap, size, heap->error);
+		// Copy the object to a new location. Its
+		// children are collected when the scan
+		// gets to it.
+		Object *new_location = Heap_RawMalloc(heap, size, heap->error);
 
-				if(new_location == NULL)
-				{
-					heap->collection_failed = 1;
-					return;
-				}
+		if(new_location == NULL)
+		{
+			heap->collection_failed = 1;
+			return;
+		}
 
-				memcpy(new_location, old_location, size);
-			}
+		memcpy(new_location, old_location, size);
 
-			// Set the old location as moved and
-			// leave the reference to the new
-			// location.
-			{
-				old_location->flags |= Object_MOVED;
+		// The remembered set is emptied
+		// by the collection.
+		new_location->flags &= ~Object_REMEMBERED;
 
-				assert((int) sizeof(MovedObject) <= size);
-				((MovedObject*) old_location)->new_location = new_location;
-			}
+		// Set the old location as moved and
+		// leave the reference to the new
+		// location.
+		{
+			old_location->flags |= Object_MOVED;
 
-			heap->movedcount += 1;
+			assert((int) sizeof(MovedObject) <= size);
+			((MovedObject*) old_location)->new_location = new_location;
 		}
 
-		// Collect the reference to the type.
-		if((Object*) new_location->type != new_location)
-			Heap_CollectReference((Object**) &new_location->type, heap);
-
-		// Collect all of the references to
-		// extensions allocate using the GC'd
-		// heap.
-		Object_WalkExtensions(new_location, 
-			Heap_CollectExtension, heap);
-
-		// Now collect all of the children.
-		Object_WalkReferences(new_location, 
-			Heap_CollectReference, heap);
+		heap->movedcount += 1;
 			
 		// Update the referer
 		*referer = new_location;
 	}
-}
\ No newline at end of file
+}
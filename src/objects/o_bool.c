@@ -38,8 +38,9 @@ static _Bool op_eql(Object *self, Object *other);
 static int hash(Object *self);
 static Object *copy(Object *self, Heap *heap, Error *err);
 
-static TypeObject t_bool = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_bool = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_BOOL,
 	.name = "bool",
 	.size = sizeof (Object),
 	.atomic = ATMTP_BOOL,
@@ -51,19 +52,19 @@ static TypeObject t_bool = {
 };
 
 static Object the_true_object = {
-	.type = &t_bool,
+	.type_index = TYPE_BOOL,
 	.flags = Object_STATIC,
 };
 
 static Object the_false_object = {
-	.type = &t_bool,
+	.type_index = TYPE_BOOL,
 	.flags = Object_STATIC,
 };
 
 static int hash(Object *self)
 {
 	assert(self != NULL);
-	assert(self->type == &t_bool);
+	assert(Object_TypeOf(self) == &t_bool);
 
 	if(self == &the_true_object)
 		return 1;
@@ -82,9 +83,9 @@ static Object *copy(Object *self, Heap *heap, Error *err)
 static _Bool op_eql(Object *self, Object *other)
 {
 	assert(self != NULL);
-	assert(self->type == &t_bool);
+	assert(Object_TypeOf(self) == &t_bool);
 	assert(other != NULL);
-	assert(other->type == &t_bool);
+	assert(Object_TypeOf(other) == &t_bool);
 
 	return self == other;
 }
@@ -108,7 +109,7 @@ static void print(Object *obj, FILE *fp)
 {
 	assert(fp != NULL);
 	assert(obj != NULL);
-	assert(obj->type == &t_bool);
+	assert(Object_TypeOf(obj) == &t_bool);
 
 	fprintf(fp, obj == &the_true_object ? "true" : "false");
 }
\ No newline at end of file
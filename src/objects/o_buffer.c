@@ -51,40 +51,42 @@ static Object *buffer_select(Object *self, Object *key, Heap *heap, Error *err);
 static _Bool   buffer_insert(Object *self, Object *key, Object *val, Heap *heap, Error *err);
 static int     buffer_count(Object *self);
 static void	   buffer_print(Object *obj, FILE *fp);
-static _Bool   buffer_free(Object *self, Error *error);
+static void    buffer_walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp);
 
 static Object *slice_select(Object *self, Object *key, Heap *heap, Error *err);
 static _Bool   slice_insert(Object *self, Object *key, Object *val, Heap *heap, Error *err);
 static int     slice_count(Object *self);
 static void	   slice_print(Object *obj, FILE *fp);
+static void    slice_walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp);
 
 
-static TypeObject t_buffer = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_buffer = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_BUFFER,
 	.name = "buffer",
 	.size = sizeof (BufferObject),
 	.select = buffer_select,
 	.insert = buffer_insert,
 	.count = buffer_count,
 	.print = buffer_print,
-	.free  = buffer_free,
+	.walkexts = buffer_walkexts,
 };
 
-static TypeObject t_buffer_slice = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_buffer_slice = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_BUFFER_SLICE,
 	.name = "buffer slice",
 	.size = sizeof (BufferSliceObject),
 	.select = slice_select,
 	.insert = slice_insert,
 	.count = slice_count,
 	.print = slice_print,
+	.walk  = slice_walk,
 };
 
-#define THRESHOLD 128
-
 _Bool Object_IsBuffer(Object *obj)
 {
-	return obj->type == &t_buffer_slice || obj->type == &t_buffer;
+	return Object_TypeOf(obj) == &t_buffer_slice || Object_TypeOf(obj) == &t_buffer;
 }
 
 Object *Object_NewBuffer(int size, Heap *heap, Error *error)
@@ -99,25 +101,12 @@ Object *Object_NewBuffer(int size, Heap *heap, Error *error)
 		if(obj == NULL)
 			return NULL;
 
-		unsigned char *body;
-
-		if(size > THRESHOLD)
-		{
-			body = malloc(sizeof(unsigned char) * size);
-
-			if(body == NULL)
-			{
-				Error_Report(error, 1, "No memory");
-				return NULL;
-			}
-		}
-		else
-		{
-			body = Heap_RawMalloc(heap, sizeof(unsigned char) * size, error);
+		// Big bodies are allocated in the large
+		// object space, so they're never moved.
+		unsigned char *body = Heap_RawMalloc(heap, sizeof(unsigned char) * size, error);
 				
-			if(body == NULL)
-				return NULL;
-		}
+		if(body == NULL)
+			return NULL;
 
 		obj->size = size;
 		obj->body = body;
@@ -127,20 +116,23 @@ Object *Object_NewBuffer(int size, Heap *heap, Error *error)
 	return (Object*) obj;
 }
 
-static _Bool buffer_free(Object *self, Error *error)
+static void buffer_walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp)
 {
-	(void) error;
-
 	BufferObject *buffer = (BufferObject*) self;
-	
-	if(buffer->size > THRESHOLD)
-		free(buffer->body);
-	return 1;
+
+	callback((void**) &buffer->body, buffer->size, userp);
+}
+
+static void slice_walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp)
+{
+	BufferSliceObject *slice = (BufferSliceObject*) self;
+
+	callback((Object**) &slice->sliced, userp);
 }
 
 Object *Object_SliceBuffer(Object *buffer, int offset, int length, Heap *heap, Error *error)
 {
-	if(buffer->type != &t_buffer && buffer->type != &t_buffer_slice)
+	if(Object_TypeOf(buffer) != &t_buffer && Object_TypeOf(buffer) != &t_buffer_slice)
 	{
 		Error_Report(error, 0, "Not a buffer or a buffer slice");
 		return NULL;
@@ -148,7 +140,7 @@ Object *Object_SliceBuffer(Object *buffer, int offset, int length, Heap *heap, E
 
 	BufferSliceObject *slice;
 
-	if(buffer->type == &t_buffer)
+	if(Object_TypeOf(buffer) == &t_buffer)
 	{
 		BufferObject *original = (BufferObject*) buffer;
 
@@ -184,7 +176,7 @@ Object *Object_SliceBuffer(Object *buffer, int offset, int length, Heap *heap, E
 	}
 	else
 	{
-		assert(buffer->type == &t_buffer_slice);
+		assert(Object_TypeOf(buffer) == &t_buffer_slice);
 
 		slice = (BufferSliceObject*) Heap_Malloc(heap, &t_buffer_slice, error);
 
@@ -221,13 +213,13 @@ Object *Object_SliceBuffer(Object *buffer, int offset, int length, Heap *heap, E
 
 void *Object_GetBufferAddrAndSize(Object *obj, int *size, Error *error)
 {
-	if(obj->type != &t_buffer && obj->type != &t_buffer_slice)
+	if(Object_TypeOf(obj) != &t_buffer && Object_TypeOf(obj) != &t_buffer_slice)
 	{
 		Error_Report(error, 0, "Not a buffer or a buffer slice");
 		return NULL;
 	}
 
-	if(obj->type == &t_buffer)
+	if(Object_TypeOf(obj) == &t_buffer)
 	{
 		BufferObject *buffer = (BufferObject*) obj;
 		
@@ -238,7 +230,7 @@ void *Object_GetBufferAddrAndSize(Object *obj, int *size, Error *error)
 	}
 	else
 	{
-		assert(obj->type == &t_buffer_slice);
+		assert(Object_TypeOf(obj) == &t_buffer_slice);
 
 		BufferSliceObject *slice = (BufferSliceObject*) obj;
 
@@ -252,7 +244,7 @@ void *Object_GetBufferAddrAndSize(Object *obj, int *size, Error *error)
 static Object *buffer_select(Object *self, Object *key, Heap *heap, Error *error)
 {
 	assert(self != NULL);
-	assert(self->type == &t_buffer);
+	assert(Object_TypeOf(self) == &t_buffer);
 	assert(key != NULL);
 	assert(heap != NULL);
 	assert(error != NULL);
@@ -282,7 +274,7 @@ static Object *buffer_select(Object *self, Object *key, Heap *heap, Error *error
 static Object *slice_select(Object *self, Object *key, Heap *heap, Error *error)
 {
 	assert(self != NULL);
-	assert(self->type == &t_buffer_slice);
+	assert(Object_TypeOf(self) == &t_buffer_slice);
 	assert(key != NULL);
 	assert(heap != NULL);
 	assert(error != NULL);
@@ -316,7 +308,7 @@ static _Bool buffer_insert(Object *self, Object *key, Object *val, Heap *heap, E
 	assert(val != NULL);
 	assert(heap != NULL);
 	assert(self != NULL);
-	assert(self->type == &t_buffer);
+	assert(Object_TypeOf(self) == &t_buffer);
 
 	BufferObject *buffer = (BufferObject*) self;
 
@@ -348,6 +340,7 @@ static _Bool buffer_insert(Object *self, Object *key, Object *val, Heap *heap, E
 	if(error->occurred == 1)
 		return 0;
 
+	Heap_WriteBarrier(heap, self);
 	buffer->body[idx] = byte;
 	return 1;
 }
@@ -359,7 +352,7 @@ static _Bool slice_insert(Object *self, Object *key, Object *val, Heap *heap, Er
 	assert(val != NULL);
 	assert(heap != NULL);
 	assert(self != NULL);
-	assert(self->type == &t_buffer_slice);
+	assert(Object_TypeOf(self) == &t_buffer_slice);
 
 	BufferSliceObject *slice = (BufferSliceObject*) self;
 
@@ -391,6 +384,7 @@ static _Bool slice_insert(Object *self, Object *key, Object *val, Heap *heap, Er
 	if(error->occurred == 1)
 		return 0;
 
+	Heap_WriteBarrier(heap, (Object*) slice->sliced);
 	slice->sliced->body[slice->offset + idx] = byte;
 	return 1;
 }
@@ -42,8 +42,9 @@ struct ClosureObject {
 static void walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp);
 static Object *select(Object *self, Object *key, Heap *heap, Error *err);
 
-static TypeObject t_closure = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_closure = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_CLOSURE,
 	.name = "closure",
 	.size = sizeof(ClosureObject),
 	.select = select,
@@ -57,7 +58,7 @@ Object *Object_NewClosure(Object *parent, Object *new_map, Heap *heap, Error *er
 	if(obj == NULL)
 		return NULL;
 
-	if(parent != NULL && parent->type != &t_closure)
+	if(parent != NULL && Object_TypeOf(parent) != &t_closure)
 	{
 		Error_Report(error, 0, "Object is not a closure");
 		return NULL;
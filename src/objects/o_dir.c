@@ -37,8 +37,9 @@ typedef struct {
 
 static _Bool dir_free(Object *obj, Error *error);
 
-static TypeObject t_dir = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_dir = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_DIR,
 	.name = "Directory",
 	.size = sizeof(DirObject),
 	.free = dir_free,
@@ -46,7 +47,7 @@ static TypeObject t_dir = {
 
 _Bool Object_IsDir(Object *obj)
 {
-	return obj->type == &t_dir;
+	return Object_TypeOf(obj) == &t_dir;
 }
 
 Object *Object_FromDIR(DIR *handle, Heap *heap, Error *error)
@@ -37,8 +37,9 @@ typedef struct {
 
 static _Bool file_free(Object *self, Error *error);
 
-static TypeObject t_file = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_file = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_FILE,
 	.name = "File",
 	.size = sizeof(FileObject),
 	.free = file_free,
@@ -46,7 +47,7 @@ static TypeObject t_file = {
 
 _Bool Object_IsFile(Object *obj)
 {
-	return obj->type == &t_file;
+	return Object_TypeOf(obj) == &t_file;
 }
 
 FILE *Object_ToStream(Object *obj, Error *error)
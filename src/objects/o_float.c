@@ -43,8 +43,9 @@ typedef struct {
 	double val;
 } FloatObject;
 
-static TypeObject t_float = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_float = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_FLOAT,
 	.name = "float",
 	.size = sizeof (FloatObject),
 	.atomic = ATMTP_FLOAT,
@@ -58,7 +59,7 @@ static TypeObject t_float = {
 static int hash(Object *self)
 {
 	assert(self != NULL);
-	assert(self->type == &t_float);
+	assert(Object_TypeOf(self) == &t_float);
 
 	FloatObject *iobj = (FloatObject*) self;
 
@@ -75,9 +76,9 @@ static Object *copy(Object *self, Heap *heap, Error *err)
 static _Bool op_eql(Object *self, Object *other)
 {
 	assert(self != NULL);
-	assert(self->type == &t_float);
+	assert(Object_TypeOf(self) == &t_float);
 	assert(other != NULL);
-	assert(other->type == &t_float);
+	assert(Object_TypeOf(other) == &t_float);
 
 	FloatObject *i1, *i2;
 
@@ -98,6 +99,12 @@ static double to_float(Object *obj, Error *err)
 	return ((FloatObject*) obj)->val;
 }
 
+double Object_GetFloat(Object *obj)
+{
+	assert(Object_GetType(obj) == &t_float);
+	return ((FloatObject*) obj)->val;
+}
+
 Object *Object_FromFloat(double val, Heap *heap, Error *error)
 {
 	FloatObject *obj = (FloatObject*) Heap_Malloc(heap, &t_float, error);
@@ -114,7 +121,7 @@ static void print(Object *obj, FILE *fp)
 {
 	assert(fp != NULL);
 	assert(obj != NULL);
-	assert(obj->type == &t_float);
+	assert(Object_TypeOf(obj) == &t_float);
 
 	fprintf(fp, "%2.2f", ((FloatObject*) obj)->val);
 }
\ No newline at end of file
@@ -39,13 +39,9 @@ static _Bool op_eql(Object *self, Object *other);
 static int hash(Object *self);
 static Object *copy(Object *self, Heap *heap, Error *err);
 
-typedef struct {
-	Object base;
-	long long int val;
-} IntObject;
-
-static TypeObject t_int = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_int = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_INT,
 	.name = "int",
 	.size = sizeof (IntObject),
 	.atomic = ATMTP_INT,
@@ -59,7 +55,7 @@ static TypeObject t_int = {
 static int hash(Object *self)
 {
 	assert(self != NULL);
-	assert(self->type == &t_int);
+	assert(Object_TypeOf(self) == &t_int);
 
 	IntObject *iobj = (IntObject*) self;
 
@@ -84,6 +80,12 @@ static long long int to_int(Object *obj, Error *err)
 	return ((IntObject*) obj)->val;
 }
 
+long long int Object_GetInt(Object *obj)
+{
+	assert(Object_GetType(obj) == &t_int);
+	return ((IntObject*) obj)->val;
+}
+
 Object *Object_FromInt(long long int val, Heap *heap, Error *error)
 {
 	assert(heap != NULL);
@@ -103,7 +105,7 @@ static void print(Object *obj, FILE *fp)
 {
 	assert(fp != NULL);
 	assert(obj != NULL);
-	assert(obj->type == &t_int);
+	assert(Object_TypeOf(obj) == &t_int);
 
 	fprintf(fp, "%lld", ((IntObject*) obj)->val);
 }
@@ -111,9 +113,9 @@ static void print(Object *obj, FILE *fp)
 static _Bool op_eql(Object *self, Object *other)
 {
 	assert(self != NULL);
-	assert(self->type == &t_int);
+	assert(Object_TypeOf(self) == &t_int);
 	assert(other != NULL);
-	assert(other->type == &t_int);
+	assert(Object_TypeOf(other) == &t_int);
 
 	IntObject *i1, *i2;
 
@@ -36,7 +36,9 @@
 typedef struct {
 	Object base;
 	int capacity, count;
+	int nested; // Number of elements that aren't immutable.
 	Object **vals;
+	Object *shared; // List holding the elements shared with copies, or NULL.
 } ListObject;
 
 static Object *select(Object *self, Object *key, Heap *heap, Error *err);
@@ -48,8 +50,9 @@ static void    walkexts(Object *self, void (*callback)(void   **referer, unsigne
 static Object *copy(Object *self, Heap *heap, Error *err);
 static int hash(Object *self);
 
-static TypeObject t_list = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_list = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_LIST,
 	.name = "list",
 	.size = sizeof (ListObject),
 	.copy = copy,
@@ -62,43 +65,125 @@ static TypeObject t_list = {
 	.walkexts = walkexts,
 };
 
+// Returns the list that holds the elements
+// of [list], which isn't [list] if they're
+// shared with copies.
+static inline ListObject *get_data(ListObject *list)
+{
+	if(list->shared != NULL)
+		return (ListObject*) list->shared;
+	return list;
+}
+
 static int hash(Object *self)
 {
 	assert(self != NULL);
-	assert(self->type == &t_list);
+	assert(Object_TypeOf(self) == &t_list);
 
-	ListObject *ls = (ListObject*) self;
+	ListObject *ls = get_data((ListObject*) self);
 
-	int h = 0;
 	// The hash is the sum of the nested
 	// hashes. It's not a smart solution
-	// but it works for now.
+	// but it works for now. The sum is
+	// unsigned so that it wraps around.
+	unsigned int h = 0;
 	for(int i = 0; i < ls->count; i += 1)
-		h += Object_Hash(ls->vals[i]);
+		h += (unsigned int) Object_Hash(ls->vals[i]);
 
-	return h;
+	return (int) h;
 }
 
+/* Symbol: copy
+ *
+ *   Copies of lists of immutable objects share the
+ *   elements with the original. The elements are 
+ *   moved to a list that the program can't reach,
+ *   which the original and the copies refer to, and
+ *   the first insertion in any of them gives it its
+ *   own array again.
+ *
+ *   Lists of other objects are copied element by
+ *   element, since their elements can be modified
+ *   without going through the list. Sharing the 
+ *   elements and copying them on the first write 
+ *   wouldn't do, because the list isn't told of
+ *   writes through other references. This costs
+ *   one pass over the list, since the copies of 
+ *   nested lists and maps of immutable objects 
+ *   share their elements.
+ */
 static Object *copy(Object *self, Heap *heap, Error *err)
 {
-	(void) heap;
-	(void) err;
+	ListObject *ls = (ListObject*) self;
+
+	if(ls->nested == 0)
+	{
+		if(ls->shared == NULL)
+		{
+			ListObject *data = (ListObject*) Heap_Malloc(heap, &t_list, err);
+			if(data == NULL) return NULL;
+
+			data->capacity = ls->capacity;
+			data->count  = ls->count;
+			data->nested = 0;
+			data->vals   = ls->vals;
+			data->shared = NULL;
+
+			Heap_WriteBarrier(heap, self);
+			ls->vals = NULL;
+			ls->shared = (Object*) data;
+		}
+
+		ListObject *ls2 = (ListObject*) Heap_Malloc(heap, &t_list, err);
+		if(ls2 == NULL) return NULL;
+
+		ls2->capacity = ls->capacity;
+		ls2->count  = ls->count;
+		ls2->nested = 0;
+		ls2->vals   = NULL;
+		ls2->shared = ls->shared;
+		return (Object*) ls2;
+	}
 
-	ListObject *ls  = (ListObject*) self;
-	ListObject *ls2 = (ListObject*) Object_NewList(ls->count, heap, err);
+	ListObject *data = get_data(ls);
+	ListObject *ls2  = (ListObject*) Object_NewList(ls->count, heap, err);
 	if(ls2 == NULL) return NULL;
 
 	for(int i = 0; i < ls->count; i += 1)
 	{
-		ls2->vals[i] = Object_Copy(ls->vals[i], heap, err);
+		ls2->vals[i] = Object_Copy(data->vals[i], heap, err);
 		if(err->occurred) return NULL;
 	}
 
-	ls2->count = ls->count;
+	ls2->count  = ls->count;
+	ls2->nested = ls->nested;
 
 	return (Object*) ls2;
 }
 
+/* Symbol: unshare
+ *
+ *   Gives a list that shares its elements with
+ *   copies an array of its own.
+ */
+static _Bool unshare(ListObject *list, Heap *heap, Error *error)
+{
+	assert(list->shared != NULL);
+
+	ListObject *data = (ListObject*) list->shared;
+
+	Object **vals = Heap_RawMalloc(heap, sizeof(Object*) * list->capacity, error);
+
+	if(vals == NULL)
+		return 0;
+
+	memcpy(vals, data->vals, sizeof(Object*) * list->count);
+
+	list->vals = vals;
+	list->shared = NULL;
+	return 1;
+}
+
 Object *Object_NewList(int capacity, Heap *heap, Error *error)
 {
 	// Handle default args.
@@ -114,6 +199,8 @@ Object *Object_NewList(int capacity, Heap *heap, Error *error)
 			return NULL;
 
 		obj->count = 0;
+		obj->nested = 0;
+		obj->shared = NULL;
 		obj->capacity = capacity;
 		obj->vals = Heap_RawMalloc(heap, sizeof(Object*) * capacity, error);
 
@@ -136,6 +223,9 @@ Object *Object_NewList2(int num, Object **items, Heap *heap, Error *error)
 	memcpy(list->vals, items, num * sizeof(Object*));
 	list->count = num;
 
+	for(int i = 0; i < num; i += 1)
+		list->nested += !Object_IsImmutable(items[i]);
+
 	return (Object*) list;
 }
 
@@ -143,6 +233,12 @@ static void walk(Object *self, void (*callback)(Object **referer, void *userp),
 {
 	ListObject *list = (ListObject*) self;
 
+	if(list->shared != NULL)
+	{
+		callback(&list->shared, userp);
+		return;
+	}
+
 	for(int i = 0; i < list->count; i += 1)
 		callback(&list->vals[i], userp);
 }
@@ -151,13 +247,14 @@ static void walkexts(Object *self, void (*callback)(void **referer, unsigned int
 {
 	ListObject *list = (ListObject*) self;
 	
-	callback((void**) &list->vals, sizeof(Object) * list->capacity, userp);
+	if(list->shared == NULL)
+		callback((void**) &list->vals, sizeof(Object*) * list->capacity, userp);
 }
 
 static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 {
 	assert(self != NULL);
-	assert(self->type == &t_list);
+	assert(Object_TypeOf(self) == &t_list);
 	assert(key != NULL);
 	assert(heap != NULL);
 	assert(error != NULL);
@@ -171,7 +268,7 @@ static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 	int idx = Object_ToInt(key, error);
 	assert(error->occurred == 0);
 
-	ListObject *list = (ListObject*) self;
+	ListObject *list = get_data((ListObject*) self);
 
 	if(idx < 0 || idx >= list->count)
 	{
@@ -213,7 +310,7 @@ static _Bool insert(Object *self, Object *key, Object *val, Heap *heap, Error *e
 	assert(val != NULL);
 	assert(heap != NULL);
 	assert(self != NULL);
-	assert(self->type == &t_list);
+	assert(Object_TypeOf(self) == &t_list);
 
 	ListObject *list = (ListObject*) self;
 
@@ -232,6 +329,11 @@ static _Bool insert(Object *self, Object *key, Object *val, Heap *heap, Error *e
 		return NULL;
 	}
 
+	Heap_WriteBarrier(heap, self);
+
+	if(list->shared != NULL && !unshare(list, heap, error))
+		return 0;
+
 	if(idx == list->count)
 	{
 		if(list->count == list->capacity)
@@ -243,9 +345,11 @@ static _Bool insert(Object *self, Object *key, Object *val, Heap *heap, Error *e
 	}
 	else
 	{
+		list->nested -= !Object_IsImmutable(list->vals[idx]);
 		list->vals[idx] = val;
 	}
 
+	list->nested += !Object_IsImmutable(val);
 	return 1;
 }
 
@@ -258,7 +362,7 @@ static int count(Object *self)
 
 static void print(Object *self, FILE *fp)
 {
-	ListObject *list = (ListObject*) self;
+	ListObject *list = get_data((ListObject*) self);
 
 	fprintf(fp, "[");
 	for(int i = 0; i < list->count; i += 1)
@@ -29,15 +29,18 @@
 */
 
 #include <assert.h>
+#include <string.h>
 #include "../utils/defs.h"
 #include "objects.h"
 
 typedef struct {
 	Object base;
 	int mapper_size, count;
+	int nested; // Number of keys and values that aren't immutable.
 	int *mapper;
 	Object **keys;
 	Object **vals;
+	Object *shared; // Map holding the items shared with copies, or NULL.
 } MapObject;
 
 static Object *select(Object *self, Object *key, Heap *heap, Error *err);
@@ -49,8 +52,9 @@ static void walkexts(Object *self, void (*callback)(void **referer, unsigned int
 static Object *copy(Object *self, Heap *heap, Error *err);
 static int hash(Object *self);
 
-static TypeObject t_map = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_map = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_MAP,
 	.name = "map",
 	.size = sizeof (MapObject),
 	.copy = copy,
@@ -68,44 +72,122 @@ static inline int calc_capacity(int mapper_size)
 	return mapper_size * 2.0 / 3.0;
 }
 
+// Returns the map that holds the items
+// of [map], which isn't [map] if they're
+// shared with copies.
+static inline MapObject *get_data(MapObject *map)
+{
+	if(map->shared != NULL)
+		return (MapObject*) map->shared;
+	return map;
+}
+
+/* Symbol: copy
+ *
+ *   Copies of maps of immutable keys and values
+ *   share the items with the original, like the
+ *   copies of lists (see o_list.c). The first 
+ *   insertion in any of the maps that share the
+ *   items gives it its own arrays again.
+ *
+ *   Maps with nested maps, lists or other mutable
+ *   objects are out of scope: those objects can be
+ *   changed through other references that the map
+ *   doesn't know of, so each one is copied. The 
+ *   copies of nested maps and lists are the cheap
+ *   shared ones when they only hold immutable 
+ *   objects, and the copy keeps the layout of the 
+ *   original, so no key is hashed again.
+ */
 static Object *copy(Object *self, Heap *heap, Error *err)
 {
 	MapObject *m1 = (MapObject*) self;
-	Object *m2 = Object_NewMap(m1->count, heap, err);
-	if(m2 == NULL) return NULL;
 
-	for(int i = 0; i < m1->count; i += 1)
+	if(m1->nested == 0)
 	{
-		Object *key, *key_cpy;
-		Object *val, *val_cpy;
+		if(m1->shared == NULL)
+		{
+			MapObject *data = (MapObject*) Heap_Malloc(heap, &t_map, err);
+			if(data == NULL) return NULL;
+
+			data->mapper_size = m1->mapper_size;
+			data->count  = m1->count;
+			data->nested = 0;
+			data->mapper = m1->mapper;
+			data->keys   = m1->keys;
+			data->vals   = m1->vals;
+			data->shared = NULL;
+
+			Heap_WriteBarrier(heap, self);
+			m1->mapper = NULL;
+			m1->keys = NULL;
+			m1->vals = NULL;
+			m1->shared = (Object*) data;
+		}
 
-		key = m1->keys[i];
-		val = m1->vals[i];
+		MapObject *m2 = (MapObject*) Heap_Malloc(heap, &t_map, err);
+		if(m2 == NULL) return NULL;
+
+		m2->mapper_size = m1->mapper_size;
+		m2->count  = m1->count;
+		m2->nested = 0;
+		m2->mapper = NULL;
+		m2->keys   = NULL;
+		m2->vals   = NULL;
+		m2->shared = m1->shared;
+		return (Object*) m2;
+	}
 
-		key_cpy = Object_Copy(key, heap, err);
-		if(key_cpy == NULL) return NULL;
+	MapObject *data = get_data(m1);
 
-		val_cpy = Object_Copy(val, heap, err);
-		if(val_cpy == NULL) return NULL;
+	MapObject *m2 = (MapObject*) Heap_Malloc(heap, &t_map, err);
+	if(m2 == NULL) return NULL;
 
-		if(!Object_Insert(m2, key_cpy, val_cpy, heap, err))
-			return NULL;
+	int capacity = calc_capacity(m1->mapper_size);
+
+	m2->mapper_size = m1->mapper_size;
+	m2->count  = 0;
+	m2->nested = m1->nested;
+	m2->shared = NULL;
+	m2->mapper = Heap_RawMalloc(heap, sizeof(int) * m1->mapper_size, err);
+	m2->keys   = Heap_RawMalloc(heap, sizeof(Object*) * capacity, err);
+	m2->vals   = Heap_RawMalloc(heap, sizeof(Object*) * capacity, err);
+
+	if(m2->mapper == NULL || m2->keys == NULL || m2->vals == NULL)
+		return NULL;
+
+	// The copies of the keys are equal to them,
+	// so they have the same hashes and the same
+	// slots in the mapper.
+	memcpy(m2->mapper, data->mapper, sizeof(int) * m1->mapper_size);
+
+	for(int i = 0; i < m1->count; i += 1)
+	{
+		m2->keys[i] = Object_Copy(data->keys[i], heap, err);
+		if(m2->keys[i] == NULL) return NULL;
+
+		m2->vals[i] = Object_Copy(data->vals[i], heap, err);
+		if(m2->vals[i] == NULL) return NULL;
+
+		m2->count += 1;
 	}
 
 	return (Object*) m2;
 }
 
+
 static int hash(Object *self)
 {
-	MapObject *m = (MapObject*) self;
+	MapObject *m = get_data((MapObject*) self);
 
-	int h = 0;
 	// The hash of the map is the sum of the
-	// hashes of each key and each item.
+	// hashes of each key and each item. The 
+	// sum is unsigned so that it wraps around.
+	unsigned int h = 0;
 	for(int i = 0; i < m->count; i += 1)
-		h += Object_Hash(m->keys[i])
-		   + Object_Hash(m->vals[i]);
-	return h;
+		h += (unsigned int) Object_Hash(m->keys[i])
+		   + (unsigned int) Object_Hash(m->vals[i]);
+	return (int) h;
 }
 
 Object *Object_NewMap(int num, Heap *heap, Error *error)
@@ -132,6 +214,8 @@ Object *Object_NewMap(int num, Heap *heap, Error *error)
 
 		obj->mapper_size = mapper_size;
 		obj->count = 0;
+		obj->nested = 0;
+		obj->shared = NULL;
 		obj->mapper = Heap_RawMalloc(heap, sizeof(int) * mapper_size, error);
 		obj->keys   = Heap_RawMalloc(heap, sizeof(Object*) * capacity, error);
 		obj->vals   = Heap_RawMalloc(heap, sizeof(Object*) * capacity, error);
@@ -150,6 +234,12 @@ static void walk(Object *self, void (*callback)(Object **referer, void *userp),
 {
 	MapObject *map = (MapObject*) self;
 
+	if(map->shared != NULL)
+	{
+		callback(&map->shared, userp);
+		return;
+	}
+
 	for(int i = 0; i < map->count; i += 1)
 	{
 		callback(&map->keys[i], userp);
@@ -159,10 +249,13 @@ static void walk(Object *self, void (*callback)(Object **referer, void *userp),
 
 static void walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp)
 {
-	assert(self->type == &t_map);
+	assert(Object_TypeOf(self) == &t_map);
 
 	MapObject *map = (MapObject*) self;
 
+	if(map->shared != NULL)
+		return;
+
 	int capacity = calc_capacity(map->mapper_size);
 	
 	callback((void**) &map->mapper, sizeof(int) * map->mapper_size, userp);
@@ -173,12 +266,12 @@ static void walkexts(Object *self, void (*callback)(void **referer, unsigned int
 static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 {
 	assert(self != NULL);
-	assert(self->type == &t_map);
+	assert(Object_TypeOf(self) == &t_map);
 	assert(key != NULL);
 	assert(heap != NULL);
 	assert(error != NULL);
 
-	MapObject *map = (MapObject*) self;
+	MapObject *map = get_data((MapObject*) self);
 
 	unsigned int mask = map->mapper_size - 1;
 	unsigned int hash = Object_Hash(key);
@@ -203,7 +296,10 @@ static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 					
 			assert(k >= 0);
 
-			if(Object_Compare(key, map->keys[k], error))
+			// Keys made from the same identifier or
+			// literal are interned, so they're often
+			// the same object.
+			if(map->keys[k] == key || Object_Compare(key, map->keys[k], error))
 				// Found it!
 				return map->vals[k];
 
@@ -222,6 +318,37 @@ static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 	return NULL;
 }
 
+/* Symbol: unshare
+ *
+ *   Gives a map that shares its items with
+ *   copies arrays of its own.
+ */
+static _Bool unshare(MapObject *map, Heap *heap, Error *error)
+{
+	assert(map->shared != NULL);
+
+	MapObject *data = (MapObject*) map->shared;
+
+	int capacity = calc_capacity(map->mapper_size);
+
+	int *mapper   = Heap_RawMalloc(heap, sizeof(int) * map->mapper_size, error);
+	Object **keys = Heap_RawMalloc(heap, sizeof(Object*) * capacity, error);
+	Object **vals = Heap_RawMalloc(heap, sizeof(Object*) * capacity, error);
+
+	if(mapper == NULL || keys == NULL || vals == NULL)
+		return 0;
+
+	memcpy(mapper, data->mapper, sizeof(int) * map->mapper_size);
+	memcpy(keys, data->keys, sizeof(Object*) * map->count);
+	memcpy(vals, data->vals, sizeof(Object*) * map->count);
+
+	map->mapper = mapper;
+	map->keys = keys;
+	map->vals = vals;
+	map->shared = NULL;
+	return 1;
+}
+
 static _Bool grow(MapObject *map, Heap *heap, Error *error)
 {
 	assert(map != NULL);
@@ -251,10 +378,10 @@ static _Bool grow(MapObject *map, Heap *heap, Error *error)
 		// This won't trigger an error because the key
 		// surely has a hash method since we already
 		// hashed it once.
-		int hash = Object_Hash(keys[i]);
+		unsigned int hash = Object_Hash(keys[i]);
 
-		int mask = new_mapper_size - 1;
-		int pert = hash;
+		unsigned int mask = new_mapper_size - 1;
+		unsigned int pert = hash;
 			
 		int j = hash & mask;
 
@@ -289,10 +416,15 @@ static _Bool insert(Object *self, Object *key, Object *val, Heap *heap, Error *e
 	assert(val != NULL);
 	assert(heap != NULL);
 	assert(self != NULL);
-	assert(self->type == &t_map);
+	assert(Object_TypeOf(self) == &t_map);
 
 	MapObject *map = (MapObject*) self;
 
+	Heap_WriteBarrier(heap, self);
+
+	if(map->shared != NULL && !unshare(map, heap, error))
+		return 0;
+
 	if(map->count == calc_capacity(map->mapper_size))
 		if(!grow(map, heap, error))
 			return 0;
@@ -319,16 +451,18 @@ static _Bool insert(Object *self, Object *key, Object *val, Heap *heap, Error *e
 			map->keys[map->count] = key_copy;
 			map->vals[map->count] = val;
 			map->count += 1;
+			map->nested += !Object_IsImmutable(key_copy) + !Object_IsImmutable(val);
 			return 1;
 		}
 		else
 		{
 			assert(k >= 0);
 
-			if(Object_Compare(key, map->keys[k], error))
+			if(map->keys[k] == key || Object_Compare(key, map->keys[k], error))
 			{
 				// Already inserted.
 				// Overwrite the value.
+				map->nested += !Object_IsImmutable(val) - !Object_IsImmutable(map->vals[k]);
 				map->vals[k] = val;
 				return 1;
 			}
@@ -357,7 +491,7 @@ static int count(Object *self)
 
 static void print(Object *self, FILE *fp)
 {
-	MapObject *map = (MapObject*) self;
+	MapObject *map = get_data((MapObject*) self);
 
 	fprintf(fp, "{");
 	for(int i = 0; i < map->count; i += 1)
@@ -37,8 +37,9 @@ static void   print(Object *obj, FILE *fp);
 static int     hash(Object *self);
 static Object *copy(Object *self, Heap *heap, Error *err);
 
-static TypeObject t_none = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_none = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_NONE,
 	.name = "none",
 	.size = sizeof (Object),
 	.hash = hash,
@@ -48,7 +49,7 @@ static TypeObject t_none = {
 };
 
 static Object the_none_object = {
-	.type = &t_none,
+	.type_index = TYPE_NONE,
 	.flags = Object_STATIC,
 };
 
@@ -81,7 +82,7 @@ static void print(Object *obj, FILE *fp)
 {
 	assert(fp != NULL);
 	assert(obj != NULL);
-	assert(obj->type == &t_none);
+	assert(Object_TypeOf(obj) == &t_none);
 
 	fprintf(fp, "none");
 }
@@ -90,6 +91,6 @@ static _Bool op_eql(Object *self, Object *other)
 {
 	(void) self;
 	
-	assert(other->type == &t_none);
+	assert(Object_TypeOf(other) == &t_none);
 	return 1;
 }
\ No newline at end of file
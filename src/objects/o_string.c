@@ -29,70 +29,353 @@
 */
 
 #include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <stddef.h>
 #include <assert.h>
 #include "../utils/defs.h"
 #include "../utils/hash.h"
 #include "../utils/utf8.h"
 #include "objects.h"
 
+// Strings shorter than this are stored in the
+// same allocation of the object. The longer ones
+// have a separate body, which is allocated in the
+// large object space when it's big enough.
+#define MAX_INLINE_STRING 4096
+
+// Slices shorter than this are copied instead of
+// being views of the sliced string, since a copy 
+// this short costs about as much as a view and 
+// doesn't keep the sliced string alive.
+#define MIN_VIEW_BYTES 16
+
+// Views that are shorter than this and use less
+// than 1/MAX_VIEW_FRACTION of their parent's bytes
+// are copied when the collector moves them, so 
+// that they don't keep a much larger parent alive.
+#define MAX_VIEW_FRACTION 8
+
+// Concatenations shorter than this are copied 
+// instead of being ropes. Appending a short string
+// to a rope also merges it with the rope's last 
+// piece while it stays under this size, so that 
+// strings built a piece at the time don't have a
+// node per piece.
+#define MAX_FLAT_CONCAT 64
+
+// Value of [offset] for ropes.
+#define ROPE -2
+
 typedef struct {
 	Object  base;
 	int     count;
 	int     bytes;
-	char   *body;
+	unsigned int hash; // State of the hash, see [hashstep].
+	int     offset; // Byte offset in the parent, -1 if not a view or ROPE.
+	union {
+		char   *body;   // NULL when the string is inline.
+		Object *parent; // The viewed string, which isn't a view.
+		Object *left;   // First half of a rope.
+	};
+	union {
+		struct {
+			// Character index and byte offset of the last
+			// character that was looked up. Indexing of 
+			// non-ASCII strings starts from here when it's
+			// closer than the ends of the string.
+			int cursor_index;
+			int cursor_offset;
+		};
+		Object *right; // Second half of a rope.
+	};
+	char    data[];
 } StringObject;
 
+static inline _Bool is_view(StringObject *str)
+{
+	return str->offset >= 0;
+}
+
+static inline _Bool is_rope(StringObject *str)
+{
+	return str->offset == ROPE;
+}
+
+static inline char *get_body(StringObject *str)
+{
+	assert(!is_rope(str));
+
+	if(is_view(str))
+	{
+		StringObject *parent = (StringObject*) str->parent;
+		assert(!is_view(parent));
+
+		return (parent->body == NULL ? parent->data : parent->body) + str->offset;
+	}
+
+	return str->body == NULL ? str->data : str->body;
+}
+
 static int hash(Object *self);
 static int count(Object *self);
 static Object *copy(Object *self, Heap *heap, Error *err);
 static void print(Object *obj, FILE *fp);
 static char *to_string(Object *self, int *size, Heap *heap, Error *err);
 static _Bool op_eql(Object *self, Object *other);
+static void walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp);
 static void walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp);
-static Object *select(Object *self, Object *key, Heap *heap, Error *error);
+static Object *string_select(Object *self, Object *key, Heap *heap, Error *error);
+static unsigned int get_size(Object *self);
 
-static TypeObject t_string = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_string = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_STRING,
 	.name = "string",
 	.atomic = ATMTP_STRING,
 	.size = sizeof(StringObject),
+	.get_size = get_size,
 	.hash = hash,
 	.count = count,
 	.copy = copy,
 	.print = print,
-	.select = select,
+	.select = string_select,
 	.to_string = to_string,
 	.op_eql = op_eql,
+	.walk = walk,
 	.walkexts = walkexts,
 };
 
+static inline int distance(int a, int b)
+{
+	return a > b ? a - b : b - a;
+}
+
+static inline int sequence_length(unsigned char head)
+{
+	if(head < 0x80)
+		return 1;
+	if((head & 0xE0) == 0xC0)
+		return 2;
+	if((head & 0xF0) == 0xE0)
+		return 3;
+	return 4;
+}
+
+/* Symbol: char_index_to_offset
+ *
+ *   Returns the offset of the first byte of the
+ *   character number [idx] of the string. 
+ *
+ *   For non-ASCII strings the bytes are scanned 
+ *   from the closest between the start, the end
+ *   and the cursor, which is then moved to [idx].
+ *   This makes sequential and strided access take
+ *   constant time per character.
+ *
+ *   The UTF-8 was validated when the string was
+ *   made, so the sequences are only measured here.
+ */
 static int char_index_to_offset(StringObject *str, int idx)
 {
+	assert(idx >= 0 && idx <= str->count);
+
 	if(str->count == str->bytes)
 		return idx;
 
-	// Iterate over a string to find the first byte of
-	// the utf-8 character number [idx].
+	int index  = 0;
+	int offset = 0;
+
+	if(distance(idx, str->cursor_index) < idx)
+	{
+		index  = str->cursor_index;
+		offset = str->cursor_offset;
+	}
+
+	if(str->count - idx < distance(idx, index))
+	{
+		index  = str->count;
+		offset = str->bytes;
+	}
+
+	const char *body = get_body(str);
+
+	while(index < idx)
+	{
+		offset += sequence_length(body[offset]);
+		index += 1;
+	}
+
+	while(index > idx)
+	{
+		do
+			offset -= 1;
+		while((body[offset] & 0xC0) == 0x80);
+		index -= 1;
+	}
+
+	assert(offset <= str->bytes);
 
-	int scanned_bytes = 0, 
-	    last_code_len = 0;
+	str->cursor_index  = idx;
+	str->cursor_offset = offset;
+	return offset;
+}
+
+/* Symbol: make_slice
+ *
+ *   Returns the substring of [str] that is [bytes] 
+ *   bytes long, starts at [byteoffset] and contains 
+ *   [count] characters. Unless it's very short, the
+ *   substring is a view of [str] (or of the string 
+ *   [str] is a view of), so it's not copied.
+ */
+static Object *make_slice(StringObject *str, int byteoffset, int bytes, int count, Heap *heap, Error *error)
+{
+	if(byteoffset == 0 && bytes == str->bytes)
+		return (Object*) str;
 
-	while(idx > 0)
+	if(bytes < MIN_VIEW_BYTES)
+		return Object_FromString(get_body(str) + byteoffset, bytes, heap, error);
+
+	if(is_view(str))
 	{
-		last_code_len = utf8_sequence_to_utf32_codepoint(str->body + scanned_bytes, str->bytes - scanned_bytes, NULL);
-		scanned_bytes += last_code_len;
-		idx -= 1;
+		byteoffset += str->offset;
+		str = (StringObject*) str->parent;
+	}
+
+	StringObject *view = Heap_Malloc(heap, &t_string, error);
 
-		assert(scanned_bytes <= str->bytes);
+	if(view == NULL)
+		return NULL;
+
+	view->count  = count;
+	view->bytes  = bytes;
+	view->cursor_index  = 0;
+	view->cursor_offset = 0;
+	view->offset = byteoffset;
+	view->parent = (Object*) str;
+	view->hash   = hashstep(0, (unsigned char*) get_body(view), bytes);
+	return (Object*) view;
+}
+
+/* Symbol: write_bytes
+ *
+ *   Copies the bytes of [str] to [dst]. Ropes are
+ *   walked by recursing on the shorter half and 
+ *   looping on the other, so the recursion depth
+ *   is logarithmic in the length of the string
+ *   however unbalanced the rope is.
+ */
+static void write_bytes(StringObject *str, char *dst)
+{
+	while(is_rope(str))
+	{
+		StringObject *left  = (StringObject*) str->left;
+		StringObject *right = (StringObject*) str->right;
+
+		if(left->bytes < right->bytes)
+		{
+			write_bytes(left, dst);
+			dst += left->bytes;
+			str = right;
+		}
+		else
+		{
+			write_bytes(right, dst + left->bytes);
+			str = left;
+		}
 	}
 
-	assert(idx == 0);
-	return scanned_bytes;
+	memcpy(dst, get_body(str), str->bytes);
 }
 
-static Object *select(Object *self, Object *key, Heap *heap, Error *error)
+/* Symbol: match_bytes
+ *
+ *   Returns true if the bytes of [str] are the 
+ *   same as the ones at [bytes]. It walks ropes 
+ *   like [write_bytes].
+ */
+static _Bool match_bytes(StringObject *str, const char *bytes)
 {
-	assert(self != NULL && self->type == &t_string);
+	while(is_rope(str))
+	{
+		StringObject *left  = (StringObject*) str->left;
+		StringObject *right = (StringObject*) str->right;
+
+		if(left->bytes < right->bytes)
+		{
+			if(!match_bytes(left, bytes))
+				return 0;
+			bytes += left->bytes;
+			str = right;
+		}
+		else
+		{
+			if(!match_bytes(right, bytes + left->bytes))
+				return 0;
+			str = left;
+		}
+	}
+
+	return !memcmp(get_body(str), bytes, str->bytes);
+}
+
+/* Symbol: byte_at
+ *
+ *   Returns the byte at offset [idx] of [str]. It's
+ *   only used when the bytes of a rope are needed
+ *   and can't be copied to a temporary buffer.
+ */
+static char byte_at(StringObject *str, int idx)
+{
+	while(is_rope(str))
+	{
+		StringObject *left = (StringObject*) str->left;
+
+		if(idx < left->bytes)
+			str = left;
+		else
+		{
+			idx -= left->bytes;
+			str = (StringObject*) str->right;
+		}
+	}
+
+	return get_body(str)[idx];
+}
+
+/* Symbol: flatten
+ *
+ *   Turns a view or a rope into a string with its
+ *   own body. Views are flattened when a zero-
+ *   terminated string is needed, since the bytes 
+ *   of a view aren't followed by a zero, while 
+ *   ropes are flattened the first time their bytes
+ *   are needed.
+ */
+static _Bool flatten(StringObject *str, Heap *heap, Error *error)
+{
+	assert(is_view(str) || is_rope(str));
+
+	char *body = Heap_RawMalloc(heap, str->bytes+1, error);
+
+	if(body == NULL)
+		return 0;
+
+	write_bytes(str, body);
+	body[str->bytes] = '\0';
+
+	Heap_WriteBarrier(heap, (Object*) str);
+	str->offset = -1;
+	str->body = body;
+	str->cursor_index  = 0;
+	str->cursor_offset = 0;
+	return 1;
+}
+
+static Object *string_select(Object *self, Object *key, Heap *heap, Error *error)
+{
+	assert(self != NULL && Object_TypeOf(self) == &t_string);
 	assert(key != NULL && heap != NULL && error != NULL);
 
 	if(!Object_IsInt(key))
@@ -112,26 +395,87 @@ static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 		return NULL;
 	}
 
+	if(is_rope(str) && !flatten(str, heap, error))
+		return NULL;
+
 	int byteoffset = char_index_to_offset(str, idx);
-	int codelength = utf8_sequence_to_utf32_codepoint(str->body + byteoffset, str->bytes - byteoffset, NULL);
+	int codelength = utf8_sequence_to_utf32_codepoint(get_body(str) + byteoffset, str->bytes - byteoffset, NULL);
 
-	return Object_FromString(str->body + byteoffset, codelength, heap, error);
+	return make_slice(str, byteoffset, codelength, 1, heap, error);
 }
 
 static char *to_string(Object *self, int *size, Heap *heap, Error *err)
 {
 	assert(self != NULL);
-	assert(self->type == &t_string);
-
-	(void) heap;
-	(void) err;
+	assert(Object_TypeOf(self) == &t_string);
 
 	StringObject *s = (StringObject*) self;
 
+	if(is_rope(s))
+	{
+		if(!flatten(s, heap, err))
+			return NULL;
+	}
+
 	if(size)
 		*size = s->bytes;
+	else if(is_view(s))
+	{
+		// The caller expects the string
+		// to be zero-terminated.
+		if(!flatten(s, heap, err))
+			return NULL;
+	}
 
-	return s->body;
+	return get_body(s);
+}
+
+/* Symbol: make_flat
+ *
+ *   Allocates a string that owns a body of [len]
+ *   bytes. The caller fills the body and sets the
+ *   character count and the hash.
+ */
+static StringObject *make_flat(int len, Heap *heap, Error *error)
+{
+	StringObject *strobj;
+	char *body;
+
+	if(len < MAX_INLINE_STRING)
+	{
+		strobj = Heap_MallocSized(heap, &t_string, offsetof(StringObject, data) + len + 1, error);
+
+		if(strobj == NULL)
+			return NULL;
+
+		strobj->offset = -1;
+		strobj->body = NULL;
+		body = strobj->data;
+	}
+	else
+	{
+		strobj = Heap_Malloc(heap, &t_string, error);
+
+		if(strobj == NULL)
+			return NULL;
+
+		strobj->offset = -1;
+		strobj->body = NULL;
+		strobj->bytes = 0;
+
+		body = Heap_RawMalloc(heap, len+1, error);
+
+		if(body == NULL)
+			return NULL;
+
+		strobj->body = body;
+	}
+
+	strobj->bytes = len;
+	strobj->cursor_index  = 0;
+	strobj->cursor_offset = 0;
+	body[len] = '\0';
+	return strobj;
 }
 
 Object *Object_FromString(const char *str, int len, Heap *heap, Error *error)
@@ -151,21 +495,20 @@ Object *Object_FromString(const char *str, int len, Heap *heap, Error *error)
 		return NULL;
 	}
 
-	StringObject *strobj = Heap_Malloc(heap, &t_string, error);
+	StringObject *strobj = make_flat(len, heap, error);
 
 	if(strobj == NULL)
 		return NULL;
 
-	strobj->body = Heap_RawMalloc(heap, len+1, error);
-	strobj->bytes = len;
-	strobj->count = count;
+	char *body = get_body(strobj);
 
-	if(strobj->body == NULL)
-		return NULL;
+	memcpy(body, str, len);
 
-	memcpy(strobj->body, str, len);
+	strobj->count = count;
 
-	strobj->body[len] = '\0';
+	// The hash is cached since strings are
+	// mostly used as keys of maps.
+	strobj->hash = hashstep(0, (unsigned char*) body, len);
 
 	return (Object*) strobj;
 }
@@ -173,7 +516,7 @@ Object *Object_FromString(const char *str, int len, Heap *heap, Error *error)
 static int count(Object *self)
 {
 	assert(self != NULL);
-	assert(self->type == &t_string);
+	assert(Object_TypeOf(self) == &t_string);
 
 	StringObject *strobj = (StringObject*) self;
 
@@ -183,17 +526,17 @@ static int count(Object *self)
 static int hash(Object *self)
 {
 	assert(self != NULL);
-	assert(self->type == &t_string);
+	assert(Object_TypeOf(self) == &t_string);
 
 	StringObject *strobj = (StringObject*) self;
 
-	return hashbytes((unsigned char*) strobj->body, strobj->count);
+	return hashfinish(strobj->hash, strobj->bytes);
 }
 
 static Object *copy(Object *self, Heap *heap, Error *err)
 {
 	assert(self != NULL);
-	assert(self->type == &t_string);
+	assert(Object_TypeOf(self) == &t_string);
 	assert(heap != NULL);
 	assert(err != NULL);
 
@@ -203,15 +546,46 @@ static Object *copy(Object *self, Heap *heap, Error *err)
 static _Bool op_eql(Object *self, Object *other)
 {
 	assert(self != NULL);
-	assert(self->type == &t_string);
+	assert(Object_TypeOf(self) == &t_string);
 	assert(other != NULL);
-	assert(other->type == &t_string);
+	assert(Object_TypeOf(other) == &t_string);
 
 	StringObject *s1 = (StringObject*) self;
 	StringObject *s2 = (StringObject*) other;
 
-	_Bool match = s1->bytes == s2->bytes && !strncmp(s1->body, s2->body, s1->bytes);
+	if(s1 == s2)
+		return 1;
+
+	// Comparing the hashes first makes different
+	// strings fail without reading their bodies.
+	if(s1->hash != s2->hash || s1->bytes != s2->bytes)
+		return 0;
+
+	if(is_rope(s1))
+	{
+		StringObject *temp = s1;
+		s1 = s2;
+		s2 = temp;
+	}
+
+	if(!is_rope(s1))
+		return match_bytes(s2, get_body(s1));
 
+	// Both are ropes, so one of them is
+	// copied to a contiguous buffer.
+	char *copy = malloc(s1->bytes);
+
+	if(copy == NULL)
+	{
+		for(int i = 0; i < s1->bytes; i += 1)
+			if(byte_at(s1, i) != byte_at(s2, i))
+				return 0;
+		return 1;
+	}
+
+	write_bytes(s1, copy);
+	_Bool match = match_bytes(s2, copy);
+	free(copy);
 	return match;
 }
 
@@ -219,16 +593,235 @@ static void print(Object *obj, FILE *fp)
 {
 	assert(fp != NULL);
 	assert(obj != NULL);
-	assert(obj->type == &t_string);
+	assert(Object_TypeOf(obj) == &t_string);
 
 	StringObject *str = (StringObject*) obj;
 
-	fprintf(fp, "%.*s", str->bytes, str->body);
+	if(!is_rope(str))
+	{
+		fprintf(fp, "%.*s", str->bytes, get_body(str));
+		return;
+	}
+
+	// There's no heap to flatten the rope
+	// with, so it's copied temporarily.
+	char *copy = malloc(str->bytes);
+
+	if(copy == NULL)
+	{
+		for(int i = 0; i < str->bytes; i += 1)
+			fputc(byte_at(str, i), fp);
+		return;
+	}
+
+	write_bytes(str, copy);
+	fwrite(copy, 1, str->bytes, fp);
+	free(copy);
+}
+
+/* Symbol: detach_view
+ *
+ *   Called by the collector on a view it moved. If 
+ *   the view is a small part of its parent, its bytes
+ *   are handed to [callback] as if they were its own
+ *   extension. When the collector copies them, the 
+ *   copy becomes the body of the view, which stops
+ *   referring to the parent. Minor collections don't
+ *   copy the bytes of old parents, so those views 
+ *   are left as they are.
+ */
+static void detach_view(StringObject *str, void (*callback)(void **referer, unsigned int size, void *userp), void *userp)
+{
+	StringObject *parent = (StringObject*) str->parent;
+
+	// The parent may have been moved already, in 
+	// which case its count and bytes were replaced 
+	// by the forwarding address. Its body isn't.
+	if(__atomic_load_n(&parent->base.flags, __ATOMIC_ACQUIRE) & Object_MOVED)
+		parent = (StringObject*) ((MovedObject*) parent)->new_location;
+
+	// Another collector thread may be moving the 
+	// parent, so its size is only a hint.
+	int parent_bytes = __atomic_load_n(&parent->bytes, __ATOMIC_RELAXED);
+
+	if(str->bytes >= MAX_INLINE_STRING || (long long int) str->bytes * MAX_VIEW_FRACTION > parent_bytes)
+		return;
+
+	// The byte that follows the view is in the 
+	// parent too, since its body is zero-terminated.
+	char *bytes = (parent->body == NULL ? parent->data : parent->body) + str->offset;
+	char *copy  = bytes;
+
+	callback((void**) &copy, str->bytes+1, userp);
+
+	if(copy == bytes)
+		return;
+
+	copy[str->bytes] = '\0';
+	str->offset = -1;
+	str->body = copy;
+	str->cursor_index  = 0;
+	str->cursor_offset = 0;
 }
 
 static void walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp)
 {
 	StringObject *str = (StringObject*) self;
 	
-	callback((void**) &str->body, str->bytes+1, userp);
-}
\ No newline at end of file
+	if(is_view(str))
+		detach_view(str, callback, userp);
+	else if(!is_rope(str) && str->body != NULL)
+		callback((void**) &str->body, str->bytes+1, userp);
+}
+
+static void walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp)
+{
+	StringObject *str = (StringObject*) self;
+
+	if(is_view(str))
+		callback(&str->parent, userp);
+	else if(is_rope(str))
+	{
+		callback(&str->left, userp);
+		callback(&str->right, userp);
+	}
+}
+
+static unsigned int get_size(Object *self)
+{
+	StringObject *str = (StringObject*) self;
+
+	if(!is_view(str) && !is_rope(str) && str->body == NULL)
+		return offsetof(StringObject, data) + str->bytes + 1;
+
+	return sizeof(StringObject);
+}
+
+/* Symbol: Object_SliceString
+ *
+ *   Returns the substring of [str] made of [length]
+ *   characters starting from the one at [offset].
+ *   The substring doesn't copy [str] unless it's 
+ *   very short.
+ *
+ * Returns:
+ *   The substring, or NULL on failure.
+ */
+Object *Object_SliceString(Object *str, int offset, int length, Heap *heap, Error *error)
+{
+	if(Object_TypeOf(str) != &t_string)
+	{
+		Error_Report(error, 0, "Not a string");
+		return NULL;
+	}
+
+	StringObject *s = (StringObject*) str;
+
+	if(offset < 0 || offset > s->count)
+	{
+		Error_Report(error, 0, "offset out of range");
+		return NULL;
+	}
+
+	if(length < 0 || offset + length > s->count)
+	{
+		Error_Report(error, 0, "slice out of range");
+		return NULL;
+	}
+
+	if(is_rope(s) && !flatten(s, heap, error))
+		return NULL;
+
+	int start = char_index_to_offset(s, offset);
+	int end   = char_index_to_offset(s, offset + length);
+
+	return make_slice(s, start, end - start, length, heap, error);
+}
+
+static Object *concat_flat(StringObject *left, StringObject *right, Heap *heap, Error *error)
+{
+	StringObject *str = make_flat(left->bytes + right->bytes, heap, error);
+
+	if(str == NULL)
+		return NULL;
+
+	char *body = get_body(str);
+	memcpy(body, get_body(left), left->bytes);
+	memcpy(body + left->bytes, get_body(right), right->bytes);
+
+	str->count = left->count + right->count;
+	str->hash  = hashjoin(left->hash, right->hash, right->bytes);
+	return (Object*) str;
+}
+
+static Object *make_rope(StringObject *left, StringObject *right, Heap *heap, Error *error)
+{
+	StringObject *rope = Heap_Malloc(heap, &t_string, error);
+
+	if(rope == NULL)
+		return NULL;
+
+	rope->count  = left->count + right->count;
+	rope->bytes  = left->bytes + right->bytes;
+	rope->hash   = hashjoin(left->hash, right->hash, right->bytes);
+	rope->offset = ROPE;
+	rope->left   = (Object*) left;
+	rope->right  = (Object*) right;
+	return (Object*) rope;
+}
+
+/* Symbol: Object_ConcatString
+ *
+ *   Returns the concatenation of two strings. Unless
+ *   it's short, the result is a rope that refers to
+ *   the two strings instead of copying them. Ropes
+ *   are flattened the first time they're indexed or
+ *   converted to a C string, so appending to a string
+ *   in a loop takes linear time overall.
+ *
+ * Returns:
+ *   The concatenation, or NULL on failure.
+ */
+Object *Object_ConcatString(Object *left, Object *right, Heap *heap, Error *error)
+{
+	if(Object_TypeOf(left) != &t_string || Object_TypeOf(right) != &t_string)
+	{
+		Error_Report(error, 0, "Not a string");
+		return NULL;
+	}
+
+	StringObject *l = (StringObject*) left;
+	StringObject *r = (StringObject*) right;
+
+	if(r->bytes == 0)
+		return left;
+
+	if(l->bytes == 0)
+		return right;
+
+	if(l->bytes > INT_MAX - 1 - r->bytes)
+	{
+		Error_Report(error, 0, "String is too long");
+		return NULL;
+	}
+
+	if(l->bytes + r->bytes < MAX_FLAT_CONCAT)
+		return concat_flat(l, r, heap, error);
+
+	if(is_rope(l) && r->bytes < MAX_FLAT_CONCAT)
+	{
+		StringObject *last = (StringObject*) l->right;
+
+		if(!is_rope(last) && last->bytes + r->bytes < MAX_FLAT_CONCAT)
+		{
+			Object *merged = concat_flat(last, r, heap, error);
+
+			if(merged == NULL)
+				return NULL;
+
+			return make_rope((StringObject*) l->left, (StringObject*) merged, heap, error);
+		}
+	}
+
+	return make_rope(l, r, heap, error);
+}
@@ -0,0 +1,294 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+*/
+
+#include <assert.h>
+#include <stddef.h>
+#include "../utils/defs.h"
+#include "objects.h"
+
+// Tuples with more elements than this store them
+// in a separate array instead of in the object.
+#define MAX_INLINE_TUPLE 512
+
+typedef struct {
+	Object  base;
+	int     count;
+	int     hash;
+	Object **vals; // NULL when the elements are inline.
+	Object  *items[];
+} TupleObject;
+
+static Object *select(Object *self, Object *key, Heap *heap, Error *err);
+static int     count(Object *self);
+static void    print(Object *obj, FILE *fp);
+static void    walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp);
+static void    walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp);
+static Object *copy(Object *self, Heap *heap, Error *err);
+static int     hash(Object *self);
+static _Bool   op_eql(Object *self, Object *other);
+static unsigned int get_size(Object *self);
+
+TypeObject t_tuple = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_TUPLE,
+	.name = "tuple",
+	.size = sizeof (TupleObject),
+	.get_size = get_size,
+	.copy = copy,
+	.hash = hash,
+	.select = select,
+	.count = count,
+	.print = print,
+	.op_eql = op_eql,
+	.walk = walk,
+	.walkexts = walkexts,
+};
+
+static inline Object **get_vals(TupleObject *tuple)
+{
+	return tuple->vals == NULL ? tuple->items : tuple->vals;
+}
+
+/* Symbol: hash_items
+ *
+ *   Combines the hashes of the elements of a tuple
+ *   using the mixing step of xxHash. Unlike a sum,
+ *   the result depends on the order of the elements,
+ *   so (1, 2) and (2, 1) don't collide.
+ */
+static int hash_items(Object **vals, int num)
+{
+	const unsigned int prime1 = 2654435761U;
+	const unsigned int prime2 = 2246822519U;
+	const unsigned int prime5 = 374761393U;
+
+	unsigned int acc = prime5;
+
+	for(int i = 0; i < num; i += 1)
+	{
+		acc += (unsigned int) Object_Hash(vals[i]) * prime2;
+		acc  = (acc << 13) | (acc >> 19);
+		acc *= prime1;
+	}
+
+	acc += (unsigned int) num ^ prime5;
+	return (int) acc;
+}
+
+/* Symbol: Object_NewTuple
+ *
+ *   Creates a tuple of the [num] objects at [items].
+ *   Tuples can't be modified, so their elements must
+ *   be immutable too. This is what makes it possible
+ *   to compute their hash once and to use a tuple as
+ *   its own copy.
+ *
+ * Returns:
+ *   The new tuple, or NULL on failure.
+ */
+Object *Object_NewTuple(int num, Object **items, Heap *heap, Error *error)
+{
+	assert(num > -1);
+
+	for(int i = 0; i < num; i += 1)
+		if(!Object_IsImmutable(items[i]))
+		{
+			Error_Report(error, 0, "Element #%d of the tuple is a %s, which isn't immutable", i+1, Object_GetName(items[i]));
+			return NULL;
+		}
+
+	TupleObject *tuple;
+	Object **vals;
+
+	if(num <= MAX_INLINE_TUPLE)
+	{
+		tuple = Heap_MallocSized(heap, &t_tuple, offsetof(TupleObject, items) + num * sizeof(Object*), error);
+
+		if(tuple == NULL)
+			return NULL;
+
+		tuple->vals = NULL;
+		vals = tuple->items;
+	}
+	else
+	{
+		tuple = Heap_Malloc(heap, &t_tuple, error);
+
+		if(tuple == NULL)
+			return NULL;
+
+		tuple->count = 0;
+		tuple->vals = NULL;
+
+		vals = Heap_RawMalloc(heap, num * sizeof(Object*), error);
+
+		if(vals == NULL)
+			return NULL;
+
+		tuple->vals = vals;
+	}
+
+	for(int i = 0; i < num; i += 1)
+		vals[i] = items[i];
+
+	tuple->count = num;
+	tuple->hash  = hash_items(vals, num);
+	return (Object*) tuple;
+}
+
+static int hash(Object *self)
+{
+	assert(self != NULL);
+	assert(Object_TypeOf(self) == &t_tuple);
+
+	TupleObject *tuple = (TupleObject*) self;
+
+	return tuple->hash;
+}
+
+static Object *copy(Object *self, Heap *heap, Error *err)
+{
+	(void) heap;
+	(void) err;
+	return self;
+}
+
+static _Bool op_eql(Object *self, Object *other)
+{
+	assert(self != NULL);
+	assert(Object_TypeOf(self) == &t_tuple);
+	assert(other != NULL);
+	assert(Object_TypeOf(other) == &t_tuple);
+
+	TupleObject *t1 = (TupleObject*) self;
+	TupleObject *t2 = (TupleObject*) other;
+
+	if(t1 == t2)
+		return 1;
+
+	// Comparing the hashes first makes different
+	// tuples fail without comparing the elements.
+	if(t1->hash != t2->hash || t1->count != t2->count)
+		return 0;
+
+	Object **vals1 = get_vals(t1);
+	Object **vals2 = get_vals(t2);
+
+	for(int i = 0; i < t1->count; i += 1)
+	{
+		Object *a = vals1[i];
+		Object *b = vals2[i];
+
+		// The elements are immutable, so 
+		// they all implement [op_eql].
+		if(a != b && (a->type_index != b->type_index || !Object_TypeOf(a)->op_eql(a, b)))
+			return 0;
+	}
+
+	return 1;
+}
+
+static Object *select(Object *self, Object *key, Heap *heap, Error *error)
+{
+	assert(self != NULL);
+	assert(Object_TypeOf(self) == &t_tuple);
+	assert(key != NULL);
+	assert(heap != NULL);
+	assert(error != NULL);
+
+	if(!Object_IsInt(key))
+	{
+		Error_Report(error, 0, "Non integer key");
+		return NULL;
+	}
+
+	int idx = Object_ToInt(key, error);
+	assert(error->occurred == 0);
+
+	TupleObject *tuple = (TupleObject*) self;
+
+	if(idx < 0 || idx >= tuple->count)
+	{
+		Error_Report(error, 0, "Out of range index");
+		return NULL;
+	}
+
+	return get_vals(tuple)[idx];
+}
+
+static int count(Object *self)
+{
+	TupleObject *tuple = (TupleObject*) self;
+
+	return tuple->count;
+}
+
+static void print(Object *self, FILE *fp)
+{
+	TupleObject *tuple = (TupleObject*) self;
+	Object **vals = get_vals(tuple);
+
+	fprintf(fp, "(");
+	for(int i = 0; i < tuple->count; i += 1)
+	{
+		Object_Print(vals[i], fp);
+
+		if(i+1 < tuple->count)
+			fprintf(fp, ", ");
+	}
+	fprintf(fp, ")");
+}
+
+static void walk(Object *self, void (*callback)(Object **referer, void *userp), void *userp)
+{
+	TupleObject *tuple = (TupleObject*) self;
+	Object **vals = get_vals(tuple);
+
+	for(int i = 0; i < tuple->count; i += 1)
+		callback(&vals[i], userp);
+}
+
+static void walkexts(Object *self, void (*callback)(void **referer, unsigned int size, void *userp), void *userp)
+{
+	TupleObject *tuple = (TupleObject*) self;
+
+	if(tuple->vals != NULL)
+		callback((void**) &tuple->vals, tuple->count * sizeof(Object*), userp);
+}
+
+static unsigned int get_size(Object *self)
+{
+	TupleObject *tuple = (TupleObject*) self;
+
+	if(tuple->vals == NULL)
+		return offsetof(TupleObject, items) + tuple->count * sizeof(Object*);
+
+	return sizeof(TupleObject);
+}
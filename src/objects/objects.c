@@ -34,8 +34,41 @@
 
 static _Bool op_eql(Object *self, Object *other);
 
+extern TypeObject t_none, t_bool, t_int, t_float, t_string, 
+				  t_list, t_map, t_buffer, t_buffer_slice, 
+				  t_file, t_dir, t_closure, t_func, t_nfunc,
+				  t_staticmap, t_tuple;
+
+/* Symbol: Object_Types
+ *
+ *   The table of all types, indexed by the
+ *   [type_index] field of the object headers.
+ *   New types must be given an index in the
+ *   [TypeIndex] enumeration and be added here.
+ */
+TypeObject *Object_Types[TYPE_COUNT] = {
+	[TYPE_TYPE]   = &t_type,
+	[TYPE_NONE]   = &t_none,
+	[TYPE_BOOL]   = &t_bool,
+	[TYPE_INT]    = &t_int,
+	[TYPE_FLOAT]  = &t_float,
+	[TYPE_STRING] = &t_string,
+	[TYPE_LIST]   = &t_list,
+	[TYPE_MAP]    = &t_map,
+	[TYPE_BUFFER] = &t_buffer,
+	[TYPE_BUFFER_SLICE] = &t_buffer_slice,
+	[TYPE_FILE]    = &t_file,
+	[TYPE_DIR]     = &t_dir,
+	[TYPE_CLOSURE] = &t_closure,
+	[TYPE_FUNC]    = &t_func,
+	[TYPE_NFUNC]   = &t_nfunc,
+	[TYPE_STATICMAP] = &t_staticmap,
+	[TYPE_TUPLE]   = &t_tuple,
+};
+
 TypeObject t_type = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_TYPE,
 	.name = "type",
 	.size = sizeof (TypeObject),
 	.op_eql = op_eql,
@@ -62,8 +95,8 @@ const char *Object_GetName(const Object *obj)
 const TypeObject *Object_GetType(const Object *obj)
 {
 	assert(obj != NULL);
-	assert(obj->type != NULL);
-	return obj->type;
+	assert(obj->type_index < TYPE_COUNT);
+	return Object_TypeOf(obj);
 }
 
 unsigned int Object_GetSize(const Object *obj, Error *err)
@@ -74,6 +107,9 @@ unsigned int Object_GetSize(const Object *obj, Error *err)
 	const TypeObject *type = Object_GetType(obj);
 	assert(type);
 
+	if(type->get_size != NULL)
+		return type->get_size((Object*) obj);
+
 	return type->size;
 }
 
@@ -257,29 +293,29 @@ Object *Object_Prev(Object *iter, Heap *heap, Error *err)
 _Bool Object_IsInt(Object *obj)
 {
 	assert(obj != NULL);
-	assert(obj->type != NULL);
-	return obj->type->atomic == ATMTP_INT;
+	assert(obj->type_index < TYPE_COUNT);
+	return Object_TypeOf(obj)->atomic == ATMTP_INT;
 }
 
 _Bool Object_IsBool(Object *obj)
 {
 	assert(obj != NULL);
-	assert(obj->type != NULL);
-	return obj->type->atomic == ATMTP_BOOL;
+	assert(obj->type_index < TYPE_COUNT);
+	return Object_TypeOf(obj)->atomic == ATMTP_BOOL;
 }
 
 _Bool Object_IsFloat(Object *obj)
 {
 	assert(obj != NULL);
-	assert(obj->type != NULL);
-	return obj->type->atomic == ATMTP_FLOAT;
+	assert(obj->type_index < TYPE_COUNT);
+	return Object_TypeOf(obj)->atomic == ATMTP_FLOAT;
 }
 
 _Bool Object_IsString(Object *obj)
 {
 	assert(obj != NULL);
-	assert(obj->type != NULL);
-	return obj->type->atomic == ATMTP_STRING;
+	assert(obj->type_index < TYPE_COUNT);
+	return Object_TypeOf(obj)->atomic == ATMTP_STRING;
 }
 
 long long int Object_ToInt(Object *obj, Error *err)
@@ -380,28 +416,28 @@ _Bool Object_Compare(Object *obj1, Object *obj2, Error *error)
 	assert(obj2 != NULL);
 	assert(error != NULL);
 
-	if(obj1->type != obj2->type)
+	if(obj1->type_index != obj2->type_index)
 		return 0;
 
-	if(obj1->type->op_eql == NULL)
+	if(Object_TypeOf(obj1)->op_eql == NULL)
 	{
 		Error_Report(error, 0, "Object %s doesn't implement %s", Object_GetName(obj1), __func__);
 		return 0;
 	}
 
-	return obj1->type->op_eql(obj1, obj2);
+	return Object_TypeOf(obj1)->op_eql(obj1, obj2);
 }
 
 void Object_WalkReferences(Object *parent, void (*callback)(Object **referer, void *userp), void *userp)
 {
 	assert(parent != NULL);
-	if(parent->type->walk != NULL)
-		parent->type->walk(parent, callback, userp);
+	if(Object_TypeOf(parent)->walk != NULL)
+		Object_TypeOf(parent)->walk(parent, callback, userp);
 }
 
 void Object_WalkExtensions(Object *parent, void (*callback)(void **referer, unsigned int size, void *userp), void *userp)
 {
 	assert(parent != NULL);
-	if(parent->type->walkexts != NULL)
-		parent->type->walkexts(parent, callback, userp);
+	if(Object_TypeOf(parent)->walkexts != NULL)
+		Object_TypeOf(parent)->walkexts(parent, callback, userp);
 }
\ No newline at end of file
@@ -39,8 +39,33 @@ typedef struct TypeObject TypeObject;
 typedef struct Object Object;
 typedef struct xHeap Heap;
 
+// The index of each type in the [Object_Types]
+// table. It's stored in the object headers in
+// place of a pointer to the type, so that they
+// fit in 8 bytes.
+typedef enum {
+	TYPE_TYPE,
+	TYPE_NONE,
+	TYPE_BOOL,
+	TYPE_INT,
+	TYPE_FLOAT,
+	TYPE_STRING,
+	TYPE_LIST,
+	TYPE_MAP,
+	TYPE_BUFFER,
+	TYPE_BUFFER_SLICE,
+	TYPE_FILE,
+	TYPE_DIR,
+	TYPE_CLOSURE,
+	TYPE_FUNC,
+	TYPE_NFUNC,
+	TYPE_STATICMAP,
+	TYPE_TUPLE,
+	TYPE_COUNT,
+} TypeIndex;
+
 struct Object {
-	TypeObject *type;
+	unsigned int type_index;
 	unsigned int flags;
 };
 
@@ -49,6 +74,13 @@ typedef struct {
 	Object *new_location;
 } MovedObject;
 
+// The layout of ints is public so that the code
+// generated by the JIT can read them inline.
+typedef struct {
+	Object base;
+	long long int val;
+} IntObject;
+
 typedef enum {
 	ATMTP_NOTATOMIC = 0,
 	ATMTP_INT,
@@ -62,8 +94,18 @@ struct TypeObject {
 	Object base;
 	
 	// Any.	
+	TypeIndex    index;
 	const char  *name;
 	unsigned int size;
+
+	// Size of the objects of variable size. When
+	// it's not set, all objects are [size] bytes.
+	unsigned int (*get_size)(Object *self);
+
+	// Size of the objects allocated by the inline
+	// fast path of [Heap_Malloc], or 0 if they must
+	// take the slow path. It's set by the heap.
+	int fast_size;
 	AtomicType   atomic;
 
 	_Bool 	(*init)(Object *self, Error *err);
@@ -102,19 +144,37 @@ struct TypeObject {
 enum {
 	Object_STATIC = 1,
 	Object_MOVED  = 2,
+	Object_REMEMBERED = 4,
 };
 
+// The part of the heap used by the inline fast 
+// path of [Heap_Malloc].
+typedef struct {
+	char *nursery;
+	int   used;
+	int   limit;
+	int   total;
+	int   objcount;
+} HeapYoung;
+
 Heap*		 Heap_New(int size);
 void		 Heap_Free(Heap *heap);
-void*		 Heap_Malloc   (Heap *heap, TypeObject *type, Error *err);
+void*		 Heap_SlowMalloc(Heap *heap, TypeObject *type, int size, Error *err);
 void*		 Heap_RawMalloc(Heap *heap, int size, Error *err);
+_Bool        Heap_SetImmortal(Heap *heap, _Bool immortal);
 _Bool 	 	 Heap_StartCollection(Heap *heap, Error *error);
 _Bool 	  	 Heap_StopCollection(Heap *heap);
+_Bool        Heap_RunDestructors(Heap *heap, Error *error);
 void  	 	 Heap_CollectReference(Object **referer, void *heap);
+void         Heap_WriteBarrier(Heap *heap, Object *obj);
 float 		 Heap_GetUsagePercentage(Heap *heap);
 unsigned int Heap_GetObjectCount(Heap *heap);
-void        *Heap_GetPointer(Heap *heap);
 unsigned int Heap_GetSize(Heap *heap);
+void         Heap_SetSizeLimits(Heap *heap, int min_size, int max_size, int occupancy);
+void         Heap_SetCollectorThreads(Heap *heap, int threads);
+void         Heap_SetPauseBudget(Heap *heap, int usecs);
+int          Heap_GetPauseBudget(Heap *heap);
+int          Heap_GetMaxPause(Heap *heap);
 
 const TypeObject* Object_GetType(const Object *obj);
 const char*	 Object_GetName(const Object *obj);
@@ -137,6 +197,7 @@ void 		 Object_WalkExtensions(Object *parent, void (*callback)(void   **referer,
 Object*		 Object_NewMap(int num, Heap *heap, Error *error);
 Object*		 Object_NewList(int capacity, Heap *heap, Error *error);
 Object*		 Object_NewList2(int num, Object **items, Heap *heap, Error *error);
+Object*		 Object_NewTuple(int num, Object **items, Heap *heap, Error *error);
 Object*		 Object_NewNone(Heap *heap, Error *error);
 Object*		 Object_NewBuffer(int size, Heap *heap, Error *error);
 Object*		 Object_NewClosure(Object *parent, Object *new_map, Heap *heap, Error *error);
@@ -146,6 +207,8 @@ Object*		 Object_FromInt   (long long int val, Heap *heap, Error *error);
 Object*		 Object_FromBool  (_Bool		 val, Heap *heap, Error *error);
 Object*		 Object_FromFloat (double 		 val, Heap *heap, Error *error);
 Object*		 Object_FromString(const char *str, int len, Heap *heap, Error *error);
+Object*		 Object_SliceString(Object *str, int offset, int length, Heap *heap, Error *error);
+Object*		 Object_ConcatString(Object *left, Object *right, Heap *heap, Error *error);
 Object*		 Object_FromStream(FILE *fp, Heap *heap, Error *error);
 Object* 	 Object_FromDIR(DIR *handle, Heap *heap, Error *error);
 
@@ -163,10 +226,91 @@ _Bool 		  Object_ToBool (Object *obj, Error *err);
 double		  Object_ToFloat(Object *obj, Error *err);
 const char	 *Object_ToString(Object *obj, int *size, Heap *heap, Error *err);
 DIR    		 *Object_ToDIR(Object *obj, Error *error);
+
+// Unchecked versions of Object_ToInt and Object_ToFloat
+// for objects that are already known to be ints or floats.
+long long int Object_GetInt  (Object *obj);
+double		  Object_GetFloat(Object *obj);
 FILE   		 *Object_ToStream(Object *obj, Error *error);
 
 _Bool 		  Object_Compare(Object *obj1, Object *obj2, Error *error);
 
 
 extern TypeObject t_type;
+extern TypeObject *Object_Types[TYPE_COUNT];
+
+static inline TypeObject *Object_TypeOf(const Object *obj)
+{
+	return Object_Types[obj->type_index];
+}
+
+/* Symbol: Object_IsImmutable
+ *
+ *   Returns true for objects that can't be modified,
+ *   which are their own copy. Containers use it to
+ *   know whether their copies can share elements.
+ */
+static inline _Bool Object_IsImmutable(const Object *obj)
+{
+	return Object_TypeOf(obj)->atomic != ATMTP_NOTATOMIC 
+		|| obj->type_index == TYPE_NONE
+		|| obj->type_index == TYPE_TUPLE;
+}
+
+/* Symbol: Heap_Malloc
+ *
+ *   Allocates an object of the given type. Objects
+ *   without destructors are bump-allocated from the
+ *   nursery here, and the rest (or the allocations
+ *   that don't fit) go through [Heap_SlowMalloc].
+ *
+ * Returns:
+ *   The new object, or NULL on failure.
+ */
+static inline void *Heap_Malloc(Heap *heap, TypeObject *type, Error *err)
+{
+	// The heap starts with its [HeapYoung].
+	HeapYoung *young = (HeapYoung*) heap;
+
+	int size = type->fast_size;
+
+	if(size == 0 || young->used + size > young->limit)
+		return Heap_SlowMalloc(heap, type, type->size, err);
+
+	Object *obj = (Object*) (young->nursery + young->used);
+	young->used  += size;
+	young->total += size;
+	young->objcount += 1;
+
+	obj->type_index = type->index;
+	obj->flags = 0;
+	return obj;
+}
+
+/* Symbol: Heap_MallocSized
+ *
+ *   Like [Heap_Malloc], but for objects of variable
+ *   size. The type must have a [get_size] method
+ *   that returns [size] for the new object.
+ */
+static inline void *Heap_MallocSized(Heap *heap, TypeObject *type, int size, Error *err)
+{
+	HeapYoung *young = (HeapYoung*) heap;
+
+	if(size < (int) sizeof(MovedObject))
+		size = sizeof(MovedObject);
+	size = (size + 7) & ~7;
+
+	if(type->fast_size == 0 || young->used + size > young->limit)
+		return Heap_SlowMalloc(heap, type, size, err);
+
+	Object *obj = (Object*) (young->nursery + young->used);
+	young->used  += size;
+	young->total += size;
+	young->objcount += 1;
+
+	obj->type_index = type->index;
+	obj->flags = 0;
+	return obj;
+}
 #endif
\ No newline at end of file
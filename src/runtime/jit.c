@@ -0,0 +1,789 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+** |                                                                          | 
+** |                          WHAT IS THIS FILE?                              |
+** | This is the implementation of the baseline JIT compiler. It translates   |
+** | hot noja functions into x86-64 machine code that the runtime can execute |
+** | in place of the `step` loop.                                             |
+** |                                                                          |
+** |                          HOW DOES IT WORK?                               |
+** | The runtime reports to the JIT every time a function is entered and every|
+** | time one of its loops jumps backwards by calling `JIT_Tick`. When the    |
+** | number of reports for a function passes a threshold, the instructions    |
+** | reachable from the function's entry point are translated.                |
+** |                                                                          |
+** | Every instruction is translated using a template chosen by its opcode,   |
+** | with the operands decoded once at translation time:                      |
+** |   - Arithmetic (ADD, SUB, MUL) and comparisons on ints run inline: the   |
+** |     code checks the type index of the operands on top of the stack and,  |
+** |     if they're ints, adds or compares their values. Comparisons replace  |
+** |     the operands with a boolean without calling anything, arithmetic     |
+** |     calls `Runtime_ExecIntResult` to allocate the result. The checks are |
+** |     omitted for the instructions the compiler proved to operate on ints. |
+** |     When the operands aren't ints, or a profile is being recorded, the   |
+** |     instruction is executed like the following ones;                     |
+** |   - The generic arithmetic instructions, CALL, SELECT and INSERT call    |
+** |     the runtime's entry point for that instruction, which goes straight  |
+** |     to `do_math_op`, `Object_Call`, `Object_Select` or `Object_Insert`;  |
+** |   - The rest call `Runtime_ExecInstr`, which dispatches on the opcode.   |
+** | Jumps are translated to native jumps, so `JUMP` and `NOPE` cost nothing  |
+** | and conditional jumps only cost a comparison on the index returned by    |
+** | `Runtime_ExecInstr`. The layout of the runtime, of the stack and of ints |
+** | is read from `runtimei.h`, `stacki.h` and `objects.h`.                   |
+** |                                                                          |
+** | The generated code has a label for each instruction, which means that    |
+** | the execution can be moved from the interpreter to the machine code at   |
+** | any point of the function (which is needed when a loop becomes hot while |
+** | it's running).                                                           |
+** |                                                                          |
+** | The code is written to pages obtained with `mmap`, which are made        |
+** | executable (and read-only) after the translation. On platforms other than|
+** | x86-64 unix systems `JIT_New` fails and the runtime keeps interpreting.  |
+** +--------------------------------------------------------------------------+
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "../utils/defs.h"
+#include "../utils/stacki.h"
+#include "runtimei.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_SUPPORTED 1
+#include <unistd.h>
+#include <sys/mman.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+#define MAX_OPS 3
+#define HOT_THRESHOLD 1000
+
+struct xJITFunction {
+	Executable *exe;
+	int         entry;
+	int        *labels;
+	Operand    *ops;
+	unsigned char *code;
+	int            mapped;
+};
+
+typedef struct {
+	Executable  *exe;
+	int          entry;
+	int          hits;
+	_Bool        failed;
+	JITFunction *func;
+} JITSlot;
+
+struct xJIT {
+	int      size, used;
+	JITSlot *slots;
+};
+
+JIT *JIT_New(void)
+{
+#if JIT_SUPPORTED
+	JIT *jit = malloc(sizeof(JIT));
+
+	if(jit == NULL)
+		return NULL;
+
+	jit->size = 32;
+	jit->used = 0;
+	jit->slots = calloc(jit->size, sizeof(JITSlot));
+
+	if(jit->slots == NULL)
+	{
+		free(jit);
+		return NULL;
+	}
+
+	return jit;
+#else
+	return NULL;
+#endif
+}
+
+static void free_function(JITFunction *func)
+{
+#if JIT_SUPPORTED
+	munmap(func->code, func->mapped);
+#endif
+	Executable_Free(func->exe);
+	free(func->labels);
+	free(func->ops);
+	free(func);
+}
+
+void JIT_Free(JIT *jit)
+{
+	for(int i = 0; i < jit->size; i += 1)
+		if(jit->slots[i].func != NULL)
+			free_function(jit->slots[i].func);
+
+	free(jit->slots);
+	free(jit);
+}
+
+static unsigned int hash_slot(Executable *exe, int entry)
+{
+	return (unsigned int) ((uintptr_t) exe >> 4) * 31 + entry;
+}
+
+static JITSlot *find_slot(JITSlot *slots, int size, Executable *exe, int entry)
+{
+	unsigned int mask = size - 1;
+	unsigned int i = hash_slot(exe, entry) & mask;
+
+	while(slots[i].exe != NULL && (slots[i].exe != exe || slots[i].entry != entry))
+		i = (i + 1) & mask;
+
+	return slots + i;
+}
+
+static _Bool grow(JIT *jit)
+{
+	int new_size = jit->size * 2;
+
+	JITSlot *new_slots = calloc(new_size, sizeof(JITSlot));
+
+	if(new_slots == NULL)
+		return 0;
+
+	for(int i = 0; i < jit->size; i += 1)
+		if(jit->slots[i].exe != NULL)
+		{
+			JITSlot *slot = find_slot(new_slots, new_size, jit->slots[i].exe, jit->slots[i].entry);
+			*slot = jit->slots[i];
+		}
+
+	free(jit->slots);
+	jit->slots = new_slots;
+	jit->size = new_size;
+	return 1;
+}
+
+#if JIT_SUPPORTED
+
+typedef struct {
+	unsigned char *data; // NULL when only measuring.
+	int size;
+} Emitter;
+
+static void emit8(Emitter *e, unsigned char byte)
+{
+	if(e->data != NULL)
+		e->data[e->size] = byte;
+	e->size += 1;
+}
+
+static void emit32(Emitter *e, uint32_t word)
+{
+	if(e->data != NULL)
+		memcpy(e->data + e->size, &word, sizeof(word));
+	e->size += sizeof(word);
+}
+
+static void emit64(Emitter *e, uint64_t word)
+{
+	if(e->data != NULL)
+		memcpy(e->data + e->size, &word, sizeof(word));
+	e->size += sizeof(word);
+}
+
+static void emit_bytes(Emitter *e, const unsigned char *bytes, int count)
+{
+	if(e->data != NULL)
+		memcpy(e->data + e->size, bytes, count);
+	e->size += count;
+}
+
+// Emits a 32 bit displacement relative to the end
+// of the instruction, which is assumed to be the
+// end of the displacement itself.
+static void emit_rel32(Emitter *e, int target)
+{
+	emit32(e, (uint32_t) (target - (e->size + 4)));
+}
+
+// Emits the displacement of a forward jump whose
+// target isn't known yet. The returned position
+// is passed to [resolve_rel32] once it's known.
+static int emit_forward_rel32(Emitter *e)
+{
+	int pos = e->size;
+	emit32(e, 0);
+	return pos;
+}
+
+// Makes the forward jump at [pos] land here.
+static void resolve_rel32(Emitter *e, int pos)
+{
+	uint32_t rel = e->size - (pos + 4);
+
+	if(e->data != NULL)
+		memcpy(e->data + pos, &rel, sizeof(rel));
+}
+
+enum {
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+};
+
+// Condition codes of Jcc, SETcc and CMOVcc.
+enum {
+	CC_E  = 0x4,
+	CC_NE = 0x5,
+	CC_L  = 0xC,
+	CC_GE = 0xD,
+	CC_LE = 0xE,
+	CC_G  = 0xF,
+};
+
+// Emits an instruction with a [base + disp] memory
+// operand. Only the registers from RAX to RDI can be
+// used and [base] can't be RSP.
+static void emit_mem(Emitter *e, _Bool wide, unsigned char opcode, int reg, int base, int disp)
+{
+	assert(base != RSP);
+
+	if(wide)
+		emit8(e, 0x48); // REX.W
+	emit8(e, opcode);
+	emit8(e, 0x80 | (reg << 3) | base); // mod=10: disp32
+	emit32(e, disp);
+}
+
+// Like [emit_mem], but the operand is [base + index*8 + disp].
+static void emit_mem_index(Emitter *e, _Bool wide, unsigned char opcode, int reg, int base, int index, int disp)
+{
+	if(wide)
+		emit8(e, 0x48); // REX.W
+	emit8(e, opcode);
+	emit8(e, 0x84 | (reg << 3));            // mod=10, rm=100: SIB + disp32
+	emit8(e, 0xC0 | (index << 3) | base); // scale=8
+	emit32(e, disp);
+}
+
+// Emits a jump to a position that isn't known yet.
+static int emit_jcc_forward(Emitter *e, int cc)
+{
+	emit8(e, 0x0F); emit8(e, 0x80 | cc);
+	return emit_forward_rel32(e);
+}
+
+static void load_args(Emitter *e, int index)
+{
+	static const unsigned char bytes[] = {
+		0x48, 0x89, 0xDF, // mov rdi, rbx
+		0x4C, 0x89, 0xE6, // mov rsi, r12
+	};
+
+	emit_bytes(e, bytes, sizeof(bytes));
+	emit8(e, 0xBA); emit32(e, index); // mov edx, index
+}
+
+static void call_function(Emitter *e, void *func)
+{
+	emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (uintptr_t) func); // mov rax, func
+	emit8(e, 0xFF); emit8(e, 0xD0); // call rax
+}
+
+// Leaves the function if the call returned -1.
+static void check_result(Emitter *e, int exit_label)
+{
+	emit8(e, 0x85); emit8(e, 0xC0); // test eax, eax
+	emit8(e, 0x0F); emit8(e, 0x88); // js exit
+	emit_rel32(e, exit_label);
+}
+
+static void emit_call(Emitter *e, int index, Opcode opcode, Operand *ops, int opc)
+{
+	load_args(e, index);
+	emit8(e, 0xB9); emit32(e, opcode); // mov ecx, opcode
+	emit8(e, 0x49); emit8(e, 0xB8); emit64(e, (uintptr_t) ops); // mov r8, ops
+	emit8(e, 0x41); emit8(e, 0xB9); emit32(e, opc);             // mov r9d, opc
+	call_function(e, Runtime_ExecInstr);
+}
+
+// Calls one of the runtime's entry points for
+// specific instructions, which take the index
+// and up to two integer arguments.
+static void emit_call_entry(Emitter *e, void *func, int index, int arg0, int arg1)
+{
+	load_args(e, index);
+	emit8(e, 0xB9); emit32(e, arg0);             // mov ecx, arg0
+	emit8(e, 0x41); emit8(e, 0xB8); emit32(e, arg1); // mov r8d, arg1
+	call_function(e, func);
+}
+
+typedef enum {
+	INTOP_NONE,
+	INTOP_ADD,
+	INTOP_SUB,
+	INTOP_MUL,
+	INTOP_CMP,
+} IntOp;
+
+// Tells how an instruction can be executed inline 
+// when its operands are ints. The [guarded] flag is
+// false when the compiler proved the types, and [cc]
+// is the condition code of comparisons.
+static IntOp get_int_op(Opcode opcode, _Bool *guarded, int *cc)
+{
+	switch(opcode)
+	{
+		case OPCODE_ADDI: case OPCODE_SUBI: case OPCODE_MULI:
+		case OPCODE_LSSI: case OPCODE_GRTI: case OPCODE_LEQI: case OPCODE_GEQI:
+		*guarded = 0;
+		break;
+
+		case OPCODE_ADD: case OPCODE_SUB: case OPCODE_MUL:
+		case OPCODE_LSS: case OPCODE_GRT: case OPCODE_LEQ: case OPCODE_GEQ:
+		case OPCODE_EQL: case OPCODE_NQL:
+		case OPCODE_ADDGI: case OPCODE_SUBGI: case OPCODE_MULGI:
+		case OPCODE_LSSGI: case OPCODE_GRTGI: case OPCODE_LEQGI: case OPCODE_GEQGI:
+		*guarded = 1;
+		break;
+
+		default: 
+		return INTOP_NONE;
+	}
+
+	switch(Executable_GetGenericOpcode(opcode))
+	{
+		case OPCODE_ADD: return INTOP_ADD;
+		case OPCODE_SUB: return INTOP_SUB;
+		case OPCODE_MUL: return INTOP_MUL;
+		case OPCODE_LSS: *cc = CC_L;  return INTOP_CMP;
+		case OPCODE_GRT: *cc = CC_G;  return INTOP_CMP;
+		case OPCODE_LEQ: *cc = CC_LE; return INTOP_CMP;
+		case OPCODE_GEQ: *cc = CC_GE; return INTOP_CMP;
+		case OPCODE_EQL: *cc = CC_E;  return INTOP_CMP;
+		case OPCODE_NQL: *cc = CC_NE; return INTOP_CMP;
+		default: break;
+	}
+	UNREACHABLE;
+	return INTOP_NONE;
+}
+
+// Emits the inline version of an operation on ints.
+// The returned jumps must be resolved to the code
+// that executes the instruction in the general case,
+// which is reached when the operands aren't ints or
+// the runtime is recording a profile.
+static int emit_int_op(Emitter *e, int index, IntOp op, _Bool guarded, int cc, int exit_label, int *slow)
+{
+	int count = 0;
+
+	emit_mem(e, 1, 0x8B, RDX, RBX, offsetof(Runtime, frame)); // mov rdx, runtime->frame
+	emit_mem(e, 0, 0x83, 7, RDX, offsetof(Frame, used));      // cmp dword frame->used, 2
+	emit8(e, 2);
+	slow[count++] = emit_jcc_forward(e, CC_L);
+
+	if(guarded)
+	{
+		emit_mem(e, 1, 0x83, 7, RBX, offsetof(Runtime, profile)); // cmp qword runtime->profile, 0
+		emit8(e, 0);
+		slow[count++] = emit_jcc_forward(e, CC_NE);
+	}
+
+	emit_mem(e, 1, 0x8B, RAX, RBX, offsetof(Runtime, stack)); // mov rax, runtime->stack
+	emit_mem(e, 0, 0x8B, RCX, RAX, offsetof(Stack, used));    // mov ecx, stack->used
+	emit_mem_index(e, 1, 0x8B, RSI, RAX, RCX, offsetof(Stack, body) - 8);  // mov rsi, rop
+	emit_mem_index(e, 1, 0x8B, RDI, RAX, RCX, offsetof(Stack, body) - 16); // mov rdi, lop
+
+	if(guarded)
+	{
+		emit_mem(e, 0, 0x81, 7, RSI, offsetof(Object, type_index)); // cmp dword rop->type_index, TYPE_INT
+		emit32(e, TYPE_INT);
+		slow[count++] = emit_jcc_forward(e, CC_NE);
+		emit_mem(e, 0, 0x81, 7, RDI, offsetof(Object, type_index)); // cmp dword lop->type_index, TYPE_INT
+		emit32(e, TYPE_INT);
+		slow[count++] = emit_jcc_forward(e, CC_NE);
+	}
+
+	emit_mem(e, 1, 0x8B, RSI, RSI, offsetof(IntObject, val)); // mov rsi, rop->val
+	emit_mem(e, 1, 0x8B, RDI, RDI, offsetof(IntObject, val)); // mov rdi, lop->val
+
+	if(op == INTOP_CMP)
+	{
+		// The result is one of the two booleans, which
+		// replaces the operands without allocating.
+		emit8(e, 0x48); emit8(e, 0x39); emit8(e, 0xF7); // cmp rdi, rsi
+		emit8(e, 0x48); emit8(e, 0xBE); emit64(e, (uintptr_t) Object_FromBool(0, NULL, NULL)); // mov rsi, false
+		emit8(e, 0x48); emit8(e, 0xBF); emit64(e, (uintptr_t) Object_FromBool(1, NULL, NULL)); // mov rdi, true
+		emit8(e, 0x48); emit8(e, 0x0F); emit8(e, 0x40 | cc); emit8(e, 0xF7);  // cmovcc rsi, rdi
+		emit_mem_index(e, 1, 0x89, RSI, RAX, RCX, offsetof(Stack, body) - 16); // mov lop, rsi
+		emit_mem(e, 0, 0x83, 5, RAX, offsetof(Stack, used)); // sub dword stack->used, 1
+		emit8(e, 1);
+		emit_mem(e, 0, 0x83, 5, RDX, offsetof(Frame, used)); // sub dword frame->used, 1
+		emit8(e, 1);
+	}
+	else
+	{
+		// The result needs to be allocated, which is
+		// left to the runtime.
+		switch(op)
+		{
+			case INTOP_ADD: emit8(e, 0x48); emit8(e, 0x01); emit8(e, 0xF7); break; // add rdi, rsi
+			case INTOP_SUB: emit8(e, 0x48); emit8(e, 0x29); emit8(e, 0xF7); break; // sub rdi, rsi
+			case INTOP_MUL: emit8(e, 0x48); emit8(e, 0x0F); emit8(e, 0xAF); emit8(e, 0xFE); break; // imul rdi, rsi
+			default: UNREACHABLE; break;
+		}
+		emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xF9); // mov rcx, rdi
+		load_args(e, index);
+		call_function(e, Runtime_ExecIntResult);
+		check_result(e, exit_label);
+	}
+
+	return count;
+}
+
+// Emits the code of the instruction at [index]. When
+// [e] has no data it's only measured.
+static void emit_instr(Emitter *e, JITFunction *func, int index, Opcode opcode, Operand *ops, int opc, int exit_label)
+{
+	_Bool guarded = 0;
+	int cc = 0;
+	IntOp int_op = get_int_op(opcode, &guarded, &cc);
+
+	if(int_op != INTOP_NONE)
+	{
+		int slow[4];
+		int slowc = emit_int_op(e, index, int_op, guarded, cc, exit_label, slow);
+
+		emit8(e, 0xE9); // jmp done
+		int done = emit_forward_rel32(e);
+
+		for(int i = 0; i < slowc; i += 1)
+			resolve_rel32(e, slow[i]);
+
+		if(opcode == OPCODE_ADD || opcode == OPCODE_SUB || opcode == OPCODE_MUL || opcode == OPCODE_LSS 
+		|| opcode == OPCODE_GRT || opcode == OPCODE_LEQ || opcode == OPCODE_GEQ)
+			emit_call_entry(e, Runtime_ExecMathOp, index, opcode, 0);
+		else
+			emit_call(e, index, opcode, ops, opc);
+		check_result(e, exit_label);
+
+		resolve_rel32(e, done);
+		return;
+	}
+
+	switch(opcode)
+	{
+		case OPCODE_NOPE:
+		break;
+
+		case OPCODE_JUMP:
+		emit8(e, 0xE9); // jmp target
+		emit_rel32(e, func->labels[ops[0].as_int]);
+		break;
+
+		case OPCODE_RETURN:
+		emit_call(e, index, opcode, ops, opc);
+		emit8(e, 0xE9); // jmp exit
+		emit_rel32(e, exit_label);
+		break;
+
+		case OPCODE_JUMPIFANDPOP:
+		case OPCODE_JUMPIFNOTANDPOP:
+		emit_call(e, index, opcode, ops, opc);
+		check_result(e, exit_label);
+		emit8(e, 0x3D); emit32(e, ops[0].as_int); // cmp eax, target
+		emit8(e, 0x0F); emit8(e, 0x84);           // je target
+		emit_rel32(e, func->labels[ops[0].as_int]);
+		break;
+
+		case OPCODE_DIV:
+		emit_call_entry(e, Runtime_ExecMathOp, index, opcode, 0);
+		check_result(e, exit_label);
+		break;
+
+		case OPCODE_SELECT:
+		emit_call_entry(e, Runtime_ExecSelect, index, 0, 0);
+		check_result(e, exit_label);
+		break;
+
+		case OPCODE_INSERT:
+		case OPCODE_INSERT2:
+		emit_call_entry(e, Runtime_ExecInsert, index, opcode, 0);
+		check_result(e, exit_label);
+		break;
+
+		case OPCODE_CALL:
+		emit_call_entry(e, Runtime_ExecCall, index, ops[0].as_int, ops[1].as_int);
+		check_result(e, exit_label);
+		break;
+
+		default:
+		emit_call(e, index, opcode, ops, opc);
+		check_result(e, exit_label);
+		break;
+	}
+}
+
+static JITFunction *translate(Executable *exe, int entry)
+{
+	int count = Executable_GetInstrCount(exe);
+
+	if(entry < 0 || entry >= count)
+		return NULL;
+
+	JITFunction *func = malloc(sizeof(JITFunction));
+	int     *opcs  = malloc(sizeof(int) * count);
+	int     *queue = malloc(sizeof(int) * count);
+	Opcode  *codes = malloc(sizeof(Opcode) * count);
+
+	if(func == NULL || opcs == NULL || queue == NULL || codes == NULL)
+		goto fail0;
+
+	func->exe = NULL;
+	func->code = NULL;
+	func->entry = entry;
+	func->labels = malloc(sizeof(int) * count);
+	func->ops = malloc(sizeof(Operand) * MAX_OPS * count);
+
+	if(func->labels == NULL || func->ops == NULL)
+		goto fail1;
+
+	// Find the instructions that are reachable from
+	// the entry point. The labels array is used to
+	// mark the instructions that were already visited.
+	for(int i = 0; i < count; i += 1)
+		func->labels[i] = -1;
+
+	int queued = 0;
+	queue[queued++] = entry;
+	func->labels[entry] = 0;
+
+	while(queued > 0)
+	{
+		int i = queue[--queued];
+
+		Operand *ops = func->ops + MAX_OPS * i;
+		opcs[i] = MAX_OPS;
+
+		if(!Executable_Fetch(exe, i, codes + i, ops, opcs + i))
+			goto fail1;
+
+		int succ[2], succc = 0;
+
+		switch(codes[i])
+		{
+			case OPCODE_RETURN: 
+			break;
+
+			case OPCODE_JUMP:
+			succ[succc++] = ops[0].as_int;
+			break;
+
+			case OPCODE_JUMPIFANDPOP:
+			case OPCODE_JUMPIFNOTANDPOP:
+			succ[succc++] = ops[0].as_int;
+			succ[succc++] = i + 1;
+			break;
+
+			default:
+			succ[succc++] = i + 1;
+			break;
+		}
+
+		for(int j = 0; j < succc; j += 1)
+		{
+			if(succ[j] < 0 || succ[j] >= count)
+				// The function may run off the end
+				// of the executable. Let the interpreter
+				// report the error.
+				goto fail1;
+
+			if(func->labels[succ[j]] < 0)
+			{
+				func->labels[succ[j]] = 0;
+				queue[queued++] = succ[j];
+			}
+		}
+	}
+
+	// Prologue: save the callee-saved registers used
+	// to hold the runtime and error pointers, then
+	// jump to the requested instruction.
+	static const unsigned char prologue[] = {
+		0x53,             // push rbx
+		0x41, 0x54,       // push r12
+		0x41, 0x55,       // push r13 (keeps the stack aligned)
+		0x48, 0x89, 0xFB, // mov rbx, rdi
+		0x49, 0x89, 0xF4, // mov r12, rsi
+		0xFF, 0xE2,       // jmp rdx
+	};
+
+	static const unsigned char epilogue[] = {
+		0x41, 0x5D, // pop r13
+		0x41, 0x5C, // pop r12
+		0x5B,       // pop rbx
+		0xC3,       // ret
+	};
+
+	// Now that the reachable instructions are known,
+	// calculate the position of each one by emitting
+	// the code without storing it.
+	Emitter e = { .data = NULL, .size = sizeof(prologue) };
+
+	int exit_label = e.size;
+	e.size += sizeof(epilogue);
+
+	for(int i = 0; i < count; i += 1)
+		if(func->labels[i] == 0)
+		{
+			func->labels[i] = e.size;
+			emit_instr(&e, func, i, codes[i], func->ops + MAX_OPS * i, opcs[i], exit_label);
+		}
+
+	int size = e.size;
+	long page = sysconf(_SC_PAGESIZE);
+
+	func->mapped = (size + page - 1) / page * page;
+	func->code = mmap(NULL, func->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if(func->code == MAP_FAILED)
+	{
+		func->code = NULL;
+		goto fail1;
+	}
+
+	e = (Emitter) { .data = func->code, .size = 0 };
+
+	emit_bytes(&e, prologue, sizeof(prologue));
+	emit_bytes(&e, epilogue, sizeof(epilogue));
+
+	for(int i = 0; i < count; i += 1)
+	{
+		if(func->labels[i] < 0)
+			continue;
+
+		assert(func->labels[i] == e.size);
+
+		emit_instr(&e, func, i, codes[i], func->ops + MAX_OPS * i, opcs[i], exit_label);
+	}
+
+	assert(e.size == size);
+
+	if(mprotect(func->code, func->mapped, PROT_READ | PROT_EXEC))
+		goto fail1;
+
+	func->exe = Executable_Copy(exe);
+
+	free(opcs);
+	free(queue);
+	free(codes);
+	return func;
+
+fail1:
+	if(func->code != NULL)
+		munmap(func->code, func->mapped);
+	free(func->labels);
+	free(func->ops);
+fail0:
+	free(func);
+	free(opcs);
+	free(queue);
+	free(codes);
+	return NULL;
+}
+#endif
+
+/* Symbol: JIT_Tick
+ *
+ *   Reports that the function starting at [entry] inside of
+ *   [exe] was entered or that one of its loops jumped back
+ *   [hits] times. When the function becomes hot, it's translated.
+ *
+ * Returns:
+ *   The translated function or NULL if the function isn't hot
+ *   yet or couldn't be translated.
+ */
+JITFunction *JIT_Tick(JIT *jit, Executable *exe, int entry, int hits)
+{
+	JITSlot *slot = find_slot(jit->slots, jit->size, exe, entry);
+
+	if(slot->exe == NULL)
+	{
+		if((jit->used + 1) * 2 > jit->size)
+		{
+			if(!grow(jit))
+				return NULL;
+			slot = find_slot(jit->slots, jit->size, exe, entry);
+		}
+
+		slot->exe = exe;
+		slot->entry = entry;
+		jit->used += 1;
+	}
+
+	if(slot->func != NULL || slot->failed)
+		return slot->func;
+
+	slot->hits += hits;
+
+	if(slot->hits < HOT_THRESHOLD)
+		return NULL;
+
+#if JIT_SUPPORTED
+	slot->func = translate(exe, entry);
+#endif
+
+	if(slot->func == NULL)
+		slot->failed = 1;
+
+	return slot->func;
+}
+
+/* Symbol: JIT_Run
+ *
+ *   Executes the translated function starting from the
+ *   instruction [index] until the current frame returns
+ *   or an error occurres.
+ *
+ * Returns:
+ *   0 if [index] isn't part of the translated code, in which
+ *   case nothing was executed, 1 otherwise.
+ */
+_Bool JIT_Run(JITFunction *func, Runtime *runtime, Error *error, int index)
+{
+	if(index < 0 || index >= Executable_GetInstrCount(func->exe) || func->labels[index] < 0)
+		return 0;
+
+	void (*enter)(Runtime*, Error*, void*);
+
+	*(void**) &enter = func->code;
+
+	enter(runtime, error, func->code + func->labels[index]);
+	return 1;
+}
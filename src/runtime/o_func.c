@@ -118,8 +118,9 @@ static int call(Object *self, Object **argv, unsigned int argc, Object **rets, u
 	return retc;
 }
 
-static TypeObject t_func = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_func = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_FUNC,
 	.name = "function",
 	.size = sizeof (FunctionObject),
 	.call = call,
@@ -122,8 +122,9 @@ static int call(Object *self, Object **argv, unsigned int argc, Object **rets, u
 	return retc;
 }
 
-static TypeObject t_nfunc = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_nfunc = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_NFUNC,
 	.name = "native function",
 	.size = sizeof (NativeFunctionObject),
 	.call = call,	
@@ -39,6 +39,10 @@
 ** | accessed, a lookup is performed into the array. Something to note is that| 
 ** | the array is converted to noja objects lazily when they are accessed,    |
 ** | which makes the start-up times lower than a general purpose map.         |
+** | Once converted, the objects are cached in the map so that following      |
+** | lookups return the same object. Both the map and its cache live in the   |
+** | immortal space of the heap, since they usually last as long as the       |
+** | runtime and are only made of static or immortal objects.                 |
 ** +--------------------------------------------------------------------------+
 ** | NOTES:                                                                   |
 ** |  - Only strings can be keys. There is no intrinsic reason why            |
@@ -55,14 +59,16 @@ typedef struct {
 	Object   base;
 	Runtime *runt;
 	const StaticMapSlot *slots;
+	Object **cache;
 } StaticMapObject;
 
 static Object *select(Object *self, Object *key, Heap *heap, Error *err);
 static Object *copy(Object *self, Heap *heap, Error *err);
 static int hash(Object *self);
 
-static TypeObject t_staticmap = {
-	.base = (Object) { .type = &t_type, .flags = Object_STATIC },
+TypeObject t_staticmap = {
+	.base = (Object) { .type_index = TYPE_TYPE, .flags = Object_STATIC },
+	.index = TYPE_STATICMAP,
 	.name = "static map",
 	.size = sizeof (StaticMapObject),
 	.copy = copy,
@@ -87,23 +93,65 @@ Object *Object_NewStaticMap(const StaticMapSlot *slots, Runtime *runt, Error *er
 {
 	Heap *heap = Runtime_GetHeap(runt);
 
+	int count = 0;
+	if(slots != NULL)
+		while(slots[count].name != NULL)
+			count += 1;
+
+	_Bool immortal = Heap_SetImmortal(heap, 1);
+
 	// Make the thing.
 	StaticMapObject *obj = (StaticMapObject*) Heap_Malloc(heap, &t_staticmap, error);
 	{
 		if(obj == 0)
+		{
+			Heap_SetImmortal(heap, immortal);
 			return 0;
+		}
 
 		obj->runt = runt;
 		obj->slots = slots;
+		obj->cache = NULL;
+
+		if(count > 0)
+		{
+			obj->cache = Heap_RawMalloc(heap, sizeof(Object*) * count, error);
+
+			if(obj->cache == NULL)
+			{
+				Heap_SetImmortal(heap, immortal);
+				return 0;
+			}
+
+			memset(obj->cache, 0, sizeof(Object*) * count);
+		}
 	}
 
+	Heap_SetImmortal(heap, immortal);
 	return (Object*) obj;
 }
 
+static Object *materialize(StaticMapObject *map, StaticMapSlot slot, Heap *heap, Error *error)
+{
+	switch(slot.kind)
+	{
+		case SM_BOOL:  return Object_FromBool(slot.as_bool, heap, error);
+		case SM_INT:   return Object_FromInt(slot.as_int, heap, error);
+		case SM_FLOAT: return Object_FromFloat(slot.as_float, heap, error);
+		case SM_FUNCT: return Object_FromNativeFunction(map->runt, slot.as_funct, slot.argc, heap, error);
+		case SM_STRING: return Object_FromString(slot.as_string, slot.length, heap, error);
+		case SM_SMAP: return Object_NewStaticMap(slot.as_smap, map->runt, error);
+		case SM_NONE: return Object_NewNone(heap, error);
+		case SM_TYPE: return (Object*) slot.as_type;
+		default: assert(0); break;
+	}
+	return NULL;
+}
+
 static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 {
 	assert(self != NULL);
-	assert(self->type == &t_staticmap);
+	assert(Object_TypeOf(self) == &t_staticmap);
 	assert(key != NULL);
 	assert(heap != NULL);
 	assert(error != NULL);
@@ -121,20 +169,17 @@ static Object *select(Object *self, Object *key, Heap *heap, Error *error)
 	for(int i = 0; map->slots[i].name != NULL; i += 1)
 		if(!strcmp(name, map->slots[i].name))
 		{
-			StaticMapSlot slot = map->slots[i];
-			Object *obj;
-			switch(slot.kind)
-			{
-				case SM_BOOL:  return Object_FromBool(slot.as_bool, heap, error);
-				case SM_INT:   return Object_FromInt(slot.as_int, heap, error);
-				case SM_FLOAT: return Object_FromFloat(slot.as_float, heap, error);
-				case SM_FUNCT: return Object_FromNativeFunction(map->runt, slot.as_funct, slot.argc, heap, error);
-				case SM_STRING: return Object_FromString(slot.as_string, slot.length, heap, error);
-				case SM_SMAP: return Object_NewStaticMap(slot.as_smap, map->runt, error);
-				case SM_NONE: return Object_NewNone(heap, error);
-				case SM_TYPE: return (Object*) slot.as_type;
-				default: assert(0); break;
-			}
+			if(map->cache[i] != NULL)
+				return map->cache[i];
+
+			// The objects are created in the immortal
+			// space because the cache isn't walked by
+			// the collector.
+			_Bool immortal = Heap_SetImmortal(heap, 1);
+			Object *obj = materialize(map, map->slots[i], heap, error);
+			Heap_SetImmortal(heap, immortal);
+
+			map->cache[i] = obj;
 			return obj;
 		}
 	return NULL;
@@ -29,32 +29,11 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "../utils/defs.h"
+#include "../utils/hash.h"
 #include "../utils/stack.h"
-#include "runtime.h"
-
-#define MAX_FRAME_STACK 16
-#define MAX_FRAMES 16
-
-typedef struct xFrame Frame;
-struct xFrame {
-	Frame  *prev;
-	Object *locals;
-	Object *closure;
-	Executable *exe;
-	int index, used;
-};
-
-struct xRuntime {
-	void *callback_userp;
-	_Bool (*callback_addr)(Runtime*, void*);
-	_Bool free_heap;
-	Object *builtins;
-	int    depth;
-	Frame *frame;
-	Stack *stack;
-	Heap  *heap;
-};
+#include "runtimei.h"
 
 Stack *Runtime_GetStack(Runtime *runtime)
 {
@@ -106,6 +85,14 @@ Runtime *Runtime_New2(int stack_size, Heap *heap, _Bool free_heap, void *callbac
 		runtime->builtins = NULL;
 		runtime->frame = NULL;
 		runtime->depth = 0;
+		runtime->jit = NULL;
+		runtime->native_exe = NULL;
+		runtime->native_body = NULL;
+		runtime->profile_exe = NULL;
+		runtime->profile = NULL;
+		runtime->interned = NULL;
+		runtime->interned_count = 0;
+		runtime->interned_capacity = 0;
 	}
 
 	return runtime;
@@ -128,9 +115,118 @@ void Runtime_Free(Runtime *runtime)
 	if(runtime->free_heap)
 		Heap_Free(runtime->heap);
 	Stack_Free(runtime->stack);
+	if(runtime->jit != NULL)
+		JIT_Free(runtime->jit);
+	free(runtime->interned);
 	free(runtime);
 }
 
+static Object **find_interned(Object **table, int capacity, const char *str, int len, int hash, Heap *heap, Error *error)
+{
+	unsigned int mask = capacity - 1;
+	unsigned int i = hash & mask;
+
+	while(table[i] != NULL)
+	{
+		int size;
+		const char *body = Object_ToString(table[i], &size, heap, error);
+
+		if(Object_Hash(table[i]) == hash && size == len && !memcmp(body, str, len))
+			break;
+
+		i = (i + 1) & mask;
+	}
+
+	return &table[i];
+}
+
+/* Symbol: intern_string
+ *
+ *   Returns the string object with the contents
+ *   of [str], which is an identifier or a literal
+ *   of the executed code. The same object is 
+ *   returned for equal strings, so that maps can
+ *   compare them by address.
+ *
+ *   Since the number of these strings is bound by
+ *   the size of the code, they're allocated in the
+ *   immortal space and never removed from the table.
+ */
+static Object *intern_string(Runtime *runtime, const char *str, Error *error)
+{
+	int len  = strlen(str);
+	int hash = hashbytes((unsigned char*) str, len);
+
+	if(runtime->interned_capacity > 0)
+	{
+		Object *obj = *find_interned(runtime->interned, runtime->interned_capacity, str, len, hash, runtime->heap, error);
+
+		if(obj != NULL)
+			return obj;
+	}
+
+	if(2 * (runtime->interned_count + 1) > runtime->interned_capacity)
+	{
+		int new_capacity = runtime->interned_capacity == 0 ? 64 : 2 * runtime->interned_capacity;
+
+		Object **new_table = calloc(new_capacity, sizeof(Object*));
+
+		if(new_table == NULL)
+		{
+			Error_Report(error, 1, "No memory");
+			return NULL;
+		}
+
+		for(int i = 0; i < runtime->interned_capacity; i += 1)
+			if(runtime->interned[i] != NULL)
+			{
+				int size;
+				const char *body = Object_ToString(runtime->interned[i], &size, runtime->heap, error);
+				*find_interned(new_table, new_capacity, body, size, Object_Hash(runtime->interned[i]), runtime->heap, error) = runtime->interned[i];
+			}
+
+		free(runtime->interned);
+		runtime->interned = new_table;
+		runtime->interned_capacity = new_capacity;
+	}
+
+	_Bool immortal = Heap_SetImmortal(runtime->heap, 1);
+	Object *obj = Object_FromString(str, len, runtime->heap, error);
+	Heap_SetImmortal(runtime->heap, immortal);
+
+	if(obj == NULL)
+		return NULL;
+
+	*find_interned(runtime->interned, runtime->interned_capacity, str, len, hash, runtime->heap, error) = obj;
+	runtime->interned_count += 1;
+	return obj;
+}
+
+/* Symbol: intern_operand
+ *
+ *   Like [intern_string], but for the string operand
+ *   of the instruction that is running. The interned
+ *   object is cached by the executable the first time
+ *   the instruction runs, so the following times the
+ *   string isn't measured, hashed or looked up.
+ */
+static Object *intern_operand(Runtime *runtime, const char *str, Error *error)
+{
+	Executable *exe = runtime->frame->exe;
+	int index = runtime->frame->index - 1;
+
+	Object *obj = Executable_GetInstrCache(exe, index, runtime);
+
+	if(obj != NULL)
+		return obj;
+
+	obj = intern_string(runtime, str, error);
+
+	if(obj != NULL)
+		Executable_SetInstrCache(exe, index, runtime, obj);
+	return obj;
+}
+
 Object *Runtime_GetBuiltins(Runtime *runtime)
 {
 	return runtime->builtins;
@@ -233,7 +329,10 @@ Snapshot *Snapshot_New(Runtime *runtime)
 			SnapshotNode *node = snapshot->nodes + snapshot->depth;
 
 			node->exe   = Executable_Copy(f->exe);
-			node->index = f->index;
+			// The index of the frame is the one
+			// of the instruction after the one 
+			// that is running.
+			node->index = f->index - 1;
 
 			if(node->exe == NULL)
 				goto abort;
@@ -262,6 +361,47 @@ void Snapshot_Free(Snapshot *snapshot)
 	free(snapshot);
 }
 
+static void print_location(FILE *fp, int depth, Source *src, int offset)
+{
+	const char *name;
+	{
+		name = NULL;
+
+		if(src != NULL) 
+			name = Source_GetName(src);
+
+		if(name == NULL)
+			name = "(unnamed)";
+	}
+
+	int line;
+	{
+		if(src == NULL)
+			line = 0;
+		else
+			{
+				line = 1;
+
+				const char *body = Source_GetBody(src);
+
+				int i = 0;
+			
+				while(i < offset)
+				{
+					if(body[i] == '\n')
+						line += 1;
+
+					i += 1;
+				}
+			}
+	}
+
+	if(line == 0)
+		fprintf(fp, "\t#%d %s\n", depth, name);
+	else
+		fprintf(fp, "\t#%d %s:%d\n", depth, name, line);
+}
+
 void Snapshot_Print(Snapshot *snapshot, FILE *fp)
 {
 	assert(snapshot != NULL);
@@ -269,6 +409,8 @@ void Snapshot_Print(Snapshot *snapshot, FILE *fp)
 
 	fprintf(fp, "Stack trace:\n");
 
+	int depth = 0;
+
 	for(int i = 0; i < snapshot->depth; i += 1)
 	{
 		SnapshotNode node = snapshot->nodes[i];
@@ -276,47 +418,19 @@ void Snapshot_Print(Snapshot *snapshot, FILE *fp)
 		Executable *exe = node.exe;
 		Source     *src = Executable_GetSource(exe);
 
-		const char *name;
-		{
-			name = NULL;
-
-			if(src != NULL) 
-				name = Source_GetName(src);
+		print_location(fp, depth, src, Executable_GetInstrOffset(exe, node.index));
+		depth += 1;
 
-			if(name == NULL)
-				name = "(unnamed)";
-		}
+		// Inlined calls are shown as if the 
+		// callee had a frame of its own.
+		int call = Executable_GetInlinedCall(exe, node.index);
 
-		int line;
+		if(call >= 0)
 		{
-			if(src == NULL)
-				line = 0;
-			else
-				{
-					line = 1;
-
-					const char *body = Source_GetBody(src);
-					int offset = Executable_GetInstrOffset(exe, node.index);
-
-					int i = 0;
-				
-					while(i < offset)
-					{
-						if(body[i] == '\n')
-							line += 1;
-
-						i += 1;
-					}
-				}
+			print_location(fp, depth, src, call);
+			depth += 1;
 		}
-
-		if(line == 0)
-			fprintf(fp, "\t#%d %s\n", i, name);
-		else
-			fprintf(fp, "\t#%d %s:%d\n", i, name, line);
 	}
-
-	//fprintf(fp, "  (Snapshot can't be printed yet)\n");
 }
 
 static Object *do_math_op(Object *lop, Object *rop, Opcode opcode, Heap *heap, Error *error)
@@ -425,6 +539,11 @@ static Object *do_math_op(Object *lop, Object *rop, Opcode opcode, Heap *heap, E
 			return NULL;
 		}
 	}
+	else if(opcode == OPCODE_ADD && Object_IsString(lop) && Object_IsString(rop))
+	{
+		// string + string
+		res = Object_ConcatString(lop, rop, heap, error);
+	}
 	else
 	{
 		Error_Report(error, 0, "Arithmetic operation on a non-numeric object");
@@ -530,445 +649,691 @@ static Object *do_relational_op(Object *lop, Object *rop, Opcode opcode, Heap *h
 	return Object_FromBool(res, heap, error);
 }
 
-static _Bool step(Runtime *runtime, Error *error)
+// Executes an instruction that the compiler specialized
+// because the profile says it only saw ints or floats.
+// The profile may be wrong for this run, so the types
+// are checked and the generic operation is used when
+// they don't match.
+static Object *do_guarded_op(Object *lop, Object *rop, Opcode opcode, Heap *heap, Error *error)
 {
-	assert(runtime != NULL);
-	assert(error->occurred == 0);
-	Opcode opcode;	
-	Operand ops[3];
-	int     opc = sizeof(ops) / sizeof(ops[0]);
+	_Bool floats = (opcode >= OPCODE_ADDGF);
+	Opcode generic = Executable_GetGenericOpcode(opcode);
 
-	if(!Executable_Fetch(runtime->frame->exe, runtime->frame->index, &opcode, ops, &opc))
+	_Bool match = floats ? (Object_IsFloat(lop) && Object_IsFloat(rop))
+						 : (Object_IsInt(lop)   && Object_IsInt(rop));
+
+	if(!match)
 	{
-		Error_Report(error, 1, "Invalid instruction index");
-		return 0;
+		if(generic == OPCODE_LSS || generic == OPCODE_GRT || generic == OPCODE_LEQ || generic == OPCODE_GEQ)
+			return do_relational_op(lop, rop, generic, heap, error);
+		return do_math_op(lop, rop, generic, heap, error);
 	}
-	
-	runtime->frame->index += 1;
 
-	switch(opcode)
+	if(floats)
 	{
-		case OPCODE_NOPE:
-		// Do nothing.
-		return 1;
+		double l = Object_GetFloat(lop);
+		double r = Object_GetFloat(rop);
 
-		case OPCODE_POS:
+		switch(generic)
 		{
-			assert(opc == 0);
-
-			if(runtime->frame->used == 0)
+			case OPCODE_ADD: return Object_FromFloat(l + r, heap, error);
+			case OPCODE_SUB: return Object_FromFloat(l - r, heap, error);
+			case OPCODE_MUL: return Object_FromFloat(l * r, heap, error);
+			case OPCODE_DIV:
+			if(r == 0)
 			{
-				Error_Report(error, 1, "Frame doesn't have enough items on the stack to execute POS");
-				return 0;
+				Error_Report(error, 0, "Division by zero");
+				return NULL;
 			}
-
-			/* Do nothing */
-			return 1;
+			return Object_FromFloat(l / r, heap, error);
+			case OPCODE_LSS: return Object_FromBool(l <  r, heap, error);
+			case OPCODE_GRT: return Object_FromBool(l >  r, heap, error);
+			case OPCODE_LEQ: return Object_FromBool(l <= r, heap, error);
+			case OPCODE_GEQ: return Object_FromBool(l >= r, heap, error);
+			default: break;
 		}
+	}
+	else
+	{
+		long long int l = Object_GetInt(lop);
+		long long int r = Object_GetInt(rop);
 
-		case OPCODE_NEG:
+		switch(generic)
 		{
-			assert(opc == 0);
-
-			if(runtime->frame->used == 0)
+			case OPCODE_ADD: return Object_FromInt(l + r, heap, error);
+			case OPCODE_SUB: return Object_FromInt(l - r, heap, error);
+			case OPCODE_MUL: return Object_FromInt(l * r, heap, error);
+			case OPCODE_DIV:
+			if(r == 0)
 			{
-				Error_Report(error, 1, "Frame doesn't have enough items on the stack to execute NEG");
-				return 0;
+				Error_Report(error, 0, "Division by zero");
+				return NULL;
 			}
+			return Object_FromInt(l / r, heap, error);
+			case OPCODE_LSS: return Object_FromBool(l <  r, heap, error);
+			case OPCODE_GRT: return Object_FromBool(l >  r, heap, error);
+			case OPCODE_LEQ: return Object_FromBool(l <= r, heap, error);
+			case OPCODE_GEQ: return Object_FromBool(l >= r, heap, error);
+			default: break;
+		}
+	}
 
-			Object *top = Stack_Top(runtime->stack, 0);
-			assert(top != NULL);
+	UNREACHABLE;
+	return NULL;
+}
 
-			if(!Runtime_Pop(runtime, error, 1))
-				return 0;
+// Records the types of the operands of the 
+// current instruction in the runtime's profile.
+static void profile_operands(Runtime *runtime, Object *lop, Object *rop)
+{
+	Frame *frame = runtime->frame;
 
-			Heap *heap = Runtime_GetHeap(runtime);
-			assert(heap != NULL);
+	if(runtime->profile == NULL || frame->exe != runtime->profile_exe)
+		return;
 
-			if(Object_IsInt(top))
-			{
-				long long n = Object_ToInt(top, error);
+	unsigned char bits;
 
-				if(error->occurred)
-					return 0;
+	if(Object_IsInt(lop) && Object_IsInt(rop))
+		bits = PROFILE_INT;
+	else if(Object_IsFloat(lop) && Object_IsFloat(rop))
+		bits = PROFILE_FLOAT;
+	else
+		bits = PROFILE_OTHER;
 
-				top = Object_FromInt(-n, heap, error);
-			}
-			else if(Object_IsFloat(top))
-			{
-				double f = Object_ToFloat(top, error);
+	// The index was already moved to the
+	// next instruction.
+	Profile_Record(runtime->profile, frame->index - 1, bits);
+}
 
-				if(error->occurred)
-					return 0;
+// Executes the generic arithmetic and relational
+// instructions.
+static _Bool exec_math_op(Runtime *runtime, Error *error, Opcode opcode)
+{
+	Object *rop = Stack_Top(runtime->stack,  0);
+	Object *lop = Stack_Top(runtime->stack, -1);
 
-				top = Object_FromFloat(-f, heap, error);
-			}
-			else
-			{
-				Error_Report(error, 0, "Negation operand on a non-numeric object");
-				return 0;
-			}
+	if(!Runtime_Pop(runtime, error, 2))
+		return 0;
 
-			if(top == NULL)
-				return 0;
+	// We managed to pop rop and lop,
+	// so we know they're not NULL.
+	assert(rop != NULL);
+	assert(lop != NULL);
 
-			if(!Runtime_Push(runtime, error, top))
-				return 0;
-			return 1;
-		}
+	profile_operands(runtime, lop, rop);
 
-		case OPCODE_NOT:
-		{
-			assert(opc == 0);
+	Object *res;
 
-			if(runtime->frame->used == 0)
-			{
-				Error_Report(error, 1, "Frame doesn't have enough items on the stack to execute NOT");
-				return 0;
-			}
+	if(opcode == OPCODE_LSS || opcode == OPCODE_GRT || opcode == OPCODE_LEQ || opcode == OPCODE_GEQ)
+		res = do_relational_op(lop, rop, opcode, runtime->heap, error);
+	else
+		res = do_math_op(lop, rop, opcode, runtime->heap, error);
 
-			Object *top = Stack_Top(runtime->stack, 0);
+	if(res == NULL)
+		return 0;
 
-			if(!Runtime_Pop(runtime, error, 1))
-				return 0;
+	if(!Runtime_Push(runtime, error, res))
+		return 0;
+	return 1;
+}
 
-			assert(top != NULL);
+static _Bool exec_call(Runtime *runtime, Error *error, int argc, int retc)
+{
+	assert(argc >= 0 && retc > 0);
 
-			_Bool v = Object_ToBool(top, error);
+	if(runtime->frame->used < argc + 1)
+	{
+		Error_Report(error, 1, "Frame doesn't own enough objects to execute call");
+		return 0;
+	}
 
-			if(error->occurred)
-				return 0;
+	Object *callable = Stack_Top(runtime->stack, 0);
+	assert(callable != NULL);
 
-			Object *negated = Object_FromBool(!v, runtime->heap, error);
+	Object *argv[8];
 
-			if(negated == NULL)
-				return 0;
+	int max_argc = sizeof(argv) / sizeof(argv[0]);
+	if(argc > max_argc)
+	{
+		Error_Report(error, 1, "Static buffer only allows function calls with up to %d arguments", max_argc);
+		return 0;
+	}
 
-			if(!Runtime_Push(runtime, error, negated))
-				return 0;
-			return 1;
-		}
+	for(int i = 0; i < argc; i += 1)
+	{
+		argv[i] = Stack_Top(runtime->stack, -(i+1));
+		assert(argv[i] != NULL);
+	}
 
-		case OPCODE_ADD:
-		case OPCODE_SUB:
-		case OPCODE_MUL:
-		case OPCODE_DIV:
-		{
-			assert(opc == 0);
+	assert(error->occurred == 0);
+	(void) Runtime_Pop(runtime, error, argc+1);
+	assert(error->occurred == 0);
 
-			Object *rop = Stack_Top(runtime->stack,  0);
-			Object *lop = Stack_Top(runtime->stack, -1);
+	Object *rets[8];
+	unsigned int maxrets = sizeof(rets)/sizeof(rets[0]);
 
-			if(!Runtime_Pop(runtime, error, 2))
-				return 0;
+	int num_rets = Object_Call(callable, argv, argc, rets, maxrets, runtime->heap, error);
 
-			// We managed to pop rop and lop,
-			// so we know they're not NULL.
-			assert(rop != NULL);
-			assert(lop != NULL);
+	if(num_rets < 0)
+		return 0;
 
-			Object *res = do_math_op(lop, rop, opcode, runtime->heap, error);
+	// NOTE: Every local object reference is invalidated from here.
 
-			if(res == NULL)
-				return 0;
+	assert(error->occurred == 0);
 
-			if(!Runtime_Push(runtime, error, res))
-				return 0;
-			return 1;
-		}
+	for(int g = 0; g < MIN(num_rets, retc); g += 1)
+		if(!Runtime_Push(runtime, error, rets[g]))
+			return 0;
 
-		case OPCODE_EQL:
-		case OPCODE_NQL:
-		{
-			assert(opc == 0);
+	for(int g = 0; g < retc - num_rets; g += 1)
+	{
+		Object *temp = Object_NewNone(Runtime_GetHeap(runtime), error);
 
-			Object *rop = Stack_Top(runtime->stack,  0);
-			Object *lop = Stack_Top(runtime->stack, -1);
+		if(temp == NULL)
+			return 0;
 
-			if(!Runtime_Pop(runtime, error, 2))
-				return 0;
+		if(!Runtime_Push(runtime, error, temp))
+			return 0;
+	}
+	return 1;
+}
 
-			// We managed to pop rop and lop,
-			// so we know they're not NULL.
-			assert(rop != NULL);
-			assert(lop != NULL);
+static _Bool exec_select(Runtime *runtime, Error *error)
+{
+	if(runtime->frame->used < 2)
+	{
+		Error_Report(error, 1, "Frame has not enough values on the stack to run SELECT instruction");
+		return 0;
+	}
 
-			_Bool rawres = Object_Compare(lop, rop, error);
+	Object *col = Stack_Top(runtime->stack, -1);
+	Object *key = Stack_Top(runtime->stack,  0);
 
-			if(error->occurred == 1)
-				return 0;
+	assert(col != NULL && key != NULL);
 
-			if(opcode == OPCODE_NQL)
-				rawres = !rawres;
+	if(!Runtime_Pop(runtime, error, 2))
+		return 0;
 
-			Object *res = Object_FromBool(rawres, runtime->heap, error);
+	assert(error->occurred == 0);
 
-			if(res == NULL)
-				return 0;
+	Error dummy;
+	Error_Init(&dummy); // We want to catch the error reported by this Object_Select.
 
-			if(!Runtime_Push(runtime, error, res))
-				return 0;
-			return 1;
-		}
+	Object *val = Object_Select(col, key, runtime->heap, &dummy);
 
-		case OPCODE_LSS:
-		case OPCODE_GRT:
-		case OPCODE_LEQ:
-		case OPCODE_GEQ:
+	if(val == NULL)
 		{
-			assert(opc == 0);
+			Error_Free(&dummy);
 
-			Object *rop = Stack_Top(runtime->stack,  0);
-			Object *lop = Stack_Top(runtime->stack, -1);
+			val = Object_NewNone(runtime->heap, error);
 
-			if(!Runtime_Pop(runtime, error, 2))
+			if(val == NULL)
 				return 0;
+		}
 
-			// We managed to pop rop and lop,
-			// so we know they're not NULL.
-			assert(rop != NULL);
-			assert(lop != NULL);
+	assert(error->occurred == 0);
 
-			Object *res = do_relational_op(lop, rop, opcode, runtime->heap, error);
+	if(!Runtime_Push(runtime, error, val))
+		return 0;
 
-			if(res == NULL)
-				return 0;
+	assert(error->occurred == 0);
+	return 1;
+}
 
-			if(!Runtime_Push(runtime, error, res))
+// Executes INSERT, which expects the collection, the
+// key and the value on the stack in this order, and
+// INSERT2, which expects the value, the collection 
+// and the key.
+static _Bool exec_insert(Runtime *runtime, Error *error, Opcode opcode)
+{
+	if(runtime->frame->used < 3)
+	{
+		Error_Report(error, 1, "Frame has not enough values on the stack to run %s instruction", Executable_GetOpcodeName(opcode));
+		return 0;
+	}
+
+	Object *col, *key, *val;
+
+	if(opcode == OPCODE_INSERT)
+	{
+		col = Stack_Top(runtime->stack, -2);
+		key = Stack_Top(runtime->stack, -1);
+		val = Stack_Top(runtime->stack,  0);
+	}
+	else
+	{
+		val = Stack_Top(runtime->stack, -2);
+		col = Stack_Top(runtime->stack, -1);
+		key = Stack_Top(runtime->stack,  0);
+	}
+
+	assert(col != NULL && key != NULL && val != NULL);
+
+	if(!Runtime_Pop(runtime, error, 2))
+		return 0;
+
+	if(!Object_Insert(col, key, val, runtime->heap, error))
+		return 0;
+	return 1;
+}
+
+static _Bool exec_assign(Runtime *runtime, Error *error, const char *name)
+{
+	if(runtime->frame->used == 0)
+	{
+		Error_Report(error, 0, "Frame has not enough values on the stack");
+		return 0;
+	}
+
+	Object *val = Stack_Top(runtime->stack, 0);
+	assert(val != NULL);
+
+	Object *key = intern_operand(runtime, name, error);
+
+	if(key == NULL)
+		return 0;
+
+	if(!Object_Insert(runtime->frame->locals, key, val, runtime->heap, error))
+		return 0;
+	return 1;
+}
+
+static _Bool exec_push_var(Runtime *runtime, Error *error, const char *name)
+{
+	Object *key = intern_operand(runtime, name, error);
+		
+	if(key == NULL)
+		return 0;
+
+	Object *locations[] = {
+		runtime->frame->locals,
+		runtime->frame->closure,
+		Runtime_GetBuiltins(runtime),
+	};
+		
+	Object *obj = NULL;
+
+	for(int p = 0; obj == NULL && (unsigned int) p < sizeof(locations)/sizeof(locations[0]); p += 1)
+	{
+		if(locations[p] == NULL)
+			continue;
+
+		obj = Object_Select(locations[p], key, Runtime_GetHeap(runtime), error);
+	}
+
+	if(obj == NULL)
+	{
+		if(error->occurred == 0)
+			// There's no such variable.
+			Error_Report(error, 0, "Reference to undefined variable \"%s\"", name);
+		return 0;
+	}
+
+	if(!Runtime_Push(runtime, error, obj))
+		return 0;
+
+	return 1;
+}
+
+static _Bool exec_instr(Runtime *runtime, Error *error, Opcode opcode, Operand *ops, int opc)
+{
+	assert(runtime != NULL);
+	assert(error->occurred == 0);
+
+	switch(opcode)
+	{
+		case OPCODE_NOPE:
+		// Do nothing.
+		return 1;
+
+		case OPCODE_POS:
+		{
+			assert(opc == 0);
+
+			if(runtime->frame->used == 0)
+			{
+				Error_Report(error, 1, "Frame doesn't have enough items on the stack to execute POS");
 				return 0;
+			}
+
+			/* Do nothing */
 			return 1;
 		}
 
-		case OPCODE_AND:
-		case OPCODE_OR:
+		case OPCODE_NEG:
 		{
 			assert(opc == 0);
 
-			Object *rop = Stack_Top(runtime->stack,  0);
-			Object *lop = Stack_Top(runtime->stack, -1);
-
-			if(!Runtime_Pop(runtime, error, 2))
+			if(runtime->frame->used == 0)
+			{
+				Error_Report(error, 1, "Frame doesn't have enough items on the stack to execute NEG");
 				return 0;
+			}
 
-			// We managed to pop rop and lop,
-			// so we know they're not NULL.
-			assert(rop != NULL);
-			assert(lop != NULL);
+			Object *top = Stack_Top(runtime->stack, 0);
+			assert(top != NULL);
 
-			_Bool raw_rop, raw_lop, raw_res;
-			raw_lop = Object_ToBool(lop, error);
-			raw_rop = Object_ToBool(rop, error);
-			if(error->occurred) return 0;
+			if(!Runtime_Pop(runtime, error, 1))
+				return 0;
 
-			switch(opcode)
+			Heap *heap = Runtime_GetHeap(runtime);
+			assert(heap != NULL);
+
+			if(Object_IsInt(top))
 			{
-				case OPCODE_AND: raw_res = raw_lop && raw_rop; break;
-				case OPCODE_OR:  raw_res = raw_lop || raw_rop; break;
-				default: assert(0); break;
+				long long n = Object_ToInt(top, error);
+
+				if(error->occurred)
+					return 0;
+
+				top = Object_FromInt(-n, heap, error);
 			}
+			else if(Object_IsFloat(top))
+			{
+				double f = Object_ToFloat(top, error);
 
-			Object *res = Object_FromBool(raw_res, runtime->heap, error);
+				if(error->occurred)
+					return 0;
 
-			if(res == NULL)
+				top = Object_FromFloat(-f, heap, error);
+			}
+			else
+			{
+				Error_Report(error, 0, "Negation operand on a non-numeric object");
 				return 0;
+			}
 
-			if(!Runtime_Push(runtime, error, res))
+			if(top == NULL)
+				return 0;
+
+			if(!Runtime_Push(runtime, error, top))
 				return 0;
 			return 1;
 		}
 
-		case OPCODE_ASS:
+		case OPCODE_NOT:
 		{
-			assert(opc == 1);
-			assert(ops[0].type == OPTP_STRING);
+			assert(opc == 0);
 
 			if(runtime->frame->used == 0)
 			{
-				Error_Report(error, 0, "Frame has not enough values on the stack");
+				Error_Report(error, 1, "Frame doesn't have enough items on the stack to execute NOT");
 				return 0;
 			}
 
-			Object *val = Stack_Top(runtime->stack, 0);
-			assert(val != NULL);
-
-			Object *key = Object_FromString(ops[0].as_string, -1, runtime->heap, error);
+			Object *top = Stack_Top(runtime->stack, 0);
 
-			if(key == NULL)
+			if(!Runtime_Pop(runtime, error, 1))
 				return 0;
 
-			if(!Object_Insert(runtime->frame->locals, key, val, runtime->heap, error))
+			assert(top != NULL);
+
+			_Bool v = Object_ToBool(top, error);
+
+			if(error->occurred)
 				return 0;
-			return 1;
-		}
 
-		case OPCODE_POP:
-		{
-			assert(opc == 1);
+			Object *negated = Object_FromBool(!v, runtime->heap, error);
 
-			if(!Runtime_Pop(runtime, error, ops[0].as_int))
+			if(negated == NULL)
+				return 0;
+
+			if(!Runtime_Push(runtime, error, negated))
 				return 0;
 			return 1;
 		}
 
-		case OPCODE_CALL:
+		case OPCODE_ADD:
+		case OPCODE_SUB:
+		case OPCODE_MUL:
+		case OPCODE_DIV:
+		assert(opc == 0);
+		return exec_math_op(runtime, error, opcode);
+
+		case OPCODE_EQL:
+		case OPCODE_NQL:
 		{
-			assert(opc == 2);
-			assert(ops[0].type == OPTP_INT);
-			assert(ops[1].type == OPTP_INT);
+			assert(opc == 0);
 
-			int argc = ops[0].as_int;
-			int retc = ops[1].as_int;
-			assert(argc >= 0 && retc > 0);
+			Object *rop = Stack_Top(runtime->stack,  0);
+			Object *lop = Stack_Top(runtime->stack, -1);
 
-			if(runtime->frame->used < argc + 1)
-			{
-				Error_Report(error, 1, "Frame doesn't own enough objects to execute call");
+			if(!Runtime_Pop(runtime, error, 2))
 				return 0;
-			}
 
-			Object *callable = Stack_Top(runtime->stack, 0);
-			assert(callable != NULL);
+			// We managed to pop rop and lop,
+			// so we know they're not NULL.
+			assert(rop != NULL);
+			assert(lop != NULL);
 
-			Object *argv[8];
+			_Bool rawres = Object_Compare(lop, rop, error);
 
-			int max_argc = sizeof(argv) / sizeof(argv[0]);
-			if(argc > max_argc)
-			{
-				Error_Report(error, 1, "Static buffer only allows function calls with up to %d arguments", max_argc);
+			if(error->occurred == 1)
 				return 0;
-			}
-
-			for(int i = 0; i < argc; i += 1)
-			{
-				argv[i] = Stack_Top(runtime->stack, -(i+1));
-				assert(argv[i] != NULL);
-			}
 
-			assert(error->occurred == 0);
-			(void) Runtime_Pop(runtime, error, argc+1);
-			assert(error->occurred == 0);
+			if(opcode == OPCODE_NQL)
+				rawres = !rawres;
 
-			Object *rets[8];
-			unsigned int maxrets = sizeof(rets)/sizeof(rets[0]);
+			Object *res = Object_FromBool(rawres, runtime->heap, error);
 
-			int num_rets = Object_Call(callable, argv, argc, rets, maxrets, runtime->heap, error);
+			if(res == NULL)
+				return 0;
 
-			if(num_rets < 0)
+			if(!Runtime_Push(runtime, error, res))
 				return 0;
+			return 1;
+		}
 
-			// NOTE: Every local object reference is invalidated from here.
+		case OPCODE_LSS:
+		case OPCODE_GRT:
+		case OPCODE_LEQ:
+		case OPCODE_GEQ:
+		assert(opc == 0);
+		return exec_math_op(runtime, error, opcode);
+
+		case OPCODE_ADDI:
+		case OPCODE_SUBI:
+		case OPCODE_MULI:
+		case OPCODE_DIVI:
+		case OPCODE_LSSI:
+		case OPCODE_GRTI:
+		case OPCODE_LEQI:
+		case OPCODE_GEQI:
+		{
+			assert(opc == 0);
 
-			assert(error->occurred == 0);
+			// The compiler proved that both operands
+			// are ints, so their types aren't checked.
+			long long int rop = Object_GetInt(Stack_Top(runtime->stack,  0));
+			long long int lop = Object_GetInt(Stack_Top(runtime->stack, -1));
 
-			for(int g = 0; g < MIN(num_rets, retc); g += 1)
-				if(!Runtime_Push(runtime, error, rets[g]))
-					return 0;
+			if(!Runtime_Pop(runtime, error, 2))
+				return 0;
 
-			for(int g = 0; g < retc - num_rets; g += 1)
+			Object *res;
+			switch(opcode)
 			{
-				Object *temp = Object_NewNone(Runtime_GetHeap(runtime), error);
-
-				if(temp == NULL)
-					return NULL;
-
-				if(!Runtime_Push(runtime, error, temp))
+				case OPCODE_ADDI: res = Object_FromInt(lop + rop, runtime->heap, error); break;
+				case OPCODE_SUBI: res = Object_FromInt(lop - rop, runtime->heap, error); break;
+				case OPCODE_MULI: res = Object_FromInt(lop * rop, runtime->heap, error); break;
+				case OPCODE_DIVI:
+				if(rop == 0)
+				{
+					Error_Report(error, 0, "Division by zero");
 					return 0;
+				}
+				res = Object_FromInt(lop / rop, runtime->heap, error); 
+				break;
+				case OPCODE_LSSI: res = Object_FromBool(lop <  rop, runtime->heap, error); break;
+				case OPCODE_GRTI: res = Object_FromBool(lop >  rop, runtime->heap, error); break;
+				case OPCODE_LEQI: res = Object_FromBool(lop <= rop, runtime->heap, error); break;
+				case OPCODE_GEQI: res = Object_FromBool(lop >= rop, runtime->heap, error); break;
+				default: UNREACHABLE; return 0;
 			}
+
+			if(res == NULL)
+				return 0;
+
+			if(!Runtime_Push(runtime, error, res))
+				return 0;
 			return 1;
 		}
 
-		case OPCODE_SELECT:
+		case OPCODE_ADDF:
+		case OPCODE_SUBF:
+		case OPCODE_MULF:
+		case OPCODE_DIVF:
+		case OPCODE_LSSF:
+		case OPCODE_GRTF:
+		case OPCODE_LEQF:
+		case OPCODE_GEQF:
 		{
 			assert(opc == 0);
 
-			if(runtime->frame->used < 2)
-			{
-				Error_Report(error, 1, "Frame has not enough values on the stack to run SELECT instruction");
-				return 0;
-			}
-
-			Object *col = Stack_Top(runtime->stack, -1);
-			Object *key = Stack_Top(runtime->stack,  0);
-
-			assert(col != NULL && key != NULL);
+			// The compiler proved that both operands
+			// are floats, so their types aren't checked.
+			double rop = Object_GetFloat(Stack_Top(runtime->stack,  0));
+			double lop = Object_GetFloat(Stack_Top(runtime->stack, -1));
 
 			if(!Runtime_Pop(runtime, error, 2))
 				return 0;
 
-			assert(error->occurred == 0);
-
-			Error dummy;
-			Error_Init(&dummy); // We want to catch the error reported by this Object_Select.
-
-			Object *val = Object_Select(col, key, runtime->heap, &dummy);
-
-			if(val == NULL)
+			Object *res;
+			switch(opcode)
+			{
+				case OPCODE_ADDF: res = Object_FromFloat(lop + rop, runtime->heap, error); break;
+				case OPCODE_SUBF: res = Object_FromFloat(lop - rop, runtime->heap, error); break;
+				case OPCODE_MULF: res = Object_FromFloat(lop * rop, runtime->heap, error); break;
+				case OPCODE_DIVF:
+				if(rop == 0)
 				{
-					Error_Free(&dummy);
-
-					val = Object_NewNone(runtime->heap, error);
-
-					if(val == NULL)
-						return 0;
+					Error_Report(error, 0, "Division by zero");
+					return 0;
 				}
+				res = Object_FromFloat(lop / rop, runtime->heap, error); 
+				break;
+				case OPCODE_LSSF: res = Object_FromBool(lop <  rop, runtime->heap, error); break;
+				case OPCODE_GRTF: res = Object_FromBool(lop >  rop, runtime->heap, error); break;
+				case OPCODE_LEQF: res = Object_FromBool(lop <= rop, runtime->heap, error); break;
+				case OPCODE_GEQF: res = Object_FromBool(lop >= rop, runtime->heap, error); break;
+				default: UNREACHABLE; return 0;
+			}
 
-			assert(error->occurred == 0);
-
-			if(!Runtime_Push(runtime, error, val))
+			if(res == NULL)
 				return 0;
 
-			assert(error->occurred == 0);
+			if(!Runtime_Push(runtime, error, res))
+				return 0;
 			return 1;
 		}
 
-		case OPCODE_INSERT:
+		case OPCODE_ADDGI:
+		case OPCODE_SUBGI:
+		case OPCODE_MULGI:
+		case OPCODE_DIVGI:
+		case OPCODE_LSSGI:
+		case OPCODE_GRTGI:
+		case OPCODE_LEQGI:
+		case OPCODE_GEQGI:
+		case OPCODE_ADDGF:
+		case OPCODE_SUBGF:
+		case OPCODE_MULGF:
+		case OPCODE_DIVGF:
+		case OPCODE_LSSGF:
+		case OPCODE_GRTGF:
+		case OPCODE_LEQGF:
+		case OPCODE_GEQGF:
 		{
 			assert(opc == 0);
 
-			if(runtime->frame->used < 3)
-			{
-				Error_Report(error, 1, "Frame has not enough values on the stack to run INSERT instruction");
+			Object *rop = Stack_Top(runtime->stack,  0);
+			Object *lop = Stack_Top(runtime->stack, -1);
+
+			if(!Runtime_Pop(runtime, error, 2))
 				return 0;
-			}
 
-			Object *col = Stack_Top(runtime->stack, -2);
-			Object *key = Stack_Top(runtime->stack, -1);
-			Object *val = Stack_Top(runtime->stack,  0);
+			assert(rop != NULL);
+			assert(lop != NULL);
 
-			assert(col != NULL && key != NULL && val != NULL);
+			profile_operands(runtime, lop, rop);
 
-			if(!Runtime_Pop(runtime, error, 2))
+			Object *res = do_guarded_op(lop, rop, opcode, runtime->heap, error);
+
+			if(res == NULL)
 				return 0;
 
-			if(!Object_Insert(col, key, val, runtime->heap, error))
+			if(!Runtime_Push(runtime, error, res))
 				return 0;
 			return 1;
 		}
 
-		case OPCODE_INSERT2:
+		case OPCODE_AND:
+		case OPCODE_OR:
 		{
 			assert(opc == 0);
 
-			if(runtime->frame->used < 3)
-			{
-				Error_Report(error, 1, "Frame has not enough values on the stack to run INSERT2 instruction");
+			Object *rop = Stack_Top(runtime->stack,  0);
+			Object *lop = Stack_Top(runtime->stack, -1);
+
+			if(!Runtime_Pop(runtime, error, 2))
 				return 0;
+
+			// We managed to pop rop and lop,
+			// so we know they're not NULL.
+			assert(rop != NULL);
+			assert(lop != NULL);
+
+			_Bool raw_rop, raw_lop, raw_res;
+			raw_lop = Object_ToBool(lop, error);
+			raw_rop = Object_ToBool(rop, error);
+			if(error->occurred) return 0;
+
+			switch(opcode)
+			{
+				case OPCODE_AND: raw_res = raw_lop && raw_rop; break;
+				case OPCODE_OR:  raw_res = raw_lop || raw_rop; break;
+				default: assert(0); break;
 			}
 
-			Object *val = Stack_Top(runtime->stack, -2);
-			Object *col = Stack_Top(runtime->stack, -1);
-			Object *key = Stack_Top(runtime->stack,  0);
+			Object *res = Object_FromBool(raw_res, runtime->heap, error);
 
-			assert(col != NULL && key != NULL && val != NULL);
+			if(res == NULL)
+				return 0;
 
-			if(!Runtime_Pop(runtime, error, 2))
+			if(!Runtime_Push(runtime, error, res))
 				return 0;
+			return 1;
+		}
+
+		case OPCODE_ASS:
+		assert(opc == 1);
+		assert(ops[0].type == OPTP_STRING);
+		return exec_assign(runtime, error, ops[0].as_string);
 
-			if(!Object_Insert(col, key, val, runtime->heap, error))
+		case OPCODE_POP:
+		{
+			assert(opc == 1);
+
+			if(!Runtime_Pop(runtime, error, ops[0].as_int))
 				return 0;
 			return 1;
 		}
 
+		case OPCODE_CALL:
+		assert(opc == 2);
+		assert(ops[0].type == OPTP_INT);
+		assert(ops[1].type == OPTP_INT);
+		return exec_call(runtime, error, ops[0].as_int, ops[1].as_int);
+
+		case OPCODE_SELECT:
+		assert(opc == 0);
+		return exec_select(runtime, error);
+
+		case OPCODE_INSERT:
+		case OPCODE_INSERT2:
+		assert(opc == 0);
+		return exec_insert(runtime, error, opcode);
+
 		case OPCODE_PUSHINT:
 		{
 			assert(opc == 1);
@@ -1004,7 +1369,7 @@ static _Bool step(Runtime *runtime, Error *error)
 			assert(opc == 1);
 			assert(ops[0].type == OPTP_STRING);
 
-			Object *obj = Object_FromString(ops[0].as_string, -1, runtime->heap, error);
+			Object *obj = intern_operand(runtime, ops[0].as_string, error);
 
 			if(obj == NULL)
 				return 0;
@@ -1015,44 +1380,9 @@ static _Bool step(Runtime *runtime, Error *error)
 		}
 
 		case OPCODE_PUSHVAR:
-		{
-			assert(opc == 1);
-			assert(ops[0].type == OPTP_STRING);
-
-			Object *key = Object_FromString(ops[0].as_string, -1, runtime->heap, error);
-				
-			if(key == NULL)
-				return 0;
-
-			Object *locations[] = {
-				runtime->frame->locals,
-				runtime->frame->closure,
-				Runtime_GetBuiltins(runtime),
-			};
-				
-			Object *obj = NULL;
-
-			for(int p = 0; obj == NULL && (unsigned int) p < sizeof(locations)/sizeof(locations[0]); p += 1)
-			{
-				if(locations[p] == NULL)
-					continue;
-
-				obj = Object_Select(locations[p], key, Runtime_GetHeap(runtime), error);
-			}
-
-			if(obj == NULL)
-			{
-				if(error->occurred == 0)
-					// There's no such variable.
-					Error_Report(error, 0, "Reference to undefined variable \"%s\"", ops[0].as_string);
-				return 0;
-			}
-
-			if(!Runtime_Push(runtime, error, obj))
-				return 0;
-
-			return 1;
-		}
+		assert(opc == 1);
+		assert(ops[0].type == OPTP_STRING);
+		return exec_push_var(runtime, error, ops[0].as_string);
 
 		case OPCODE_PUSHNNE:
 		{
@@ -1235,6 +1565,25 @@ static _Bool step(Runtime *runtime, Error *error)
 	return 1;
 }
 
+static _Bool step(Runtime *runtime, Error *error)
+{
+	assert(runtime != NULL);
+	assert(error->occurred == 0);
+	Opcode opcode;	
+	Operand ops[3];
+	int     opc = sizeof(ops) / sizeof(ops[0]);
+
+	if(!Executable_Fetch(runtime->frame->exe, runtime->frame->index, &opcode, ops, &opc))
+	{
+		Error_Report(error, 1, "Invalid instruction index");
+		return 0;
+	}
+	
+	runtime->frame->index += 1;
+
+	return exec_instr(runtime, error, opcode, ops, opc);
+}
+
 static _Bool collect(Runtime *runtime, Error *error)
 {
 	Frame *frame = runtime->frame;
@@ -1259,7 +1608,226 @@ static _Bool collect(Runtime *runtime, Error *error)
 		Heap_CollectReference(ref, runtime->heap);
 	}
 
-	return Heap_StopCollection(runtime->heap);
+	if(!Heap_StopCollection(runtime->heap))
+		return 0;
+
+	// The destructors are called after the pause.
+	return Heap_RunDestructors(runtime->heap, error);
+}
+
+/* Symbol: Runtime_ExecInstr
+ *
+ *   Executes the instruction at position [index] of the
+ *   current frame given its already decoded opcode and
+ *   operands. This is what the JIT-compiled code calls
+ *   for each instruction.
+ *
+ * Returns:
+ *   The index of the next instruction to be executed or
+ *   -1 if the frame returned or an error occurred.
+ */
+int Runtime_ExecInstr(Runtime *runtime, Error *error, int index, Opcode opcode, Operand *ops, int opc)
+{
+	Frame *frame = runtime->frame;
+
+	frame->index = index + 1;
+
+	if(!exec_instr(runtime, error, opcode, ops, opc))
+		return -1;
+
+	if(Heap_GetUsagePercentage(runtime->heap) > 100)
+		if(!collect(runtime, error))
+			return -1;
+
+	return frame->index;
+}
+
+// Completes an instruction executed by one of the
+// entry points below, like [Runtime_ExecInstr] does.
+static int finish_instr(Runtime *runtime, Error *error, Frame *frame, _Bool ok)
+{
+	if(!ok)
+		return -1;
+
+	if(Heap_GetUsagePercentage(runtime->heap) > 100)
+		if(!collect(runtime, error))
+			return -1;
+
+	return frame->index;
+}
+
+/* Symbol: Runtime_ExecMathOp
+ *
+ *   Like [Runtime_ExecInstr], but only for the generic
+ *   arithmetic and relational instructions (ADD, .., DIV
+ *   and LSS, .., GEQ). Compiled code calls it to skip the
+ *   dispatch when it knows the opcode in advance.
+ */
+int Runtime_ExecMathOp(Runtime *runtime, Error *error, int index, Opcode opcode)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+	return finish_instr(runtime, error, frame, exec_math_op(runtime, error, opcode));
+}
+
+/* Symbol: Runtime_ExecCall
+ *
+ *   Like [Runtime_ExecInstr], but only for CALL.
+ */
+int Runtime_ExecCall(Runtime *runtime, Error *error, int index, int argc, int retc)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+	return finish_instr(runtime, error, frame, exec_call(runtime, error, argc, retc));
+}
+
+/* Symbol: Runtime_ExecSelect
+ *
+ *   Like [Runtime_ExecInstr], but only for SELECT.
+ */
+int Runtime_ExecSelect(Runtime *runtime, Error *error, int index)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+	return finish_instr(runtime, error, frame, exec_select(runtime, error));
+}
+
+/* Symbol: Runtime_ExecInsert
+ *
+ *   Like [Runtime_ExecInstr], but only for INSERT 
+ *   and INSERT2.
+ */
+int Runtime_ExecInsert(Runtime *runtime, Error *error, int index, Opcode opcode)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+	return finish_instr(runtime, error, frame, exec_insert(runtime, error, opcode));
+}
+
+/* Symbol: Runtime_ExecPushVar
+ *
+ *   Like [Runtime_ExecInstr], but only for PUSHVAR.
+ */
+int Runtime_ExecPushVar(Runtime *runtime, Error *error, int index, const char *name)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+	return finish_instr(runtime, error, frame, exec_push_var(runtime, error, name));
+}
+
+/* Symbol: Runtime_ExecAssign
+ *
+ *   Like [Runtime_ExecInstr], but only for ASS.
+ */
+int Runtime_ExecAssign(Runtime *runtime, Error *error, int index, const char *name)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+	return finish_instr(runtime, error, frame, exec_assign(runtime, error, name));
+}
+
+/* Symbol: Runtime_ExecPushInt
+ *
+ *   Like [Runtime_ExecInstr], but only for PUSHINT.
+ */
+int Runtime_ExecPushInt(Runtime *runtime, Error *error, int index, long long int val)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+
+	Object *obj = Object_FromInt(val, runtime->heap, error);
+
+	return finish_instr(runtime, error, frame, obj != NULL && Runtime_Push(runtime, error, obj));
+}
+
+/* Symbol: Runtime_ExecIntResult
+ *
+ *   Completes the arithmetic instruction at [index] for
+ *   compiled code that found two ints on top of the stack
+ *   and already calculated the result [val]. The operands
+ *   are replaced by the result.
+ */
+int Runtime_ExecIntResult(Runtime *runtime, Error *error, int index, long long int val)
+{
+	Frame *frame = runtime->frame;
+	frame->index = index + 1;
+
+	Object *res = Object_FromInt(val, runtime->heap, error);
+
+	_Bool ok = res != NULL 
+			&& Runtime_Pop(runtime, error, 2) 
+			&& Runtime_Push(runtime, error, res);
+
+	return finish_instr(runtime, error, frame, ok);
+}
+
+_Bool Runtime_EnableJIT(Runtime *runtime)
+{
+	if(runtime->jit == NULL && runtime->callback_addr == NULL)
+		runtime->jit = JIT_New();
+
+	return runtime->jit != NULL;
+}
+
+/* Symbol: Runtime_SetNativeBody
+ *
+ *   Makes the runtime execute the code of [exe] by calling
+ *   [body] instead of interpreting it. The [body] is called
+ *   with the index of the function's first instruction every
+ *   time a function of [exe] is called and must execute the
+ *   function like the interpreter would do, until it returns
+ *   or an error occurres. This is used by the programs generated
+ *   by the ahead-of-time compiler.
+ */
+void Runtime_SetNativeBody(Runtime *runtime, Executable *exe, void (*body)(Runtime*, Error*, int))
+{
+	runtime->native_exe = exe;
+	runtime->native_body = body;
+}
+
+/* Symbol: Runtime_SetProfile
+ *
+ *   Makes the runtime record in [profile] the operand
+ *   types of the arithmetic and relational instructions 
+ *   of [exe] that it executes.
+ */
+void Runtime_SetProfile(Runtime *runtime, Executable *exe, Profile *profile)
+{
+	runtime->profile_exe = exe;
+	runtime->profile = profile;
+}
+
+static void run_jit(Runtime *runtime, Error *error, int entry)
+{
+	Frame *frame = runtime->frame;
+
+	// Entering the function counts as a hit.
+	JITFunction *func = JIT_Tick(runtime->jit, frame->exe, entry, 1);
+
+	while(1)
+	{
+		if(func != NULL)
+		{
+			if(JIT_Run(func, runtime, error, frame->index))
+				return;
+			func = NULL;
+		}
+
+		int prev = frame->index;
+
+		if(!step(runtime, error))
+			break;
+
+		if(Heap_GetUsagePercentage(runtime->heap) > 100)
+			if(!collect(runtime, error))
+				break;
+
+		// Backward jumps are counted as hits so that long
+		// running loops can be moved to machine code while
+		// they're executing.
+		if(frame->index <= prev)
+			func = JIT_Tick(runtime->jit, frame->exe, entry, 1);
+	}
 }
 
 int run(Runtime *runtime, Error *error, Executable *exe, int index, Object *closure, Object **argv, int argc, Object **rets, int maxretc)
@@ -1333,6 +1901,10 @@ int run(Runtime *runtime, Error *error, Executable *exe, int index, Object *clos
 						break;
 			}
 	}
+	else if(runtime->native_body != NULL && runtime->native_exe == exe)
+		runtime->native_body(runtime, error, index);
+	else if(runtime->jit != NULL)
+		run_jit(runtime, error, index);
 	else
 		while(step(runtime, error))
 		{
@@ -36,6 +36,7 @@
 #include "../utils/stack.h"
 #include "../objects/objects.h"
 #include "../common/executable.h"
+#include "../common/profile.h"
 
 typedef struct xRuntime Runtime;
 typedef struct xSnapshot Snapshot;
@@ -51,6 +52,18 @@ Object*		Runtime_GetBuiltins(Runtime *runtime);
 void 		Runtime_SetBuiltins(Runtime *runtime, Object *builtins);
 int 		Runtime_GetCurrentIndex(Runtime *runtime);
 Executable *Runtime_GetCurrentExecutable(Runtime *runtime);
+_Bool       Runtime_EnableJIT(Runtime *runtime);
+void        Runtime_SetNativeBody(Runtime *runtime, Executable *exe, void (*body)(Runtime*, Error*, int));
+void        Runtime_SetProfile(Runtime *runtime, Executable *exe, Profile *profile);
+int         Runtime_ExecInstr(Runtime *runtime, Error *error, int index, Opcode opcode, Operand *ops, int opc);
+int         Runtime_ExecMathOp(Runtime *runtime, Error *error, int index, Opcode opcode);
+int         Runtime_ExecCall(Runtime *runtime, Error *error, int index, int argc, int retc);
+int         Runtime_ExecSelect(Runtime *runtime, Error *error, int index);
+int         Runtime_ExecInsert(Runtime *runtime, Error *error, int index, Opcode opcode);
+int         Runtime_ExecPushVar(Runtime *runtime, Error *error, int index, const char *name);
+int         Runtime_ExecAssign(Runtime *runtime, Error *error, int index, const char *name);
+int         Runtime_ExecPushInt(Runtime *runtime, Error *error, int index, long long int val);
+int         Runtime_ExecIntResult(Runtime *runtime, Error *error, int index, long long int val);
 Snapshot   *Snapshot_New(Runtime *runtime);
 void 	    Snapshot_Free(Snapshot *snapshot);
 void 	    Snapshot_Print(Snapshot *snapshot, FILE *fp);
@@ -0,0 +1,147 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+*/
+
+#ifndef RUNTIMEi_H
+#define RUNTIMEi_H
+#include "../utils/stacki.h"
+#include "runtime.h"
+#include "jit.h"
+
+// The layout of the runtime is shared with the code
+// generated by the JIT and the ahead-of-time compiler, 
+// which accesses the stack and the current frame directly.
+
+#define MAX_FRAME_STACK 16
+#define MAX_FRAMES 16
+
+typedef struct xFrame Frame;
+struct xFrame {
+	Frame  *prev;
+	Object *locals;
+	Object *closure;
+	Executable *exe;
+	int index, used;
+};
+
+struct xRuntime {
+	void *callback_userp;
+	_Bool (*callback_addr)(Runtime*, void*);
+	_Bool free_heap;
+	Object *builtins;
+	int    depth;
+	Frame *frame;
+	Stack *stack;
+	Heap  *heap;
+	JIT   *jit;
+	Executable *native_exe;
+	void (*native_body)(Runtime*, Error*, int);
+	Executable *profile_exe;
+	Profile    *profile;
+
+	// Hash table of the strings made from the
+	// identifiers and literals of the code.
+	Object **interned;
+	int      interned_count;
+	int      interned_capacity;
+};
+
+/* Symbol: Runtime_TopInts
+ *
+ *   Used by compiled code to execute the operations on
+ *   ints without calling the runtime. If the two values
+ *   on top of the stack are ints, they're stored in [lop]
+ *   and [rop]. When [guarded] is false the types aren't
+ *   checked, because the compiler proved them. Guarded
+ *   operations are also left to the runtime while it's
+ *   recording a profile.
+ *
+ * Returns:
+ *   1 if the operands were stored, 0 otherwise.
+ */
+static inline _Bool Runtime_TopInts(Runtime *runtime, _Bool guarded, long long int *lop, long long int *rop)
+{
+	Stack *stack = runtime->stack;
+
+	if(runtime->frame->used < 2)
+		return 0;
+
+	Object *l = stack->body[stack->used-2];
+	Object *r = stack->body[stack->used-1];
+
+	if(guarded && (runtime->profile != NULL || l->type_index != TYPE_INT || r->type_index != TYPE_INT))
+		return 0;
+
+	*lop = ((IntObject*) l)->val;
+	*rop = ((IntObject*) r)->val;
+	return 1;
+}
+
+/* Symbol: Runtime_ReplaceTopWithBool
+ *
+ *   Replaces the two operands found by [Runtime_TopInts]
+ *   with the result of their comparison.
+ */
+static inline void Runtime_ReplaceTopWithBool(Runtime *runtime, Error *error, _Bool val)
+{
+	Stack *stack = runtime->stack;
+
+	stack->body[stack->used-2] = Object_FromBool(val, runtime->heap, error);
+	stack->used -= 1;
+	runtime->frame->used -= 1;
+}
+
+/* Symbol: Runtime_PopCondition
+ *
+ *   Pops the boolean on top of the stack and stores its
+ *   value in [cond], like the conditional jumps do.
+ *
+ * Returns:
+ *   1 if the value was popped, 0 if there was no boolean
+ *   on top of the stack. In that case the conditional jump
+ *   must be left to the runtime, which reports the error.
+ */
+static inline _Bool Runtime_PopCondition(Runtime *runtime, Error *error, _Bool *cond)
+{
+	Stack *stack = runtime->stack;
+
+	if(runtime->frame->used < 1)
+		return 0;
+
+	Object *top = stack->body[stack->used-1];
+
+	if(top->type_index != TYPE_BOOL)
+		return 0;
+
+	*cond = Object_ToBool(top, error);
+	stack->used -= 1;
+	runtime->frame->used -= 1;
+	return 1;
+}
+#endif
@@ -31,19 +31,67 @@
 #include <stdint.h>
 #include "hash.h"
 
-int hashbytes(unsigned char *str, int len)
+#define HASH_MULTIPLIER 1000003U
+
+/* Symbol: hashstep
+ *
+ *   Feeds [len] bytes to the hash state [state].
+ *   The state of a string is a polynomial in the
+ *   multiplier, so the state of a concatenation 
+ *   can also be computed with [hashjoin] from the
+ *   states of its parts.
+ */
+unsigned int hashstep(unsigned int state, const unsigned char *str, int len)
 {
-	int x = 0; // Temp?
+	for(int i = 0; i < len; i += 1)
+		state = HASH_MULTIPLIER * state + str[i];
+	return state;
+}
 
-	x ^= *str << 7;
+/* Symbol: hashjoin
+ *
+ *   Returns the state of the concatenation of two
+ *   byte strings given their states and the length
+ *   of the second one, without reading the bytes.
+ */
+unsigned int hashjoin(unsigned int left, unsigned int right, int right_len)
+{
+	unsigned int power = 1;
+	unsigned int base = HASH_MULTIPLIER;
 
-	for(int i = 0; i < len; i += 1)
-		x = (1000003UL * x) ^ *str++;
+	for(unsigned int n = right_len; n > 0; n >>= 1)
+	{
+		if(n & 1)
+			power *= base;
+		base *= base;
+	}
 
-	x ^= len;
+	return left * power + right;
+}
 
-	if(x == -1)
+/* Symbol: hashfinish
+ *
+ *   Turns the state of a byte string into its hash.
+ *   The state's low bits only depend on the low bits
+ *   of the bytes, so they're mixed with the high ones.
+ */
+int hashfinish(unsigned int state, int len)
+{
+	unsigned int x = state ^ (unsigned int) len;
+
+	x ^= x >> 16;
+	x *= 0x85ebca6bU;
+	x ^= x >> 13;
+	x *= 0xc2b2ae35U;
+	x ^= x >> 16;
+
+	if((int) x == -1)
 		x = -2;
 	
-	return x;
-}
\ No newline at end of file
+	return (int) x;
+}
+
+int hashbytes(unsigned char *str, int len)
+{
+	return hashfinish(hashstep(0, str, len), len);
+}
@@ -31,4 +31,7 @@
 #ifndef HASH_H
 #define HASH_H
 int hashbytes(unsigned char *str, int len);
+unsigned int hashstep(unsigned int state, const unsigned char *str, int len);
+unsigned int hashjoin(unsigned int left, unsigned int right, int right_len);
+int hashfinish(unsigned int state, int len);
 #endif
\ No newline at end of file
@@ -30,16 +30,9 @@
 
 #include <stdint.h>
 #include <stdlib.h>
-#include "stack.h"
+#include "stacki.h"
 #include "defs.h"
 
-struct xStack {
-	unsigned int size, 
-				 used;
-	int 		 refs;
-	void 		*body[];
-};
-
 _Bool Stack_IsReadOnlyCopy(Stack *s)
 {
 	return (uintptr_t) s & (uintptr_t) 1;
@@ -222,31 +222,17 @@ int utf8_sequence_to_utf32_codepoint(const char *utf8_data, int nbytes, uint32_t
 }
 
 /* SYMBOL
-**   utf8_strlen
+**   utf8_strlen_scalar
 **
 ** DESCRIPTION
-**   Count the number of characters of a UTF-8 string. 
-**
-**   NOTE: By "character" we mean a valid UTF-8 sequence. 
-**
-** ARGUMENTS
-**   The [utf8_data] pointer refers to the location of the UTF-8 string.
-**
-**   The [nbytes] argument specifies the byte count of the string referred
-**   by [utf8_data]. It can't be negative. 
-**
-** RETURN
-**   Returns the number of characters encoded by [utf8_data], or -1 if
-**   the string is not valid UTF-8.
+**   Portable implementation of [utf8_strlen]. It's also what the
+**   vectorized kernels fall back to for the bytes they can't handle.
 **
-** NOTE: By calling this function on an ASCII-only string, the return
-**       value is equal to [nbytes].
-**
-** NOTE: You can check the validity of a UTF-8 string
-**       by calling this function and checking that it's
-**       return value is not negative.
+**   The decoding rules of [utf8_sequence_to_utf32_codepoint] are
+**   loose (continuation bytes aren't checked), so this is also the
+**   function that defines what the other kernels have to return.
 */
-int utf8_strlen(const char *utf8_data, int nbytes)
+static int utf8_strlen_scalar(const char *utf8_data, int nbytes)
 {
     assert(utf8_data != NULL);
     assert(nbytes >= 0);
@@ -292,6 +278,341 @@ int utf8_strlen(const char *utf8_data, int nbytes)
     return len;
 }
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_SIMD 1
+#include <immintrin.h>
+
+/* SYMBOL
+**   utf8_strlen_sse2
+**
+** DESCRIPTION
+**   Skips ASCII 16 bytes at the time and decodes everything
+**   else using the scalar decoder. SSE2 has no byte shuffle,
+**   so the table-driven validation of the AVX2 kernel isn't
+**   available here.
+*/
+__attribute__((target("sse2")))
+static int utf8_strlen_sse2(const char *utf8_data, int nbytes)
+{
+    assert(utf8_data != NULL);
+    assert(nbytes >= 0);
+
+    int len = 0;
+
+    int i = 0;
+    while(i < nbytes)
+    {
+        // Skip through ASCII. Only worth it if the next
+        // byte is ASCII, else runs of unicode would pay
+        // for a vector load per character.
+        while(i + 16 <= nbytes && (utf8_data[i] & 0x80) == 0)
+        {
+            __m128i block = _mm_loadu_si128((const __m128i*) (utf8_data + i));
+            int mask = _mm_movemask_epi8(block);
+            if(mask != 0)
+            {
+                int ASCII_count = __builtin_ctz(mask);
+                i   += ASCII_count;
+                len += ASCII_count;
+                break;
+            }
+            i   += 16;
+            len += 16;
+        }
+
+        while(i < nbytes && (utf8_data[i] & 0x80) == 0)
+        {
+            i += 1;
+            len += 1;
+        }
+
+        if(i == nbytes)
+            break;
+
+        int n = utf8_sequence_to_utf32_codepoint(utf8_data + i, nbytes - i, NULL);
+
+        if(n < 1)
+            return -1;
+
+        i += n;
+        len += 1;
+    }
+    return len;
+}
+
+// Error classes of the AVX2 validator. Each one is a bit
+// that's set by all three lookup tables only when the
+// pair of bytes it looks at makes that error happen.
+#define TOO_SHORT      (1 << 0) // Lead byte not followed by a continuation
+#define TOO_LONG       (1 << 1) // Continuation not preceded by a lead byte
+#define OVERLONG_3     (1 << 2) // 11100000 100_____
+#define TOO_LARGE      (1 << 3) // 11110100 1001____ and above
+#define SURROGATE      (1 << 4) // 11101101 101_____
+#define OVERLONG_2     (1 << 5) // 1100000_ ________
+#define TOO_LARGE_1000 (1 << 6) // 11110101 1000____ and above
+#define OVERLONG_4     (1 << 6) // 11110000 1000____
+#define TWO_CONTS      (1 << 7) // Two continuations in a row
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+#define REPEAT16(...) __VA_ARGS__, __VA_ARGS__
+
+__attribute__((target("avx2")))
+static inline __m256i prev_bytes(__m256i input, __m256i prev_input, const int n)
+{
+    __m256i shifted_in = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch(n)
+    {
+        case 1: return _mm256_alignr_epi8(input, shifted_in, 15);
+        case 2: return _mm256_alignr_epi8(input, shifted_in, 14);
+        default:return _mm256_alignr_epi8(input, shifted_in, 13);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i high_nibbles(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+/* SYMBOL
+**   check_block_avx2
+**
+** DESCRIPTION
+**   Validates a 32 byte block against the previous one using
+**   the lookup algorithm by Keiser and Lemire: the high and
+**   low nibble of each byte and the high nibble of the one
+**   that follows are mapped to the set of errors they may
+**   cause, and an error happened where the three sets meet.
+**
+** RETURN
+**   A vector that's non-zero where the block is not valid
+**   UTF-8 (incomplete sequences at the end of the block are
+**   not counted).
+*/
+__attribute__((target("avx2")))
+static inline __m256i check_block_avx2(__m256i input, __m256i prev_input)
+{
+    const __m256i byte_1_high_table = _mm256_setr_epi8(REPEAT16(
+        // 0_______ ________ <ASCII in byte 1>
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        // 10______ ________ <continuation in byte 1>
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        // 1100____ ________ <two byte lead in byte 1>
+        TOO_SHORT | OVERLONG_2,
+        // 1101____ ________ <two byte lead in byte 1>
+        TOO_SHORT,
+        // 1110____ ________ <three byte lead in byte 1>
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        // 1111____ ________ <four+ byte lead in byte 1>
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4));
+
+    const __m256i byte_1_low_table = _mm256_setr_epi8(REPEAT16(
+        // ____0000 ________
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        // ____0001 ________
+        CARRY | OVERLONG_2,
+        // ____001_ ________
+        CARRY,
+        CARRY,
+        // ____0100 ________
+        CARRY | TOO_LARGE,
+        // ____0101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____011_ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1___ ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1101 ________
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000));
+
+    const __m256i byte_2_high_table = _mm256_setr_epi8(REPEAT16(
+        // ________ 0_______ <ASCII in byte 2>
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        // ________ 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        // ________ 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        // ________ 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+        // ________ 11______ <lead byte in byte 2>
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT));
+
+    __m256i prev1 = prev_bytes(input, prev_input, 1);
+    __m256i prev2 = prev_bytes(input, prev_input, 2);
+    __m256i prev3 = prev_bytes(input, prev_input, 3);
+
+    __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, high_nibbles(prev1));
+    __m256i byte_1_low  = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+    __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, high_nibbles(input));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    // The third and fourth byte of 3 and 4 byte sequences
+    // must be continuations. Those are the only places where
+    // two continuations in a row are allowed.
+    __m256i is_third_byte  = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char) (0xE0 - 0x80)));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char) (0xF0 - 0x80)));
+    __m256i must_be_2_3_continuation = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char) 0x80));
+
+    return _mm256_xor_si256(must_be_2_3_continuation, special_cases);
+}
+
+/* SYMBOL
+**   utf8_strlen_avx2
+**
+** DESCRIPTION
+**   Validates and counts 32 bytes at the time. When the string
+**   is strictly valid UTF-8 the character count is the number
+**   of bytes that aren't continuations. Anything that isn't
+**   strictly valid (stray continuations, overlong sequences or
+**   surrogates, which the scalar decoder lets through) is handed
+**   back to [utf8_strlen_scalar] so that both always agree.
+*/
+__attribute__((target("avx2")))
+static int utf8_strlen_avx2(const char *utf8_data, int nbytes)
+{
+    assert(utf8_data != NULL);
+    assert(nbytes >= 0);
+
+    // Every byte at the end of a block greater or equal
+    // to the corresponding byte of this vector starts a
+    // sequence that doesn't fit in the block.
+    const __m256i max_complete = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, (char) (0xF0 - 1), (char) (0xE0 - 1), (char) (0xC0 - 1));
+
+    const __m256i last_continuation = _mm256_set1_epi8(-65); // 0xBF
+
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+
+    int len = 0;
+
+    int i = 0;
+    while(i + 32 <= nbytes)
+    {
+        __m256i input = _mm256_loadu_si256((const __m256i*) (utf8_data + i));
+        __m256i error;
+
+        if(_mm256_movemask_epi8(input) == 0)
+        {
+            // All ASCII. The only possible error is
+            // a sequence left open by the last block.
+            error = prev_incomplete;
+            prev_incomplete = _mm256_setzero_si256();
+            len += 32;
+        }
+        else
+        {
+            // Sequences left open by the last block are
+            // checked against this one's continuations.
+            error = check_block_avx2(input, prev_input);
+            prev_incomplete = _mm256_subs_epu8(input, max_complete);
+            len += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpgt_epi8(input, last_continuation)));
+        }
+
+        if(!_mm256_testz_si256(error, error))
+            return utf8_strlen_scalar(utf8_data, nbytes);
+
+        prev_input = input;
+        i += 32;
+    }
+
+    if(!_mm256_testz_si256(prev_incomplete, prev_incomplete))
+    {
+        // The last block ended in the middle of a sequence.
+        // Its lead byte was counted, so go back to it and
+        // let the scalar code count it again.
+        do
+            i -= 1;
+        while(((unsigned char) utf8_data[i] & 0xC0) == 0x80);
+        len -= 1;
+    }
+
+    int tail = utf8_strlen_scalar(utf8_data + i, nbytes - i);
+    if(tail < 0)
+        return -1;
+
+    return len + tail;
+}
+
+#undef TOO_SHORT
+#undef TOO_LONG
+#undef OVERLONG_3
+#undef TOO_LARGE
+#undef SURROGATE
+#undef OVERLONG_2
+#undef TOO_LARGE_1000
+#undef OVERLONG_4
+#undef TWO_CONTS
+#undef CARRY
+#undef REPEAT16
+#endif
+
+static int utf8_strlen_select(const char *utf8_data, int nbytes);
+
+// Kernel used by [utf8_strlen]. It's chosen the first time
+// it's called based on what the CPU supports. Threads racing
+// on the first call all store the same value.
+static int (*utf8_strlen_kernel)(const char*, int) = utf8_strlen_select;
+
+static int utf8_strlen_select(const char *utf8_data, int nbytes)
+{
+    int (*kernel)(const char*, int) = utf8_strlen_scalar;
+
+#if UTF8_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        kernel = utf8_strlen_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        kernel = utf8_strlen_sse2;
+#endif
+
+    __atomic_store_n(&utf8_strlen_kernel, kernel, __ATOMIC_RELAXED);
+    return kernel(utf8_data, nbytes);
+}
+
+/* SYMBOL
+**   utf8_strlen
+**
+** DESCRIPTION
+**   Count the number of characters of a UTF-8 string. 
+**
+**   NOTE: By "character" we mean a valid UTF-8 sequence. 
+**
+** ARGUMENTS
+**   The [utf8_data] pointer refers to the location of the UTF-8 string.
+**
+**   The [nbytes] argument specifies the byte count of the string referred
+**   by [utf8_data]. It can't be negative. 
+**
+** RETURN
+**   Returns the number of characters encoded by [utf8_data], or -1 if
+**   the string is not valid UTF-8.
+**
+** NOTE: By calling this function on an ASCII-only string, the return
+**       value is equal to [nbytes].
+**
+** NOTE: You can check the validity of a UTF-8 string
+**       by calling this function and checking that it's
+**       return value is not negative.
+*/
+int utf8_strlen(const char *utf8_data, int nbytes)
+{
+    return __atomic_load_n(&utf8_strlen_kernel, __ATOMIC_RELAXED)(utf8_data, nbytes);
+}
+
 /* SYMBOL
 **   utf8_prev
 **
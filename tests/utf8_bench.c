@@ -0,0 +1,217 @@
+
+/* +--------------------------------------------------------------------------+
+** |                          _   _       _                                   |
+** |                         | \ | |     (_)                                  |
+** |                         |  \| | ___  _  __ _                             |
+** |                         | . ` |/ _ \| |/ _` |                            |
+** |                         | |\  | (_) | | (_| |                            |
+** |                         |_| \_|\___/| |\__,_|                            |
+** |                                    _/ |                                  |
+** |                                   |__/                                   |
+** +--------------------------------------------------------------------------+
+** | Copyright (c) 2022 Francesco Cozzuto <francesco.cozzuto@gmail.com>       |
+** +--------------------------------------------------------------------------+
+** | This file is part of The Noja Interpreter.                               |
+** |                                                                          |
+** | The Noja Interpreter is free software: you can redistribute it and/or    |
+** | modify it under the terms of the GNU General Public License as published |
+** | by the Free Software Foundation, either version 3 of the License, or (at |
+** | your option) any later version.                                          |
+** |                                                                          |
+** | The Noja Interpreter is distributed in the hope that it will be useful,  |
+** | but WITHOUT ANY WARRANTY; without even the implied warranty of           |
+** | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General |
+** | Public License for more details.                                         |
+** |                                                                          |
+** | You should have received a copy of the GNU General Public License along  |
+** | with The Noja Interpreter. If not, see <http://www.gnu.org/licenses/>.   |
+** +--------------------------------------------------------------------------+ 
+** |                                                                          |
+** | Microbenchmark of the [utf8_strlen] kernels. It first checks that all    |
+** | kernels return the same thing as the scalar one on random and mutated    |
+** | inputs, then measures the throughput of each one on ASCII text and on    |
+** | text made of 2, 3 and 4 byte sequences.                                  |
+** |                                                                          |
+** | Build it with "make utf8_bench" and run "./build/utf8_bench".            |
+** |                                                                          |
+** +--------------------------------------------------------------------------+ 
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The kernels are static, so include the
+// implementation instead of linking it.
+#include "../src/utils/utf8.c"
+
+typedef struct {
+    const char *name;
+    int (*func)(const char*, int);
+} Kernel;
+
+static Kernel kernels[] = {
+    { "scalar", utf8_strlen_scalar },
+#if UTF8_SIMD
+    { "sse2",   utf8_strlen_sse2   },
+    { "avx2",   utf8_strlen_avx2   },
+#endif
+};
+
+#define KERNEL_COUNT (int) (sizeof(kernels) / sizeof(kernels[0]))
+
+static _Bool kernel_supported(int k)
+{
+#if UTF8_SIMD
+    if(kernels[k].func == utf8_strlen_avx2)
+        return __builtin_cpu_supports("avx2");
+    if(kernels[k].func == utf8_strlen_sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return 1;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fill [buff] with [count] bytes of text made of
+// random code points that encode to [width] bytes.
+static int fill(char *buff, int count, int width)
+{
+    static const uint32_t ranges[4][2] = {
+        { 0x20,    0x7E     },
+        { 0x80,    0x7FF    },
+        { 0x800,   0xD7FF   },
+        { 0x10000, 0x10FFFF },
+    };
+
+    int i = 0;
+    while(i + width <= count)
+    {
+        uint32_t lo = ranges[width-1][0];
+        uint32_t hi = ranges[width-1][1];
+        uint32_t code = lo + (uint32_t) rand() % (hi - lo + 1);
+        i += utf8_sequence_from_utf32_codepoint(buff + i, count - i, code);
+    }
+    return i;
+}
+
+static _Bool check(const char *str, int len)
+{
+    int expected = utf8_strlen_scalar(str, len);
+    for(int k = 1; k < KERNEL_COUNT; k += 1)
+    {
+        if(!kernel_supported(k))
+            continue;
+
+        int result = kernels[k].func(str, len);
+        if(result != expected)
+        {
+            fprintf(stderr, "Kernel %s returned %d instead of %d on a string of %d bytes\n",
+                    kernels[k].name, result, expected, len);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static _Bool verify(void)
+{
+    static char buff[1024];
+    static const unsigned char special[] = {
+        0x00, 0x7F, 0x80, 0xBF, 0xC0, 0xC1, 0xC2, 0xDF, 0xE0, 0xED,
+        0xEF, 0xF0, 0xF4, 0xF5, 0xFF, 0x8F, 0x90, 0x9F, 0xA0,
+    };
+
+    for(int round = 0; round < 200000; round += 1)
+    {
+        int len = rand() % sizeof(buff);
+
+        // Start from valid text so that most mutations
+        // only break it at a few places.
+        int width = 1 + rand() % 4;
+        len = fill(buff, len, width);
+        for(int i = 0; i < len; i += 1)
+            if(rand() % 8 == 0)
+            {
+                int  n = fill(buff + i, len - i < 4 ? len - i : 4, 1 + rand() % 4);
+                i += n;
+            }
+
+        int mutations = rand() % 4;
+        for(int m = 0; m < mutations && len > 0; m += 1)
+        {
+            int pos = rand() % len;
+            if(rand() % 2)
+                buff[pos] = special[rand() % sizeof(special)];
+            else
+                buff[pos] = rand();
+        }
+
+        if(!check(buff, len))
+            return 0;
+
+        // Also try every prefix of short strings, to
+        // hit sequences cut at the end of a block.
+        if(len < 80)
+            for(int i = 0; i < len; i += 1)
+                if(!check(buff, i))
+                    return 0;
+    }
+    return 1;
+}
+
+static void bench(const char *name, const char *str, int len)
+{
+    printf("%-6s", name);
+    for(int k = 0; k < KERNEL_COUNT; k += 1)
+    {
+        if(!kernel_supported(k))
+        {
+            printf("  %8s: %10s", kernels[k].name, "n/a");
+            continue;
+        }
+
+        int repeat = 20;
+        volatile int sink = 0;
+
+        double start = now();
+        for(int r = 0; r < repeat; r += 1)
+            sink += kernels[k].func(str, len);
+        double elapsed = now() - start;
+        (void) sink;
+
+        double mbps = (double) len * repeat / elapsed / (1024 * 1024);
+        printf("  %8s: %7.0f MB/s", kernels[k].name, mbps);
+    }
+    printf("\n");
+}
+
+int main(void)
+{
+    srand(1);
+
+    if(!verify())
+        return -1;
+    printf("All kernels agree with the scalar one.\n");
+
+    int size = 8 * 1024 * 1024;
+    char *buff = malloc(size);
+    if(buff == NULL)
+        return -1;
+
+    static const char *names[] = { "ascii", "2-byte", "3-byte", "4-byte" };
+    for(int width = 1; width <= 4; width += 1)
+    {
+        int len = fill(buff, size, width);
+        bench(names[width-1], buff, len);
+    }
+
+    free(buff);
+    return 0;
+}